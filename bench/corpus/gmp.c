@@ -0,0 +1,12 @@
+#include <stdio.h>
+#include <gmp.h>
+
+// 1000! exercises multiplication and conversion in the GMP addon
+int main(void) {
+    mpz_t result;
+    mpz_init(result);
+    mpz_fac_ui(result, 1000);
+    printf("1000! has %zu digits\n", mpz_sizeinbase(result, 10));
+    mpz_clear(result);
+    return 0;
+}
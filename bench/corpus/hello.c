@@ -0,0 +1,6 @@
+#include <stdio.h>
+
+int main(void) {
+    printf("Hello from SSCC!\n");
+    return 0;
+}
@@ -0,0 +1,8 @@
+#include "words.h"
+
+// djb2
+unsigned long hash_string(const char *s) {
+    unsigned long h = 5381;
+    while (*s) h = h * 33 + (unsigned char)*s++;
+    return h;
+}
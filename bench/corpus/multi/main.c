@@ -0,0 +1,21 @@
+#include <stdio.h>
+#include "words.h"
+
+static const char text[] =
+    "the quick brown fox jumps over the lazy dog and the dog sleeps "
+    "while the fox runs over the hills and far away from the dog";
+
+int main(void) {
+    WordTable *table = table_new(64);
+    char word[64];
+    size_t pos = 0;
+    
+    while ((pos = next_word(text, pos, word, sizeof(word))) != 0) {
+        table_add(table, word);
+    }
+    
+    static const char *const probes[] = { "the", "dog", "fox", "cat" };
+    report(table, probes, sizeof(probes) / sizeof(probes[0]));
+    table_free(table);
+    return 0;
+}
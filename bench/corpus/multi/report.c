@@ -0,0 +1,9 @@
+#include <stdio.h>
+#include "words.h"
+
+void report(const WordTable *table, const char *const *words, size_t count) {
+    printf("%zu unique words\n", table_unique(table));
+    for (size_t i = 0; i < count; i++) {
+        printf("  %-8s %zu\n", words[i], table_count(table, words[i]));
+    }
+}
@@ -0,0 +1,67 @@
+#include <stdlib.h>
+#include <string.h>
+#include "words.h"
+
+typedef struct Entry {
+    char *word;
+    size_t count;
+    struct Entry *next;
+} Entry;
+
+struct WordTable {
+    Entry **buckets;
+    size_t bucket_count;
+    size_t unique;
+};
+
+WordTable *table_new(size_t buckets) {
+    WordTable *table = calloc(1, sizeof(WordTable));
+    table->buckets = calloc(buckets, sizeof(Entry*));
+    table->bucket_count = buckets;
+    return table;
+}
+
+static Entry *find(const WordTable *table, const char *word) {
+    Entry *e = table->buckets[hash_string(word) % table->bucket_count];
+    while (e && strcmp(e->word, word) != 0) e = e->next;
+    return e;
+}
+
+void table_add(WordTable *table, const char *word) {
+    Entry *e = find(table, word);
+    if (e) {
+        e->count++;
+        return;
+    }
+    
+    size_t b = hash_string(word) % table->bucket_count;
+    e = malloc(sizeof(Entry));
+    e->word = strdup(word);
+    e->count = 1;
+    e->next = table->buckets[b];
+    table->buckets[b] = e;
+    table->unique++;
+}
+
+size_t table_count(const WordTable *table, const char *word) {
+    Entry *e = find(table, word);
+    return e ? e->count : 0;
+}
+
+size_t table_unique(const WordTable *table) {
+    return table->unique;
+}
+
+void table_free(WordTable *table) {
+    for (size_t i = 0; i < table->bucket_count; i++) {
+        Entry *e = table->buckets[i];
+        while (e) {
+            Entry *next = e->next;
+            free(e->word);
+            free(e);
+            e = next;
+        }
+    }
+    free(table->buckets);
+    free(table);
+}
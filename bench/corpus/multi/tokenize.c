@@ -0,0 +1,16 @@
+#include <ctype.h>
+#include "words.h"
+
+// Returns the position after the word copied into word, or 0 at the end
+size_t next_word(const char *text, size_t pos, char *word, size_t word_size) {
+    while (text[pos] && !isalpha((unsigned char)text[pos])) pos++;
+    if (!text[pos]) return 0;
+    
+    size_t len = 0;
+    while (isalpha((unsigned char)text[pos])) {
+        if (len + 1 < word_size) word[len++] = (char)tolower((unsigned char)text[pos]);
+        pos++;
+    }
+    word[len] = '\0';
+    return pos;
+}
@@ -0,0 +1,24 @@
+#ifndef WORDS_H
+#define WORDS_H
+
+#include <stddef.h>
+
+typedef struct WordTable WordTable;
+
+// tokenize.c
+size_t next_word(const char *text, size_t pos, char *word, size_t word_size);
+
+// table.c
+WordTable *table_new(size_t buckets);
+void table_add(WordTable *table, const char *word);
+size_t table_count(const WordTable *table, const char *word);
+size_t table_unique(const WordTable *table);
+void table_free(WordTable *table);
+
+// hash.c
+unsigned long hash_string(const char *s);
+
+// report.c
+void report(const WordTable *table, const char *const *words, size_t count);
+
+#endif
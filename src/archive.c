@@ -0,0 +1,1457 @@
+// SSCC archive reader/writer (see archive.h for the on-disk layout)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <lzma.h>
+#include "archive.h"
+#include "hash.h"
+#include "pool.h"
+
+#define MAX_INDEX_SEED_TRIES (1u << 20)
+
+static uint32_t read_u32(const unsigned char *p) {
+    uint32_t val;
+    memcpy(&val, p, sizeof(val));
+    return val;
+}
+
+// The archive checksum replaces per-entry xz checks, and the dictionary is
+// sized to the input so decoders do not reserve the preset's 64MB for a
+// header file
+int lzma_compress_data(const char *input, size_t input_size, char **output, size_t *output_size) {
+    lzma_stream strm = LZMA_STREAM_INIT;
+    
+    lzma_options_lzma options;
+    if (lzma_lzma_preset(&options, 9)) return -1;
+    if (options.dict_size > input_size) {
+        options.dict_size = input_size < LZMA_DICT_SIZE_MIN ? LZMA_DICT_SIZE_MIN : input_size;
+    }
+    lzma_filter filters[] = {
+        { LZMA_FILTER_LZMA2, &options },
+        { LZMA_VLI_UNKNOWN, NULL },
+    };
+    
+    lzma_ret ret = lzma_stream_encoder(&strm, filters, LZMA_CHECK_NONE);
+    if (ret != LZMA_OK) return -1;
+    
+    *output_size = input_size + (input_size / 3) + 128; // Buffer
+    *output = malloc(*output_size);
+    if (!*output) {
+        lzma_end(&strm);
+        return -1;
+    }
+    
+    strm.next_in = (const uint8_t*)input;
+    strm.avail_in = input_size;
+    strm.next_out = (uint8_t*)*output;
+    strm.avail_out = *output_size;
+    
+    ret = lzma_code(&strm, LZMA_FINISH);
+    if (ret != LZMA_STREAM_END) {
+        free(*output);
+        lzma_end(&strm);
+        return -1;
+    }
+    
+    *output_size = strm.total_out;
+    lzma_end(&strm);
+    return 0;
+}
+
+// Decodes the first output_size bytes of an xz stream. Solid entries only
+// need a prefix of their block, so a full output buffer also counts as done.
+static int xz_decode(const char *input, size_t input_size, char *output, size_t output_size,
+                     uint32_t flags, int prefix) {
+    lzma_stream strm = LZMA_STREAM_INIT;
+    
+    lzma_ret ret = lzma_stream_decoder(&strm, UINT64_MAX, LZMA_CONCATENATED | flags);
+    if (ret != LZMA_OK) return -1;
+    
+    strm.next_in = (const uint8_t*)input;
+    strm.avail_in = input_size;
+    strm.next_out = (uint8_t*)output;
+    strm.avail_out = output_size;
+    
+    ret = lzma_code(&strm, LZMA_FINISH);
+    lzma_end(&strm);
+    
+    if (strm.total_out != output_size) return -1;
+    return (ret == LZMA_STREAM_END || (prefix && (ret == LZMA_OK || ret == LZMA_BUF_ERROR))) ? 0 : -1;
+}
+
+int lzma_decompress_data(const char *input, size_t input_size, char *output, size_t output_size) {
+    return xz_decode(input, input_size, output, output_size, 0, 0);
+}
+
+// Fast LZ codec
+//
+// LZ4-style sequences: a token byte (literal count << 4 | match length - 4),
+// 255-continued length bytes for either nibble at 15, the literals, then a
+// 16-bit little-endian match offset. The final sequence carries literals
+// only. Decoding is a tight copy loop, several times faster than LZMA.
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 16
+#define LZ_CHAIN_DEPTH 64
+
+static uint32_t lz_hash(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static unsigned char *lz_put_length(unsigned char *op, size_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (unsigned char)len;
+    return op;
+}
+
+static unsigned char *lz_put_sequence(unsigned char *op, const unsigned char *literals, size_t literal_len,
+                                      size_t offset, size_t match_len) {
+    unsigned char *token = op++;
+    size_t ml = match_len ? match_len - LZ_MIN_MATCH : 0;
+    *token = (unsigned char)((literal_len >= 15 ? 15 : literal_len) << 4 | (ml >= 15 ? 15 : ml));
+    if (literal_len >= 15) op = lz_put_length(op, literal_len - 15);
+    memcpy(op, literals, literal_len);
+    op += literal_len;
+    if (match_len) {
+        *op++ = offset & 0xff;
+        *op++ = offset >> 8;
+        if (ml >= 15) op = lz_put_length(op, ml - 15);
+    }
+    return op;
+}
+
+static int lz_compress(const char *input, size_t input_size, char **output, size_t *output_size) {
+    const unsigned char *in = (const unsigned char*)input;
+    unsigned char *out = malloc(input_size + input_size / 255 + 16);
+    int32_t *head = malloc((1u << LZ_HASH_BITS) * sizeof(int32_t));
+    int32_t *chain = malloc((input_size + 1) * sizeof(int32_t));
+    if (!out || !head || !chain || input_size > INT32_MAX) {
+        free(out);
+        free(head);
+        free(chain);
+        return -1;
+    }
+    memset(head, 0xff, (1u << LZ_HASH_BITS) * sizeof(int32_t));
+    
+    // Greedy parse over hash chains; build time is cheap, decode time is not
+    unsigned char *op = out;
+    size_t ip = 0, anchor = 0;
+    while (ip + LZ_MIN_MATCH <= input_size) {
+        uint32_t h = lz_hash(in + ip);
+        size_t best_len = 0, best_offset = 0;
+        int depth = 0;
+        for (int32_t cand = head[h]; cand >= 0 && ip - cand <= LZ_MAX_OFFSET && depth < LZ_CHAIN_DEPTH;
+             cand = chain[cand], depth++) {
+            size_t len = 0, max = input_size - ip;
+            while (len < max && in[cand + len] == in[ip + len]) len++;
+            if (len > best_len) {
+                best_len = len;
+                best_offset = ip - cand;
+            }
+        }
+        chain[ip] = head[h];
+        head[h] = ip;
+        
+        if (best_len < LZ_MIN_MATCH) {
+            ip++;
+            continue;
+        }
+        
+        op = lz_put_sequence(op, in + anchor, ip - anchor, best_offset, best_len);
+        for (size_t k = ip + 1; k < ip + best_len && k + LZ_MIN_MATCH <= input_size; k++) {
+            h = lz_hash(in + k);
+            chain[k] = head[h];
+            head[h] = k;
+        }
+        ip += best_len;
+        anchor = ip;
+    }
+    op = lz_put_sequence(op, in + anchor, input_size - anchor, 0, 0);
+    
+    free(head);
+    free(chain);
+    *output = (char*)out;
+    *output_size = op - out;
+    return 0;
+}
+
+static int lz_get_length(const unsigned char **ip, const unsigned char *end, size_t *len) {
+    unsigned char b;
+    do {
+        if (*ip >= end) return -1;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+static int lz_decompress(const char *input, size_t input_size, char *output, size_t output_size) {
+    const unsigned char *ip = (const unsigned char*)input;
+    const unsigned char *end = ip + input_size;
+    unsigned char *out = (unsigned char*)output;
+    size_t op = 0;
+    
+    while (ip < end) {
+        unsigned char token = *ip++;
+        size_t literal_len = token >> 4;
+        if (literal_len == 15 && lz_get_length(&ip, end, &literal_len) != 0) return -1;
+        if (literal_len > (size_t)(end - ip) || literal_len > output_size - op) return -1;
+        memcpy(out + op, ip, literal_len);
+        ip += literal_len;
+        op += literal_len;
+        
+        if (ip == end) break;   // final, literal-only sequence
+        
+        if (end - ip < 2) return -1;
+        size_t offset = ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        size_t match_len = token & 15;
+        if (match_len == 15 && lz_get_length(&ip, end, &match_len) != 0) return -1;
+        match_len += LZ_MIN_MATCH;
+        if (offset == 0 || offset > op || match_len > output_size - op) return -1;
+        
+        unsigned char *dst = out + op;
+        const unsigned char *src = dst - offset;
+        if (offset >= match_len) {
+            memcpy(dst, src, match_len);
+        } else {
+            for (size_t k = 0; k < match_len; k++) dst[k] = src[k];
+        }
+        op += match_len;
+    }
+    return op == output_size ? 0 : -1;
+}
+
+// Perfect-hash index
+
+static uint32_t index_hash(const char *path, size_t len, uint32_t seed, uint32_t modulus) {
+    uint64_t h = sscc_hash64(path, len, SSCC_HASH_INIT ^ (seed * 0x9e3779b97f4a7c15ULL));
+    // FNV's low bits mix poorly; fold the high half in before reducing
+    h ^= h >> 29;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 32;
+    return (uint32_t)(h % modulus);
+}
+
+typedef struct {
+    uint32_t bucket;
+    uint32_t size;
+    uint32_t first;
+} IndexBucket;
+
+static int compare_buckets(const void *a, const void *b) {
+    const IndexBucket *x = a, *y = b;
+    if (x->size != y->size) return x->size < y->size ? 1 : -1;
+    return x->bucket < y->bucket ? -1 : (x->bucket > y->bucket);
+}
+
+// Hash-and-displace: keys are grouped into buckets, and each bucket (largest
+// first) searches for a seed that sends all its keys to free slots
+static int build_index(const char **paths, const uint32_t *lens, uint32_t n,
+                       uint32_t **index, uint32_t *index_size) {
+    uint32_t bucket_count = n / 4 + 1;
+    uint32_t slot_count = n + n / 4 + 1;
+    
+    uint32_t *next = malloc((n + 1) * sizeof(uint32_t));
+    IndexBucket *buckets = calloc(bucket_count, sizeof(IndexBucket));
+    uint32_t *out = malloc((2 + bucket_count + slot_count) * sizeof(uint32_t));
+    uint32_t *try_slots = malloc((n + 1) * sizeof(uint32_t));
+    if (!next || !buckets || !out || !try_slots) goto fail;
+    
+    for (uint32_t b = 0; b < bucket_count; b++) {
+        buckets[b].bucket = b;
+        buckets[b].first = UINT32_MAX;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t b = index_hash(paths[i], lens[i], 0, bucket_count);
+        next[i] = buckets[b].first;
+        buckets[b].first = i;
+        buckets[b].size++;
+    }
+    qsort(buckets, bucket_count, sizeof(IndexBucket), compare_buckets);
+    
+    uint32_t *seeds = out + 2;
+    uint32_t *slots = seeds + bucket_count;
+    out[0] = bucket_count;
+    out[1] = slot_count;
+    memset(seeds, 0, bucket_count * sizeof(uint32_t));
+    memset(slots, 0xff, slot_count * sizeof(uint32_t));
+    
+    for (uint32_t b = 0; b < bucket_count && buckets[b].size > 0; b++) {
+        uint32_t seed;
+        for (seed = 1; seed < MAX_INDEX_SEED_TRIES; seed++) {
+            uint32_t placed = 0;
+            uint32_t i;
+            for (i = buckets[b].first; i != UINT32_MAX; i = next[i]) {
+                uint32_t s = index_hash(paths[i], lens[i], seed, slot_count);
+                if (slots[s] != ARCHIVE_NO_INDEX) break;
+                
+                uint32_t k;
+                for (k = 0; k < placed && try_slots[k] != s; k++);
+                if (k < placed) break;
+                try_slots[placed++] = s;
+            }
+            if (i == UINT32_MAX) break;
+        }
+        
+        if (seed == MAX_INDEX_SEED_TRIES) {
+            // Only identical keys can defeat every seed
+            fprintf(stderr, "Error: Cannot build path index (duplicate path %s?)\n",
+                    paths[buckets[b].first]);
+            goto fail;
+        }
+        
+        uint32_t k = 0;
+        for (uint32_t i = buckets[b].first; i != UINT32_MAX; i = next[i]) {
+            slots[try_slots[k++]] = i;
+        }
+        seeds[buckets[b].bucket] = seed;
+    }
+    
+    free(next);
+    free(buckets);
+    free(try_slots);
+    *index = out;
+    *index_size = 2 + bucket_count + slot_count;
+    return 0;
+
+fail:
+    free(next);
+    free(buckets);
+    free(out);
+    free(try_slots);
+    return -1;
+}
+
+int archive_build_index(const Archive *a, uint32_t **index, uint32_t *index_size) {
+    const char **paths = malloc((a->file_count + 1) * sizeof(char*));
+    uint32_t *lens = malloc((a->file_count + 1) * sizeof(uint32_t));
+    if (!paths || !lens) {
+        free(paths);
+        free(lens);
+        return -1;
+    }
+    
+    for (uint32_t i = 0; i < a->file_count; i++) {
+        paths[i] = archive_path(a, &a->entries[i]);
+        lens[i] = a->entries[i].path_len;
+    }
+    
+    int ret = build_index(paths, lens, a->file_count, index, index_size);
+    free(paths);
+    free(lens);
+    return ret;
+}
+
+static int index_is_valid(const uint32_t *index, uint32_t index_size) {
+    return index && index_size >= 2 && index[0] > 0 && index[1] > 0 &&
+           (uint64_t)index[0] + index[1] + 2 == index_size;
+}
+
+void archive_set_index(Archive *a, const uint32_t *index, uint32_t index_size) {
+    if (index_is_valid(index, index_size)) {
+        a->index = index;
+        a->index_size = index_size;
+    }
+}
+
+const char *archive_path(const Archive *a, const ArchiveEntry *e) {
+    return a->strtab + e->path_offset;
+}
+
+const char *archive_dir(const Archive *a, uint32_t dir_id) {
+    return dir_id < a->dir_count ? a->strtab + a->dirs[dir_id] : "";
+}
+
+int archive_find(const Archive *a, const char *path) {
+    size_t len = strlen(path);
+    
+    if (a->index) {
+        uint32_t bucket_count = a->index[0];
+        uint32_t slot_count = a->index[1];
+        uint32_t seed = a->index[2 + index_hash(path, len, 0, bucket_count)];
+        uint32_t i = a->index[2 + bucket_count + index_hash(path, len, seed, slot_count)];
+        if (i < a->file_count && a->entries[i].path_len == len &&
+            memcmp(archive_path(a, &a->entries[i]), path, len) == 0) {
+            return (int)i;
+        }
+        return -1;
+    }
+    
+    for (uint32_t i = 0; i < a->file_count; i++) {
+        if (a->entries[i].path_len == len && memcmp(archive_path(a, &a->entries[i]), path, len) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+int archive_decode(const Archive *a, const ArchiveEntry *e, void *output) {
+    const char *blob = (const char*)a->data + e->data_offset;
+    uint32_t flags = a->verified ? LZMA_IGNORE_CHECK : 0;
+    
+    switch (e->codec) {
+        case ARCHIVE_CODEC_STORED:
+            if (e->compressed_size != e->original_size) return -1;
+            memcpy(output, blob, e->original_size);
+            return 0;
+        case ARCHIVE_CODEC_LZMA:
+            return xz_decode(blob, e->compressed_size, output, e->original_size, flags, 0);
+        case ARCHIVE_CODEC_LZ:
+            return lz_decompress(blob, e->compressed_size, output, e->original_size);
+        case ARCHIVE_CODEC_SOLID: {
+            // Decoding one member alone means decoding the block up to it
+            if (e->block_offset == 0) {
+                return xz_decode(blob, e->compressed_size, output, e->original_size, flags, 1);
+            }
+            size_t prefix = (size_t)e->block_offset + e->original_size;
+            char *block = malloc(prefix);
+            if (!block) return -1;
+            int ret = xz_decode(blob, e->compressed_size, block, prefix, flags, 1);
+            if (ret == 0) memcpy(output, block + e->block_offset, e->original_size);
+            free(block);
+            return ret;
+        }
+        default:
+            return -1;
+    }
+}
+
+int archive_link_target(const Archive *a, const ArchiveEntry *e, char *target, size_t size) {
+    if (e->codec != ARCHIVE_CODEC_LINK || e->compressed_size >= size) return -1;
+    memcpy(target, a->data + e->data_offset, e->compressed_size);
+    target[e->compressed_size] = '\0';
+    return 0;
+}
+
+uint32_t archive_unit_end(const Archive *a, uint32_t first, size_t *size) {
+    const ArchiveEntry *e = &a->entries[first];
+    uint32_t end = first + 1;
+    size_t unit_size = (size_t)e->block_offset + e->original_size;
+    
+    // A block is decoded once for the run of members that follows its first
+    // entry; a member reached on its own decodes the block prefix it needs
+    if (e->codec == ARCHIVE_CODEC_SOLID && e->block_offset == 0) {
+        while (end < a->file_count && a->entries[end].codec == ARCHIVE_CODEC_SOLID &&
+               a->entries[end].data_offset == e->data_offset && a->entries[end].block_offset != 0) {
+            size_t member_end = (size_t)a->entries[end].block_offset + a->entries[end].original_size;
+            if (member_end > unit_size) unit_size = member_end;
+            end++;
+        }
+    }
+    
+    if (size) *size = unit_size;
+    return end;
+}
+
+int archive_decode_unit(const Archive *a, uint32_t first, void *output, size_t size) {
+    const ArchiveEntry *e = &a->entries[first];
+    if (e->codec == ARCHIVE_CODEC_SOLID) {
+        return xz_decode((const char*)a->data + e->data_offset, e->compressed_size, output, size,
+                         a->verified ? LZMA_IGNORE_CHECK : 0, 1);
+    }
+    return archive_decode(a, e, output);
+}
+
+const void *archive_stored_data(const Archive *a, const ArchiveEntry *e) {
+    if (e->codec != ARCHIVE_CODEC_STORED || e->compressed_size != e->original_size) return NULL;
+    return a->data + e->data_offset;
+}
+
+struct ArchiveDecoder {
+    lzma_stream strm;
+    int ended;                  // the stream has reported LZMA_STREAM_END
+};
+
+// Decodes the next size bytes of the stream into output; liblzma is given
+// all the input up front, so anything short of that is corruption
+static int xz_read(ArchiveDecoder *d, void *output, size_t size) {
+    d->strm.next_out = output;
+    d->strm.avail_out = size;
+    while (d->strm.avail_out > 0 && !d->ended) {
+        lzma_ret ret = lzma_code(&d->strm, LZMA_FINISH);
+        if (ret == LZMA_STREAM_END) d->ended = 1;
+        else if (ret != LZMA_OK) return -1;
+    }
+    return d->strm.avail_out == 0 ? 0 : -1;
+}
+
+static int xz_skip(ArchiveDecoder *d, size_t size, ArchiveSink *sink) {
+    while (size > 0) {
+        size_t n = size < sink->scratch_size ? size : sink->scratch_size;
+        if (xz_read(d, sink->scratch, n) != 0) return -1;
+        size -= n;
+    }
+    return 0;
+}
+
+int archive_decode_unit_to(const Archive *a, uint32_t first, ArchiveSink *sink) {
+    const ArchiveEntry *e = &a->entries[first];
+    if (e->codec != ARCHIVE_CODEC_LZMA && e->codec != ARCHIVE_CODEC_SOLID) {
+        void *output = sink->begin(sink->ctx, first);
+        if (!output) return 0;
+        if (archive_decode(a, e, output) != 0) return -1;
+        sink->done(sink->ctx, first, output);
+        return 0;
+    }
+    
+    // liblzma reuses the dictionary and coder state it allocated for the
+    // previous unit when the next one is initialized on the same stream
+    if (!sink->decoder) {
+        sink->decoder = calloc(1, sizeof(ArchiveDecoder));
+        if (!sink->decoder) return -1;
+        lzma_stream init = LZMA_STREAM_INIT;
+        sink->decoder->strm = init;
+    }
+    ArchiveDecoder *d = sink->decoder;
+    uint32_t flags = a->verified ? LZMA_IGNORE_CHECK : 0;
+    if (lzma_stream_decoder(&d->strm, UINT64_MAX, LZMA_CONCATENATED | flags) != LZMA_OK) return -1;
+    d->strm.next_in = a->data + e->data_offset;
+    d->strm.avail_in = e->compressed_size;
+    d->ended = 0;
+    
+    // Members follow each other in the block, so one pass serves them all;
+    // a member reached on its own skips the block prefix first
+    uint32_t end = archive_unit_end(a, first, NULL);
+    size_t pos = 0;
+    for (uint32_t i = first; i < end; i++) {
+        e = &a->entries[i];
+        if (e->block_offset < pos || xz_skip(d, e->block_offset - pos, sink) != 0) return -1;
+        
+        void *output = sink->begin(sink->ctx, i);
+        if (!output && e->codec == ARCHIVE_CODEC_LZMA) return 0;
+        if (output ? xz_read(d, output, e->original_size) != 0
+                   : xz_skip(d, e->original_size, sink) != 0) return -1;
+        // A whole stream must end exactly where the entry does
+        if (e->codec == ARCHIVE_CODEC_LZMA && !d->ended) {
+            d->strm.avail_out = 0;
+            if (lzma_code(&d->strm, LZMA_FINISH) != LZMA_STREAM_END) return -1;
+        }
+        if (output) sink->done(sink->ctx, i, output);
+        pos = (size_t)e->block_offset + e->original_size;
+    }
+    return 0;
+}
+
+void archive_sink_release(ArchiveSink *sink) {
+    if (!sink->decoder) return;
+    lzma_end(&sink->decoder->strm);
+    free(sink->decoder);
+    sink->decoder = NULL;
+}
+
+static int compare_strings(const void *a, const void *b) {
+    return strcmp(*(char *const*)a, *(char *const*)b);
+}
+
+int archive_write_manifest(const Archive *a, const char *const *needs, int need_count, FILE *out) {
+    char **names = malloc((a->file_count + 1) * sizeof(char*));
+    if (!names) return -1;
+    
+    // "include X" for the first component of every header path, "lib X"
+    // for every library, each listed once
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < a->file_count; i++) {
+        const char *path = archive_path(a, &a->entries[i]);
+        char name[512];
+        if (strncmp(path, "include/", 8) == 0) {
+            const char *slash = strchr(path + 8, '/');
+            int len = slash ? (int)(slash - path - 8) + 1 : (int)strlen(path + 8);
+            snprintf(name, sizeof(name), "include %.*s", len, path + 8);
+        } else if (strncmp(path, "lib/lib", 7) == 0 && !strchr(path + 4, '/')) {
+            const char *ext = strstr(path + 7, ".so");
+            size_t len = strlen(path + 7);
+            if (len > 2 && strcmp(path + 7 + len - 2, ".a") == 0) {
+                len -= 2;
+            } else if (ext && (ext[3] == '\0' || ext[3] == '.')) {
+                len = ext - (path + 7);
+            } else {
+                continue;
+            }
+            snprintf(name, sizeof(name), "lib %.*s", (int)len, path + 7);
+        } else {
+            continue;
+        }
+        names[count] = strdup(name);
+        if (names[count]) count++;
+    }
+    qsort(names, count, sizeof(char*), compare_strings);
+    
+    fprintf(out, "# sscc addon manifest: %s\n", a->name);
+    fprintf(out, "size %zu\n", a->size);
+    for (uint32_t i = 0; i < count; i++) {
+        if (i == 0 || strcmp(names[i], names[i - 1]) != 0) fprintf(out, "%s\n", names[i]);
+    }
+    for (int i = 0; i < need_count; i++) {
+        fprintf(out, "needs %s\n", needs[i]);
+    }
+    for (uint32_t i = 0; i < count; i++) free(names[i]);
+    free(names);
+    return ferror(out) ? -1 : 0;
+}
+
+static const char *codec_names[] = { "stored", "lzma", "lz", "solid", "link" };
+
+int archive_codec_from_name(const char *name) {
+    for (int i = 0; i < (int)(sizeof(codec_names) / sizeof(codec_names[0])); i++) {
+        if (strcmp(name, codec_names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+const char *archive_codec_name(int codec) {
+    if (codec < 0 || codec >= (int)(sizeof(codec_names) / sizeof(codec_names[0]))) return "unknown";
+    return codec_names[codec];
+}
+
+// Archive reading
+
+typedef struct {
+    ArchiveEntry *entries;
+    uint32_t *dirs;
+    char *strtab;
+    uint32_t *index;
+} OwnedTables;
+
+static void free_owned(OwnedTables *t) {
+    if (!t) return;
+    free(t->entries);
+    free(t->dirs);
+    free(t->strtab);
+    free(t->index);
+    free(t);
+}
+
+// Assign the parent directory of every entry, deduplicating directory names
+// into dirs[] (which point into the same string table)
+static int assign_dirs(OwnedTables *t, uint32_t file_count, uint32_t *dir_count) {
+    t->dirs = malloc((file_count + 1) * sizeof(uint32_t));
+    if (!t->dirs) return -1;
+    
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < file_count; i++) {
+        const char *path = t->strtab + t->entries[i].path_offset;
+        const char *slash = strrchr(path, '/');
+        size_t len = slash ? (size_t)(slash - path) : 0;
+        
+        uint32_t d;
+        for (d = 0; d < count; d++) {
+            const char *dir = t->strtab + t->dirs[d];
+            if (strlen(dir) == len && memcmp(dir, path, len) == 0) break;
+        }
+        if (d == count) {
+            // Borrow the directory string from a path copy, cut at the slash
+            uint32_t off = t->entries[i].path_offset + t->entries[i].path_len + 1;
+            memcpy(t->strtab + off, path, len);
+            t->strtab[off + len] = '\0';
+            t->dirs[count++] = off;
+        }
+        t->entries[i].dir_id = d;
+    }
+    
+    *dir_count = count;
+    return 0;
+}
+
+// Entry paths are joined to an extraction directory: refuse anything that
+// could leave it (absolute paths, ".." components) or an empty name
+static int path_ok(const char *path, size_t len) {
+    if (len == 0 || path[0] == '/') return 0;
+    for (size_t i = 0; i < len; ) {
+        size_t end = i;
+        while (end < len && path[end] != '/') end++;
+        if (end - i == 2 && path[i] == '.' && path[i + 1] == '.') return 0;
+        i = end + 1;
+    }
+    return 1;
+}
+
+static int open_v1(Archive *a, const unsigned char *data, size_t size) {
+    size_t pos;
+    uint32_t name_len = 0, desc_len = 0;
+    const unsigned char *name = NULL, *desc = NULL;
+    
+    if (size >= 8 && memcmp(data, "CORE", 4) == 0) {
+        a->kind = ARCHIVE_KIND_CORE;
+        pos = 4;
+    } else if (size >= 5 && memcmp(data, "ADDON", 5) == 0) {
+        a->kind = ARCHIVE_KIND_ADDON;
+        pos = 5;
+        if (pos + 4 > size || (name_len = read_u32(data + pos)) > size - pos - 4) return -1;
+        name = data + pos + 4;
+        pos += 4 + name_len;
+        if (pos + 4 > size || (desc_len = read_u32(data + pos)) > size - pos - 4) return -1;
+        desc = data + pos + 4;
+        pos += 4 + desc_len;
+    } else {
+        return -1;
+    }
+    
+    if (pos + 4 > size) return -1;
+    uint32_t count = read_u32(data + pos);
+    pos += 4;
+    
+    // First pass: validate every record and size the string table. Each path
+    // is stored twice, the second copy doubling as its directory name.
+    size_t records = pos;
+    size_t strtab_size = (size_t)name_len + desc_len + 2;
+    for (uint32_t i = 0; i < count; i++) {
+        if (pos + 4 > size) return -1;
+        uint32_t path_len = read_u32(data + pos);
+        pos += 4;
+        if (path_len > size - pos || size - pos - path_len < 8) return -1;
+        if (memchr(data + pos, '\0', path_len) || !path_ok((const char*)data + pos, path_len)) return -1;
+        pos += path_len;
+        
+        uint32_t compressed_size = read_u32(data + pos + 4);
+        pos += 8;
+        if (compressed_size > size - pos) return -1;
+        pos += compressed_size;
+        strtab_size += 2 * ((size_t)path_len + 1);
+    }
+    
+    OwnedTables *t = calloc(1, sizeof(OwnedTables));
+    if (!t || !(t->entries = calloc(count + 1, sizeof(ArchiveEntry))) ||
+        !(t->strtab = malloc(strtab_size))) {
+        free_owned(t);
+        return -1;
+    }
+    
+    size_t strtab_used = 0;
+    if (name) memcpy(t->strtab, name, name_len);
+    t->strtab[name_len] = '\0';
+    if (desc) memcpy(t->strtab + name_len + 1, desc, desc_len);
+    t->strtab[name_len + 1 + desc_len] = '\0';
+    strtab_used = (size_t)name_len + desc_len + 2;
+    
+    // Second pass: fill the synthesized table of contents
+    pos = records;
+    for (uint32_t i = 0; i < count; i++) {
+        ArchiveEntry *e = &t->entries[i];
+        uint32_t path_len = read_u32(data + pos);
+        pos += 4;
+        
+        e->path_offset = strtab_used;
+        e->path_len = path_len;
+        memcpy(t->strtab + strtab_used, data + pos, path_len);
+        t->strtab[strtab_used + path_len] = '\0';
+        strtab_used += 2 * ((size_t)path_len + 1);
+        pos += path_len;
+        
+        e->original_size = read_u32(data + pos);
+        e->compressed_size = read_u32(data + pos + 4);
+        pos += 8;
+        e->data_offset = pos;
+        e->codec = ARCHIVE_CODEC_LZMA;
+        pos += e->compressed_size;
+    }
+    
+    if (assign_dirs(t, count, &a->dir_count) != 0) {
+        free_owned(t);
+        return -1;
+    }
+    
+    a->version = 1;
+    a->data = data;
+    a->size = size;
+    a->file_count = count;
+    a->entries = t->entries;
+    a->dirs = t->dirs;
+    a->strtab = t->strtab;
+    a->strtab_size = strtab_used;
+    if (a->kind == ARCHIVE_KIND_ADDON) {
+        a->name = t->strtab;
+        a->description = t->strtab + name_len + 1;
+    }
+    a->owned = t;
+    return 0;
+}
+
+static int range_ok(size_t size, uint64_t offset, uint64_t length) {
+    return offset <= size && length <= size - offset;
+}
+
+// v2 headers end before the checksum field, v3 and v4 before the hot set
+static size_t header_size(uint32_t version) {
+    if (version < 3) return offsetof(ArchiveHeader, checksum);
+    if (version < 5) return offsetof(ArchiveHeader, hot_count);
+    return sizeof(ArchiveHeader);
+}
+
+static int open_v2(Archive *a, const unsigned char *data, size_t size) {
+    ArchiveHeader h;
+    memset(&h, 0, sizeof(h));
+    if (size < header_size(2)) return -1;
+    memcpy(&h, data, header_size(2));
+    
+    if (memcmp(h.magic, ARCHIVE_MAGIC, 4) != 0 || h.version < 2 || h.version > ARCHIVE_VERSION) return -1;
+    if (size < header_size(h.version)) return -1;
+    memcpy(&h, data, header_size(h.version));
+    if (h.hot_count > h.file_count) return -1;
+    if (!range_ok(size, h.toc_offset, (uint64_t)h.file_count * sizeof(ArchiveEntry)) ||
+        !range_ok(size, h.dirs_offset, (uint64_t)h.dir_count * sizeof(uint32_t)) ||
+        !range_ok(size, h.strtab_offset, h.strtab_size) || h.strtab_size == 0 ||
+        data[h.strtab_offset + h.strtab_size - 1] != '\0') {
+        return -1;
+    }
+    if (h.index_offset && !range_ok(size, h.index_offset, (uint64_t)h.index_size * sizeof(uint32_t))) {
+        return -1;
+    }
+    
+    OwnedTables *t = NULL;
+    const ArchiveEntry *entries = (const ArchiveEntry*)(data + h.toc_offset);
+    const uint32_t *dirs = (const uint32_t*)(data + h.dirs_offset);
+    const uint32_t *index = h.index_offset ? (const uint32_t*)(data + h.index_offset) : NULL;
+    
+    // Tables are aligned by the writer, but the buffer itself may not be
+    if ((uintptr_t)entries % 8 || (uintptr_t)dirs % 4 || (uintptr_t)index % 4) {
+        t = calloc(1, sizeof(OwnedTables));
+        if (!t) return -1;
+        t->entries = malloc((h.file_count + 1) * sizeof(ArchiveEntry));
+        t->dirs = malloc((h.dir_count + 1) * sizeof(uint32_t));
+        t->index = malloc((h.index_size + 1) * sizeof(uint32_t));
+        if (!t->entries || !t->dirs || !t->index) {
+            free_owned(t);
+            return -1;
+        }
+        memcpy(t->entries, entries, h.file_count * sizeof(ArchiveEntry));
+        memcpy(t->dirs, dirs, h.dir_count * sizeof(uint32_t));
+        if (index) memcpy(t->index, index, h.index_size * sizeof(uint32_t));
+        entries = t->entries;
+        dirs = t->dirs;
+        index = index ? t->index : NULL;
+    }
+    
+    const char *strtab = (const char*)data + h.strtab_offset;
+    for (uint32_t i = 0; i < h.dir_count; i++) {
+        if (dirs[i] >= h.strtab_size) goto bad;
+    }
+    for (uint32_t i = 0; i < h.file_count; i++) {
+        const ArchiveEntry *e = &entries[i];
+        if ((uint64_t)e->path_offset + e->path_len >= h.strtab_size ||
+            strtab[e->path_offset + e->path_len] != '\0' ||
+            !path_ok(strtab + e->path_offset, e->path_len) || e->codec > ARCHIVE_CODEC_LINK ||
+            (e->codec == ARCHIVE_CODEC_LINK && (h.version < 4 ||
+             !range_ok(size, e->data_offset, e->compressed_size) ||
+             memchr(data + e->data_offset, '\0', e->compressed_size) ||
+             !path_ok((const char*)data + e->data_offset, e->compressed_size))) ||
+            (e->dir_id >= h.dir_count && h.dir_count > 0) ||
+            (e->block_offset != 0 && e->codec != ARCHIVE_CODEC_SOLID) ||
+            !range_ok(size, e->data_offset, e->compressed_size)) {
+            goto bad;
+        }
+    }
+    if (h.name_offset >= h.strtab_size || h.desc_offset >= h.strtab_size) {
+        goto bad;
+    }
+    
+    a->version = h.version;
+    a->kind = h.kind;
+    a->data = data;
+    a->size = size;
+    a->file_count = h.file_count;
+    a->dir_count = h.dir_count;
+    a->entries = entries;
+    a->dirs = dirs;
+    a->strtab = strtab;
+    a->strtab_size = h.strtab_size;
+    a->name = strtab + h.name_offset;
+    a->description = strtab + h.desc_offset;
+    a->hot_count = h.hot_count;
+    archive_set_index(a, index, h.index_size);
+    a->owned = t;
+    return 0;
+
+bad:
+    free_owned(t);
+    return -1;
+}
+
+int archive_open(Archive *a, const void *data, size_t size) {
+    memset(a, 0, sizeof(*a));
+    a->name = "";
+    a->description = "";
+    
+    if (size >= 4 && memcmp(data, ARCHIVE_MAGIC, 4) == 0) {
+        return open_v2(a, data, size);
+    }
+    return open_v1(a, data, size);
+}
+
+// FNV-1a over the archive with the checksum field zeroed. One pass over the
+// compressed bytes is far cheaper than an xz check per decoded file.
+static uint64_t archive_checksum(const unsigned char *data, size_t size, size_t hsize) {
+    ArchiveHeader h;
+    memcpy(&h, data, hsize);
+    h.checksum = 0;
+    uint64_t hash = sscc_hash64(&h, hsize, SSCC_HASH_INIT);
+    return sscc_hash64(data + hsize, size - hsize, hash);
+}
+
+int archive_verify(Archive *a) {
+    if (a->version < 3) return 0;
+    
+    ArchiveHeader h;
+    size_t hsize = header_size(a->version);
+    memcpy(&h, a->data, hsize);
+    if (archive_checksum(a->data, a->size, hsize) != h.checksum) return -1;
+    a->verified = 1;
+    return 0;
+}
+
+void archive_close(Archive *a) {
+    free_owned(a->owned);
+    a->owned = NULL;
+}
+
+// Archive writing
+
+void archive_builder_init(ArchiveBuilder *b, int kind, const char *name, const char *description) {
+    memset(b, 0, sizeof(*b));
+    b->kind = kind;
+    b->codec = ARCHIVE_CODEC_LZMA;
+    b->name = name ? name : "";
+    b->description = description ? description : "";
+}
+
+static uint32_t builder_dir_id(ArchiveBuilder *b, const char *path) {
+    const char *slash = strrchr(path, '/');
+    size_t len = slash ? (size_t)(slash - path) : 0;
+    
+    for (uint32_t d = 0; d < b->dir_count; d++) {
+        if (strlen(b->dirs[d]) == len && memcmp(b->dirs[d], path, len) == 0) return d;
+    }
+    
+    char **dirs = realloc(b->dirs, (b->dir_count + 1) * sizeof(char*));
+    if (!dirs) return 0;
+    b->dirs = dirs;
+    b->dirs[b->dir_count] = strndup(path, len);
+    return b->dir_count++;
+}
+
+int archive_builder_add(ArchiveBuilder *b, const char *path, const void *data, size_t size) {
+    if (size > UINT32_MAX) return -1;
+    
+    if (b->count == b->capacity) {
+        uint32_t capacity = b->capacity ? b->capacity * 2 : 256;
+        ArchiveBuildEntry *entries = realloc(b->entries, capacity * sizeof(ArchiveBuildEntry));
+        if (!entries) return -1;
+        b->entries = entries;
+        b->capacity = capacity;
+    }
+    
+    ArchiveBuildEntry *e = &b->entries[b->count];
+    memset(e, 0, sizeof(*e));
+    e->codec = b->codec;
+    if (e->codec == ARCHIVE_CODEC_SOLID && size > ARCHIVE_SOLID_MAX_FILE) {
+        e->codec = ARCHIVE_CODEC_LZMA;
+    } else if (e->codec != ARCHIVE_CODEC_SOLID && e->codec != ARCHIVE_CODEC_LZ &&
+               e->codec != ARCHIVE_CODEC_LZMA) {
+        e->codec = ARCHIVE_CODEC_STORED;
+    }
+    
+    // Compressed by archive_builder_write, solid entries together with their
+    // neighbours
+    e->raw = malloc(size ? size : 1);
+    if (!e->raw) return -1;
+    memcpy(e->raw, data, size);
+    e->raw_size = size;
+    
+    e->path = strdup(path);
+    e->dir_id = builder_dir_id(b, path);
+    e->original_size = size;
+    e->content_hash = sscc_hash64(data, size, SSCC_HASH_INIT);
+    e->blob_owner = b->count;
+    b->count++;
+    return 0;
+}
+
+int archive_builder_add_link(ArchiveBuilder *b, const char *path, const char *target,
+                             size_t size, uint64_t content_hash) {
+    if (size > UINT32_MAX) return -1;
+    if (archive_builder_add(b, path, "", 0) != 0) return -1;
+    
+    ArchiveBuildEntry *e = &b->entries[b->count - 1];
+    free(e->raw);
+    e->raw = NULL;
+    e->raw_size = 0;
+    e->blob = (unsigned char*)strdup(target);
+    if (!e->blob) return -1;
+    e->blob_size = strlen(target);
+    e->codec = ARCHIVE_CODEC_LINK;
+    e->original_size = size;
+    e->content_hash = content_hash;
+    return 0;
+}
+
+// Hot-set ordering: entries are ranked by how many profiled compiles opened
+// them, ties broken by first mention, and the rest keep their scan order
+typedef struct {
+    uint32_t entry;
+    uint64_t count;
+    uint64_t first_seen;
+} HotRank;
+
+static const ArchiveBuilder *hot_builder;
+
+static int compare_entry_path(const void *a, const void *b) {
+    return strcmp(hot_builder->entries[*(const uint32_t*)a].path,
+                  hot_builder->entries[*(const uint32_t*)b].path);
+}
+
+static int compare_hot_rank(const void *a, const void *b) {
+    const HotRank *x = a, *y = b;
+    if ((x->count > 0) != (y->count > 0)) return x->count > 0 ? -1 : 1;
+    if (x->count != y->count) return x->count > y->count ? -1 : 1;
+    if (x->first_seen != y->first_seen) return x->first_seen < y->first_seen ? -1 : 1;
+    return x->entry < y->entry ? -1 : x->entry > y->entry;
+}
+
+int archive_builder_order_hot(ArchiveBuilder *b, const char *manifest) {
+    FILE *f = fopen(manifest, "r");
+    if (!f) return -1;
+    
+    // Entries are only moved before solid blocks are packed
+    for (uint32_t i = 0; i < b->count; i++) {
+        if (b->entries[i].blob_owner != i) {
+            fclose(f);
+            return -1;
+        }
+    }
+    
+    uint32_t *by_path = malloc((b->count + 1) * sizeof(uint32_t));
+    HotRank *ranks = calloc(b->count + 1, sizeof(HotRank));
+    ArchiveBuildEntry *ordered = malloc((b->count + 1) * sizeof(ArchiveBuildEntry));
+    if (!by_path || !ranks || !ordered) {
+        free(by_path);
+        free(ranks);
+        free(ordered);
+        fclose(f);
+        return -1;
+    }
+    for (uint32_t i = 0; i < b->count; i++) {
+        by_path[i] = i;
+        ranks[i].entry = i;
+    }
+    hot_builder = b;
+    qsort(by_path, b->count, sizeof(uint32_t), compare_entry_path);
+    
+    char line[4096];
+    uint64_t line_number = 0;
+    while (fgets(line, sizeof(line), f)) {
+        line_number++;
+        char *p = line + strspn(line, " \t");
+        uint64_t count = 1;
+        if (*p >= '0' && *p <= '9') {
+            count = strtoull(p, &p, 10);
+            p += strspn(p, " \t");
+        }
+        p[strcspn(p, "\r\n")] = '\0';
+        if (*p == '\0' || *p == '#' || count == 0) continue;
+        
+        uint32_t lo = 0, hi = b->count;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            int cmp = strcmp(b->entries[by_path[mid]].path, p);
+            if (cmp == 0) {
+                HotRank *r = &ranks[by_path[mid]];
+                if (r->count == 0) r->first_seen = line_number;
+                r->count += count;
+                break;
+            }
+            if (cmp < 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+    }
+    fclose(f);
+    
+    qsort(ranks, b->count, sizeof(HotRank), compare_hot_rank);
+    b->hot_count = 0;
+    for (uint32_t i = 0; i < b->count; i++) {
+        ordered[i] = b->entries[ranks[i].entry];
+        ordered[i].blob_owner = i;
+        if (ranks[i].count > 0) b->hot_count++;
+    }
+    memcpy(b->entries, ordered, b->count * sizeof(ArchiveBuildEntry));
+    
+    free(by_path);
+    free(ranks);
+    free(ordered);
+    return b->hot_count;
+}
+
+static int same_top_dir(const char *a, const char *b) {
+    size_t len = strcspn(a, "/");
+    return strncmp(a, b, len) == 0 && (b[len] == '/' || b[len] == '\0');
+}
+
+// Pack runs of pending solid entries into blocks of up to
+// ARCHIVE_SOLID_BLOCK_SIZE that never span top-level directories, so that
+// include/ and lib/ can still be extracted independently, nor the end of
+// the hot set. The block becomes the raw data of its first entry.
+static int is_pending_solid(const ArchiveBuildEntry *e) {
+    return e->codec == ARCHIVE_CODEC_SOLID && e->raw;
+}
+
+static int pack_solid_blocks(ArchiveBuilder *b) {
+    uint32_t i = 0;
+    while (i < b->count) {
+        if (!is_pending_solid(&b->entries[i]) || b->entries[i].blob_owner != i) {
+            i++;
+            continue;
+        }
+        
+        uint32_t end = i;
+        size_t block_size = 0;
+        while (end < b->count && is_pending_solid(&b->entries[end]) &&
+               same_top_dir(b->entries[i].path, b->entries[end].path) &&
+               (end == i || block_size + b->entries[end].original_size <= ARCHIVE_SOLID_BLOCK_SIZE) &&
+               (end == i || end != b->hot_count)) {
+            block_size += b->entries[end].original_size;
+            end++;
+        }
+        
+        unsigned char *block = malloc(block_size ? block_size : 1);
+        if (!block) return -1;
+        size_t pos = 0;
+        for (uint32_t k = i; k < end; k++) {
+            memcpy(block + pos, b->entries[k].raw, b->entries[k].original_size);
+            b->entries[k].block_offset = pos;
+            b->entries[k].blob_owner = i;
+            pos += b->entries[k].original_size;
+            free(b->entries[k].raw);
+            b->entries[k].raw = NULL;
+            b->entries[k].raw_size = 0;
+        }
+        b->entries[i].raw = block;
+        b->entries[i].raw_size = block_size;
+        i = end;
+    }
+    return 0;
+}
+
+// Blob cache: one file per compressed blob, named by the hash of everything
+// the blob depends on. Bump BLOB_CACHE_VERSION when an encoder's output
+// changes; the liblzma version is part of the key already.
+#define BLOB_CACHE_VERSION "sscc-blob-1"
+#define BLOB_CACHE_MAGIC "SSBC"
+
+typedef struct {
+    char magic[4];
+    uint32_t codec;             // codec of the blob, STORED if it did not shrink
+    uint64_t key;
+    uint64_t size;
+    uint64_t hash;              // sscc_hash64 of the blob
+} BlobCacheHeader;
+
+static uint64_t blob_cache_key(const ArchiveBuildEntry *e) {
+    uint64_t h = sscc_hash64(BLOB_CACHE_VERSION, strlen(BLOB_CACHE_VERSION), SSCC_HASH_INIT);
+    h = sscc_hash_u64(e->codec, h);
+    h = sscc_hash_u64(lzma_version_number(), h);
+    h = sscc_hash_u64(e->raw_size, h);
+    return sscc_hash64(e->raw, e->raw_size, h);
+}
+
+static int blob_cache_load(const char *dir, uint64_t key, ArchiveBuildEntry *e) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%016llx", dir, (unsigned long long)key);
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    
+    BlobCacheHeader h;
+    unsigned char *blob = NULL;
+    if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, BLOB_CACHE_MAGIC, 4) != 0 ||
+        h.key != key || h.size > UINT32_MAX || !(blob = malloc(h.size ? h.size : 1)) ||
+        fread(blob, 1, h.size, f) != h.size || sscc_hash64(blob, h.size, SSCC_HASH_INIT) != h.hash) {
+        free(blob);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    e->codec = h.codec;
+    e->blob = blob;
+    e->blob_size = h.size;
+    return 0;
+}
+
+// Written to a temporary file and renamed, so concurrent builds sharing the
+// cache never read a partial blob. Failures only cost a later rebuild.
+static void blob_cache_store(const char *dir, uint64_t key, const ArchiveBuildEntry *e) {
+    char path[4096], temp_path[4096 + 16];
+    snprintf(path, sizeof(path), "%s/%016llx", dir, (unsigned long long)key);
+    snprintf(temp_path, sizeof(temp_path), "%s.tmpXXXXXX", path);
+    int fd = mkstemp(temp_path);
+    if (fd < 0) return;
+    
+    BlobCacheHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, BLOB_CACHE_MAGIC, 4);
+    h.codec = e->codec;
+    h.key = key;
+    h.size = e->blob_size;
+    h.hash = sscc_hash64(e->blob, e->blob_size, SSCC_HASH_INIT);
+    FILE *f = fdopen(fd, "wb");
+    int ok = f && fwrite(&h, sizeof(h), 1, f) == 1 && fwrite(e->blob, 1, e->blob_size, f) == e->blob_size;
+    if (f) {
+        ok = fclose(f) == 0 && ok;
+    } else {
+        close(fd);
+    }
+    if (!ok || rename(temp_path, path) != 0) unlink(temp_path);
+}
+
+typedef struct {
+    ArchiveBuilder *b;
+    const uint32_t *owners;     // entries holding raw data
+    uint8_t *reused;            // per owner, 1 if found in the blob cache
+} CompressJob;
+
+static int compress_task(void *ctx, uint32_t item) {
+    CompressJob *job = ctx;
+    ArchiveBuildEntry *e = &job->b->entries[job->owners[item]];
+    if (e->codec == ARCHIVE_CODEC_STORED) {
+        e->blob = e->raw;
+        e->blob_size = e->raw_size;
+        e->raw = NULL;
+        return 0;
+    }
+    
+    const char *cache = job->b->blob_cache;
+    uint64_t key = cache ? blob_cache_key(e) : 0;
+    if (cache && blob_cache_load(cache, key, e) == 0) {
+        job->reused[item] = 1;
+        free(e->raw);
+        e->raw = NULL;
+        return 0;
+    }
+    
+    char *compressed = NULL;
+    size_t compressed_size = 0;
+    int ret = e->codec == ARCHIVE_CODEC_LZ ?
+              lz_compress((const char*)e->raw, e->raw_size, &compressed, &compressed_size) :
+              lzma_compress_data((const char*)e->raw, e->raw_size, &compressed, &compressed_size);
+    if (ret != 0) return -1;
+    
+    // Data that does not shrink is kept as is; solid blocks always stay
+    // compressed, their entries are addressed inside the decoded block
+    if (e->codec != ARCHIVE_CODEC_SOLID && compressed_size >= e->raw_size) {
+        free(compressed);
+        e->blob = e->raw;
+        e->blob_size = e->raw_size;
+        e->codec = ARCHIVE_CODEC_STORED;
+    } else {
+        free(e->raw);
+        e->blob = (unsigned char*)compressed;
+        e->blob_size = compressed_size;
+    }
+    e->raw = NULL;
+    if (cache) blob_cache_store(cache, key, e);
+    return 0;
+}
+
+// Compresses every pending blob, largest first
+static int compress_blobs(ArchiveBuilder *b) {
+    uint32_t *owners = malloc((b->count + 1) * sizeof(uint32_t));
+    uint32_t *sizes = malloc((b->count + 1) * sizeof(uint32_t));
+    uint32_t *order = malloc((b->count + 1) * sizeof(uint32_t));
+    uint8_t *reused = calloc(b->count + 1, 1);
+    int ret = -1;
+    if (!owners || !sizes || !order || !reused) goto out;
+    
+    uint32_t count = 0, compressible = 0;
+    for (uint32_t i = 0; i < b->count; i++) {
+        if (!b->entries[i].raw) continue;
+        if (b->entries[i].codec != ARCHIVE_CODEC_STORED) compressible++;
+        owners[count] = i;
+        sizes[count] = b->entries[i].raw_size > UINT32_MAX ? UINT32_MAX : b->entries[i].raw_size;
+        count++;
+    }
+    if (b->blob_cache && mkdir(b->blob_cache, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Warning: Cannot create blob cache %s: %s\n", b->blob_cache, strerror(errno));
+        b->blob_cache = NULL;
+    }
+    pool_order_by_size(order, sizes, count);
+    
+    CompressJob job = { b, owners, reused };
+    uint32_t failed = 0;
+    int threads = b->threads > 0 ? b->threads : pool_default_threads();
+    if (pool_run(count, order, threads, compress_task, &job, &failed) != 0) {
+        fprintf(stderr, "Error: Cannot compress %s\n", b->entries[owners[failed]].path);
+        goto out;
+    }
+    
+    b->blob_count = compressible;
+    b->blobs_reused = 0;
+    for (uint32_t k = 0; k < count; k++) b->blobs_reused += reused[k];
+    ret = 0;
+
+out:
+    free(owners);
+    free(sizes);
+    free(order);
+    free(reused);
+    return ret;
+}
+
+static size_t align_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// Writes a piece of the archive, or with out == NULL only adds it to the
+// checksum, so the header can carry the checksum of what follows it
+static void emit(FILE *out, const void *data, size_t size, uint64_t *hash) {
+    if (out) {
+        fwrite(data, 1, size, out);
+    } else {
+        *hash = sscc_hash64(data, size, *hash);
+    }
+}
+
+static void emit_padding(FILE *out, size_t from, size_t to, uint64_t *hash) {
+    static const char zeros[16];
+    if (to > from) emit(out, zeros, to - from, hash);
+}
+
+int archive_builder_write(ArchiveBuilder *b, FILE *out, int with_index) {
+    if (pack_solid_blocks(b) != 0 || compress_blobs(b) != 0) return -1;
+    
+    // String table: paths, directory names, then addon metadata
+    size_t strtab_size = 1;
+    for (uint32_t i = 0; i < b->count; i++) strtab_size += strlen(b->entries[i].path) + 1;
+    for (uint32_t d = 0; d < b->dir_count; d++) strtab_size += strlen(b->dirs[d]) + 1;
+    strtab_size += strlen(b->name) + strlen(b->description) + 2;
+    
+    char *strtab = calloc(1, strtab_size);
+    ArchiveEntry *toc = calloc(b->count + 1, sizeof(ArchiveEntry));
+    uint32_t *dirs = calloc(b->dir_count + 1, sizeof(uint32_t));
+    const char **paths = malloc((b->count + 1) * sizeof(char*));
+    uint32_t *lens = malloc((b->count + 1) * sizeof(uint32_t));
+    uint32_t *index = NULL;
+    uint32_t index_size = 0;
+    int ret = -1;
+    if (!strtab || !toc || !dirs || !paths || !lens) goto out;
+    
+    size_t pos = 1;   // offset 0 is the empty string
+    for (uint32_t i = 0; i < b->count; i++) {
+        size_t len = strlen(b->entries[i].path);
+        memcpy(strtab + pos, b->entries[i].path, len + 1);
+        toc[i].path_offset = pos;
+        toc[i].path_len = len;
+        paths[i] = strtab + pos;
+        lens[i] = len;
+        pos += len + 1;
+    }
+    for (uint32_t d = 0; d < b->dir_count; d++) {
+        size_t len = strlen(b->dirs[d]);
+        memcpy(strtab + pos, b->dirs[d], len + 1);
+        dirs[d] = pos;
+        pos += len + 1;
+    }
+    uint32_t name_offset = pos;
+    memcpy(strtab + pos, b->name, strlen(b->name) + 1);
+    pos += strlen(b->name) + 1;
+    uint32_t desc_offset = pos;
+    memcpy(strtab + pos, b->description, strlen(b->description) + 1);
+    
+    if (with_index && build_index(paths, lens, b->count, &index, &index_size) != 0) goto out;
+    
+    ArchiveHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, ARCHIVE_MAGIC, 4);
+    h.version = 3;
+    for (uint32_t i = 0; i < b->count; i++) {
+        if (b->entries[i].codec == ARCHIVE_CODEC_LINK) h.version = 4;
+    }
+    if (b->hot_count > 0) {
+        h.version = 5;
+        h.hot_count = b->hot_count;
+    }
+    size_t hsize = header_size(h.version);
+    h.kind = b->kind;
+    h.file_count = b->count;
+    h.dir_count = b->dir_count;
+    h.toc_offset = align_up(hsize, 8);
+    h.dirs_offset = h.toc_offset + b->count * sizeof(ArchiveEntry);
+    h.index_offset = index ? h.dirs_offset + b->dir_count * sizeof(uint32_t) : 0;
+    h.index_size = index_size;
+    h.strtab_offset = h.dirs_offset + (b->dir_count + index_size) * sizeof(uint32_t);
+    h.strtab_size = strtab_size;
+    h.name_offset = name_offset;
+    h.desc_offset = desc_offset;
+    h.data_offset = align_up(h.strtab_offset + strtab_size, 16);
+    
+    size_t data_pos = h.data_offset;
+    for (uint32_t i = 0; i < b->count; i++) {
+        const ArchiveBuildEntry *e = &b->entries[i];
+        toc[i].dir_id = e->dir_id;
+        toc[i].codec = e->codec;
+        toc[i].block_offset = e->block_offset;
+        toc[i].original_size = e->original_size;
+        toc[i].content_hash = e->content_hash;
+        
+        // Solid members share the blob written for the first entry of their block
+        if (e->blob_owner != i) {
+            toc[i].compressed_size = toc[e->blob_owner].compressed_size;
+            toc[i].data_offset = toc[e->blob_owner].data_offset;
+            continue;
+        }
+        if (data_pos + e->blob_size > UINT32_MAX) {
+            fprintf(stderr, "Error: Archive exceeds 4GB\n");
+            goto out;
+        }
+        toc[i].compressed_size = e->blob_size;
+        toc[i].data_offset = data_pos;
+        data_pos += e->blob_size;
+    }
+    
+    // First pass computes the checksum, second pass writes
+    for (FILE *dest = NULL; ; dest = out) {
+        uint64_t hash = SSCC_HASH_INIT;
+        emit(dest, &h, hsize, &hash);
+        emit_padding(dest, hsize, h.toc_offset, &hash);
+        emit(dest, toc, b->count * sizeof(ArchiveEntry), &hash);
+        emit(dest, dirs, b->dir_count * sizeof(uint32_t), &hash);
+        if (index) emit(dest, index, index_size * sizeof(uint32_t), &hash);
+        emit(dest, strtab, strtab_size, &hash);
+        emit_padding(dest, h.strtab_offset + strtab_size, h.data_offset, &hash);
+        for (uint32_t i = 0; i < b->count; i++) {
+            if (b->entries[i].blob_owner == i) emit(dest, b->entries[i].blob, b->entries[i].blob_size, &hash);
+        }
+        if (dest) break;
+        h.checksum = hash;
+    }
+    ret = ferror(out) ? -1 : 0;
+
+out:
+    free(strtab);
+    free(toc);
+    free(dirs);
+    free(paths);
+    free(lens);
+    free(index);
+    return ret;
+}
+
+void archive_builder_free(ArchiveBuilder *b) {
+    for (uint32_t i = 0; i < b->count; i++) {
+        free(b->entries[i].path);
+        free(b->entries[i].blob);
+        free(b->entries[i].raw);
+    }
+    for (uint32_t d = 0; d < b->dir_count; d++) free(b->dirs[d]);
+    free(b->entries);
+    free(b->dirs);
+    memset(b, 0, sizeof(*b));
+}
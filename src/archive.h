@@ -0,0 +1,220 @@
+// SSCC archive format shared by embed_resources, create_addon, sscc_payload and sscc
+#ifndef SSCC_ARCHIVE_H
+#define SSCC_ARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Format v1 (sequential, still read for existing .addon files):
+//   "CORE"  u32 count  { u32 path_len, path, u32 size, u32 comp_size, blob }*
+//   "ADDON" u32 len name u32 len desc u32 count { same records }*
+//
+// Format v2..v5 (indexed; v3 adds the archive checksum to the header, v4
+// archives may contain link entries, v5 headers record the hot set; each is
+// only written when an archive needs it):
+//   ArchiveHeader
+//   ArchiveEntry[file_count]      table of contents
+//   u32 dirs[dir_count]           string table offsets of directory paths
+//   u32 index[index_size]         optional perfect-hash path index
+//   string table                  NUL-terminated paths, addon name/description
+//   blobs                         compressed entry data
+//
+// All integers are little-endian, like the v1 records they replace.
+#define ARCHIVE_MAGIC "SSCA"
+#define ARCHIVE_VERSION 5
+
+#define ARCHIVE_KIND_CORE 0
+#define ARCHIVE_KIND_ADDON 1
+
+// Entry codecs. The tier an archive is built with is a build-time choice;
+// readers handle every codec, entry by entry.
+#define ARCHIVE_CODEC_STORED 0  // uncompressed, usable in place
+#define ARCHIVE_CODEC_LZMA 1    // xz stream, one per entry
+#define ARCHIVE_CODEC_LZ 2      // byte-oriented LZ77, fast to decode
+#define ARCHIVE_CODEC_SOLID 3   // xz stream shared by a block of entries
+#define ARCHIVE_CODEC_LINK 4    // same content as another path of the tree,
+                                // whose name is the blob (see archive_link_target)
+
+// Solid blocks group small files from one top-level directory; larger files
+// are stored as individual LZMA entries
+#define ARCHIVE_SOLID_BLOCK_SIZE (256 * 1024)
+#define ARCHIVE_SOLID_MAX_FILE (64 * 1024)
+
+#define ARCHIVE_NO_INDEX 0xffffffffu
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t kind;
+    uint32_t file_count;
+    uint32_t dir_count;
+    uint32_t toc_offset;
+    uint32_t dirs_offset;
+    uint32_t index_offset;      // 0 when the index is supplied externally
+    uint32_t index_size;        // in u32 words
+    uint32_t strtab_offset;
+    uint32_t strtab_size;
+    uint32_t name_offset;       // string table offsets, addons only
+    uint32_t desc_offset;
+    uint32_t data_offset;
+    uint64_t checksum;          // v3: sscc_hash64 of the archive, see archive_verify
+    uint32_t hot_count;         // v5: leading entries most compiles open
+    uint32_t reserved;
+} ArchiveHeader;
+
+typedef struct {
+    uint32_t path_offset;       // string table offset of the relative path
+    uint32_t path_len;
+    uint32_t dir_id;            // parent directory, index into dirs[]
+    uint32_t codec;
+    uint32_t block_offset;      // offset inside the decoded solid block
+    uint32_t original_size;
+    uint32_t compressed_size;   // of the whole block for solid entries
+    uint32_t data_offset;       // from the start of the archive
+    uint64_t content_hash;      // sscc_hash64 of the uncompressed content
+} ArchiveEntry;
+
+// Read-only view of a v1 or v2 archive held in memory
+typedef struct {
+    const unsigned char *data;
+    size_t size;
+    int version;
+    int kind;
+    const char *name;
+    const char *description;
+    uint32_t file_count;
+    uint32_t dir_count;
+    const ArchiveEntry *entries;
+    const uint32_t *dirs;
+    const char *strtab;
+    uint32_t strtab_size;
+    const uint32_t *index;
+    uint32_t index_size;
+    uint32_t hot_count;         // 0 when the archive has no hot set
+    int verified;               // checksum matched; per-entry checks are skipped
+    void *owned;                // tables synthesized for v1 archives
+} Archive;
+
+int archive_open(Archive *a, const void *data, size_t size);
+void archive_close(Archive *a);
+void archive_set_index(Archive *a, const uint32_t *index, uint32_t index_size);
+
+// Checks the whole-archive checksum once. Returns 0 if it matches (or the
+// archive predates checksums and relies on per-entry xz checks instead).
+int archive_verify(Archive *a);
+
+const char *archive_path(const Archive *a, const ArchiveEntry *e);
+const char *archive_dir(const Archive *a, uint32_t dir_id);
+int archive_find(const Archive *a, const char *path);
+int archive_decode(const Archive *a, const ArchiveEntry *e, void *output);
+
+// Link entries are never decoded: their content is that of `target`, a path
+// of this archive or of one extracted before it (the core, an earlier addon).
+// Copies the NUL-terminated target; returns -1 if it does not fit.
+int archive_link_target(const Archive *a, const ArchiveEntry *e, char *target, size_t size);
+
+// Decoding units: a run of entries sharing one solid block, or a single entry.
+// archive_unit_end returns one past the last entry of the unit starting at
+// `first` and its decoded size; archive_decode_unit decodes it in one pass,
+// each entry landing at output + block_offset.
+uint32_t archive_unit_end(const Archive *a, uint32_t first, size_t *size);
+int archive_decode_unit(const Archive *a, uint32_t first, void *output, size_t size);
+
+// Streaming decode of a unit, for callers that place each entry themselves.
+// begin returns where entry i's original_size bytes go (a mapped file, a
+// reused buffer), or NULL to skip it; done is called once they are there.
+// Solid blocks are decoded member by member rather than whole, bytes nobody
+// wants passing through scratch, and the xz decoder state is kept in the
+// sink and reused by the next unit. Returns -1 if the data is corrupt.
+typedef struct ArchiveDecoder ArchiveDecoder;
+typedef struct {
+    void *(*begin)(void *ctx, uint32_t i);
+    void (*done)(void *ctx, uint32_t i, void *data);
+    void *ctx;
+    unsigned char *scratch;
+    size_t scratch_size;
+    ArchiveDecoder *decoder;    // NULL until first used, see archive_sink_release
+} ArchiveSink;
+
+int archive_decode_unit_to(const Archive *a, uint32_t first, ArchiveSink *sink);
+void archive_sink_release(ArchiveSink *sink);
+
+// Stored entries need no decoding: their bytes, in place, or NULL for
+// entries of other codecs
+const void *archive_stored_data(const Archive *a, const ArchiveEntry *e);
+
+// Addon manifests (NAME.addon.manifest, written by create_addon) list what an
+// addon provides, so sscc can tell which addons an invocation needs without
+// opening them. Text lines:
+//   size N          size of the addon file the manifest describes
+//   include NAME    a header directly under include/, or NAME/ for a directory
+//   lib NAME        lib/libNAME.a or lib/libNAME.so*, what -lNAME links
+//   needs FILE      another addon (by file name) holding targets of this
+//                   one's links, which has to be loaded first
+// needs lists need_count such file names; only create_addon knows them.
+int archive_write_manifest(const Archive *a, const char *const *needs, int need_count, FILE *out);
+
+int archive_codec_from_name(const char *name);
+const char *archive_codec_name(int codec);
+
+// Perfect-hash index over entry paths: u32 bucket_count, u32 slot_count,
+// u32 seeds[bucket_count], u32 slots[slot_count]. Built once, looked up with
+// two hashes and one string compare.
+int archive_build_index(const Archive *a, uint32_t **index, uint32_t *index_size);
+
+// Archive writer used by the build tools
+typedef struct {
+    char *path;
+    uint32_t dir_id;
+    uint32_t codec;
+    uint32_t original_size;
+    uint64_t content_hash;
+    unsigned char *blob;
+    size_t blob_size;
+    unsigned char *raw;         // data waiting to be compressed (a whole
+    size_t raw_size;            // solid block once packed)
+    uint32_t block_offset;
+    uint32_t blob_owner;        // entry whose blob holds this entry's data
+} ArchiveBuildEntry;
+
+typedef struct {
+    int kind;
+    int codec;                  // tier for new entries, ARCHIVE_CODEC_LZMA by default
+    const char *name;
+    const char *description;
+    ArchiveBuildEntry *entries;
+    uint32_t count;
+    uint32_t capacity;
+    char **dirs;
+    uint32_t dir_count;
+    uint32_t hot_count;         // set by archive_builder_order_hot
+    int threads;                // compression threads, 0 for pool_default_threads()
+    const char *blob_cache;     // directory of blobs from earlier builds, or NULL
+    uint32_t blob_count;        // set by archive_builder_write: blobs to compress
+    uint32_t blobs_reused;      // and how many of them came from blob_cache
+} ArchiveBuilder;
+
+void archive_builder_init(ArchiveBuilder *b, int kind, const char *name, const char *description);
+int archive_builder_add(ArchiveBuilder *b, const char *path, const void *data, size_t size);
+// Adds path as a reference to target, which holds `size` bytes hashing to
+// content_hash, instead of storing the data again
+int archive_builder_add_link(ArchiveBuilder *b, const char *path, const char *target,
+                             size_t size, uint64_t content_hash);
+// Moves the entries named in a hot-set manifest to the front of the archive,
+// most used first, and keeps them out of solid blocks shared with the rest.
+// Manifest lines are "COUNT PATH" (as from `sort | uniq -c`) or bare paths
+// from sscc --sscc-profile; counts of repeated paths add up. Returns the
+// number of hot entries, or -1 if the manifest cannot be read.
+int archive_builder_order_hot(ArchiveBuilder *b, const char *manifest);
+// Entries are compressed here, not when added: solid blocks are packed, then
+// every blob is compressed on the thread pool. A blob depends only on its
+// codec and input, so the archive is the same whatever the thread count, and
+// blobs found in blob_cache (keyed by that pair) are not compressed again.
+int archive_builder_write(ArchiveBuilder *b, FILE *out, int with_index);
+void archive_builder_free(ArchiveBuilder *b);
+
+int lzma_compress_data(const char *input, size_t input_size, char **output, size_t *output_size);
+int lzma_decompress_data(const char *input, size_t input_size, char *output, size_t output_size);
+
+#endif
@@ -0,0 +1,336 @@
+// Batched file creation (see batch.h)
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#ifdef __linux__
+#include <linux/io_uring.h>
+#endif
+#include "batch.h"
+
+// A path an earlier archive made a link (a symlink) must be replaced, not
+// written through: O_NOFOLLOW fails with ELOOP, and the link is removed and
+// the file created again (see plain_create)
+#define OPEN_FLAGS (O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW)
+
+int file_batch_uring_enabled(void) {
+    const char *env = getenv("SSCC_NO_URING");
+    return !(env && *env && strcmp(env, "0") != 0);
+}
+
+void file_batch_init(FileBatch *b, int dir_fd, int use_uring) {
+    memset(b, 0, sizeof(*b));
+    b->dir_fd = dir_fd;
+    b->use_uring = use_uring;
+}
+
+void file_batch_add(FileBatch *b, const char *path, const void *data, size_t size, uint32_t id) {
+    FileBatchItem *it = &b->items[b->count++];
+    it->path = path;
+    it->data = data;
+    it->size = size;
+    it->id = id;
+    it->temp = NULL;
+    memset(it->result, 0, sizeof(it->result));
+    if (b->atomic) {
+        size_t len = strlen(path);
+        it->temp = malloc(len + sizeof(FILE_BATCH_TEMP_SUFFIX));
+        if (it->temp) {
+            memcpy(it->temp, path, len);
+            memcpy(it->temp + len, FILE_BATCH_TEMP_SUFFIX, sizeof(FILE_BATCH_TEMP_SUFFIX));
+        }
+    }
+}
+
+// An atomic batch item that could not get its temporary name fails
+static int item_missing_temp(const FileBatch *b, const FileBatchItem *it) {
+    return b->atomic && !it->temp;
+}
+
+static void plain_create(FileBatch *b, FileBatchItem *it) {
+    const char *name = it->temp ? it->temp : it->path;
+    int fd = openat(b->dir_fd, name, OPEN_FLAGS | O_CLOEXEC, 0666);
+    b->syscalls++;
+    if (fd < 0 && errno == ELOOP && unlinkat(b->dir_fd, name, 0) == 0) {
+        fd = openat(b->dir_fd, name, OPEN_FLAGS | O_CLOEXEC, 0666);
+        b->syscalls += 2;
+    }
+    it->result[0] = fd < 0 ? -errno : 0;
+    if (fd < 0) return;
+    
+    const char *p = it->data;
+    size_t left = it->size;
+    while (left > 0) {
+        ssize_t n = write(fd, p, left);
+        b->syscalls++;
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        p += n;
+        left -= n;
+    }
+    it->result[1] = (int)(it->size - left);
+    it->result[2] = close(fd) != 0 ? -errno : 0;
+    b->syscalls++;
+    
+    // Only a complete file is published
+    if (it->temp) {
+        it->result[3] = -ECANCELED;
+        if (left == 0 && it->result[2] == 0) {
+            it->result[3] = renameat(b->dir_fd, it->temp, b->dir_fd, it->path) != 0 ? -errno : 0;
+            b->syscalls++;
+        }
+    }
+}
+
+static void plain_flush(FileBatch *b) {
+    for (uint32_t i = 0; i < b->count; i++) {
+        FileBatchItem *it = &b->items[i];
+        if (item_missing_temp(b, it)) {
+            it->result[0] = -ENOMEM;
+            continue;
+        }
+        plain_create(b, it);
+    }
+}
+
+#ifdef IORING_FEAT_CQE_SKIP
+// Every file is up to four operations: openat into direct descriptor slot
+// i + 1, write through it, close it and, in atomic batches, rename it
+#define RING_OPS 4
+#define RING_ENTRIES (FILE_BATCH_MAX * RING_OPS)
+
+struct FileBatchRing {
+    int fd;
+    unsigned char *rings;       // SQ and CQ rings share one mapping
+    size_t rings_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+};
+
+static void ring_free(FileBatch *b) {
+    struct FileBatchRing *r = b->ring;
+    if (r->sqes) munmap(r->sqes, r->sqes_size);
+    if (r->rings) munmap(r->rings, r->rings_size);
+    close(r->fd);
+    b->syscalls += 3;
+    free(r);
+    b->ring = NULL;
+}
+
+static int ring_setup(FileBatch *b) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = syscall(__NR_io_uring_setup, RING_ENTRIES, &p);
+    b->syscalls++;
+    if (fd < 0) return -1;
+    
+    // Direct descriptors arrived in 5.15; CQE_SKIP (5.17) is the first
+    // feature bit that implies them
+    struct FileBatchRing *r = calloc(1, sizeof(*r));
+    if (!r || !(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_CQE_SKIP)) {
+        free(r);
+        close(fd);
+        b->syscalls++;
+        return -1;
+    }
+    r->fd = fd;
+    b->ring = r;
+    
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    r->rings_size = sq_size > cq_size ? sq_size : cq_size;
+    r->rings = mmap(NULL, r->rings_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                    IORING_OFF_SQ_RING);
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                   IORING_OFF_SQES);
+    b->syscalls += 2;
+    if (r->rings == MAP_FAILED || r->sqes == MAP_FAILED) {
+        if (r->rings == MAP_FAILED) r->rings = NULL;
+        if (r->sqes == MAP_FAILED) r->sqes = NULL;
+        ring_free(b);
+        return -1;
+    }
+    r->sq_tail = (unsigned*)(r->rings + p.sq_off.tail);
+    r->sq_mask = *(unsigned*)(r->rings + p.sq_off.ring_mask);
+    r->sq_array = (unsigned*)(r->rings + p.sq_off.array);
+    r->cq_head = (unsigned*)(r->rings + p.cq_off.head);
+    r->cq_tail = (unsigned*)(r->rings + p.cq_off.tail);
+    r->cq_mask = *(unsigned*)(r->rings + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe*)(r->rings + p.cq_off.cqes);
+    
+    // An empty table of direct descriptors, one slot per batch item
+    int fds[FILE_BATCH_MAX];
+    memset(fds, 0xff, sizeof(fds));
+    int ret = syscall(__NR_io_uring_register, fd, IORING_REGISTER_FILES, fds, FILE_BATCH_MAX);
+    b->syscalls++;
+    if (ret < 0) {
+        ring_free(b);
+        return -1;
+    }
+    return 0;
+}
+
+static struct io_uring_sqe *ring_sqe(struct FileBatchRing *r, unsigned *tail, uint64_t user_data) {
+    unsigned idx = *tail & r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = user_data;
+    r->sq_array[idx] = idx;
+    (*tail)++;
+    return sqe;
+}
+
+static void ring_reap(struct FileBatchRing *r, FileBatch *b, unsigned *completed) {
+    unsigned head = *r->cq_head;
+    unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+        struct io_uring_cqe *cqe = &r->cqes[head & r->cq_mask];
+        b->items[cqe->user_data / RING_OPS].result[cqe->user_data % RING_OPS] = cqe->res;
+        (*completed)++;
+    }
+    __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+}
+
+// Returns -1 if nothing could be submitted, for the caller to fall back
+static int ring_flush(FileBatch *b) {
+    struct FileBatchRing *r = b->ring;
+    unsigned tail = *r->sq_tail;
+    unsigned ops = 0;
+    for (uint32_t i = 0; i < b->count; i++) {
+        FileBatchItem *it = &b->items[i];
+        if (item_missing_temp(b, it)) {
+            it->result[0] = -ENOMEM;
+            continue;
+        }
+        
+        // A failed openat cancels the write; the close runs regardless.
+        // In atomic batches any failure cancels the rest, rename included:
+        // the descriptor left in its slot is replaced by the next openat
+        // into it, or closed with the ring.
+        struct io_uring_sqe *sqe = ring_sqe(r, &tail, i * RING_OPS);
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->fd = b->dir_fd;
+        sqe->addr = (uintptr_t)(it->temp ? it->temp : it->path);
+        sqe->len = 0666;
+        sqe->open_flags = OPEN_FLAGS;
+        sqe->file_index = i + 1;
+        
+        if (it->size > 0) {
+            sqe = ring_sqe(r, &tail, i * RING_OPS + 1);
+            sqe->opcode = IORING_OP_WRITE;
+            sqe->flags = IOSQE_FIXED_FILE | (it->temp ? IOSQE_IO_LINK : IOSQE_IO_HARDLINK);
+            sqe->fd = i;
+            sqe->addr = (uintptr_t)it->data;
+            sqe->len = it->size;
+            ops++;
+        }
+        
+        sqe = ring_sqe(r, &tail, i * RING_OPS + 2);
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->file_index = i + 1;
+        ops += 2;
+        
+        if (it->temp) {
+            sqe->flags = IOSQE_IO_LINK;
+            sqe = ring_sqe(r, &tail, i * RING_OPS + 3);
+            sqe->opcode = IORING_OP_RENAMEAT;
+            sqe->fd = b->dir_fd;
+            sqe->addr = (uintptr_t)it->temp;
+            sqe->len = b->dir_fd;
+            sqe->addr2 = (uintptr_t)it->path;
+            ops++;
+        }
+    }
+    __atomic_store_n(r->sq_tail, tail, __ATOMIC_RELEASE);
+    
+    unsigned submitted = 0, completed = 0;
+    while (completed < ops) {
+        int ret = syscall(__NR_io_uring_enter, r->fd, ops - submitted, ops - completed,
+                          IORING_ENTER_GETEVENTS, NULL, 0);
+        b->syscalls++;
+        if (ret < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY)) {
+            ring_reap(r, b, &completed);
+            continue;
+        }
+        if (ret < 0) {
+            if (submitted == 0) {
+                // Take the queued entries back so the ring stays consistent
+                __atomic_store_n(r->sq_tail, tail - ops, __ATOMIC_RELEASE);
+                return -1;
+            }
+            for (uint32_t i = 0; i < b->count; i++) b->items[i].result[0] = -EIO;
+            break;
+        }
+        submitted += ret;
+        ring_reap(r, b, &completed);
+    }
+    return 0;
+}
+#endif
+
+void file_batch_flush(FileBatch *b, FileBatchDone done, void *ctx) {
+    if (b->count == 0) return;
+    
+    int flushed = 0;
+#ifdef IORING_FEAT_CQE_SKIP
+    // A single file gains nothing from a ring it would have to set up
+    if (b->use_uring && !b->ring && b->count > 1 && ring_setup(b) != 0) {
+        b->use_uring = 0;
+    }
+    if (b->ring) {
+        flushed = ring_flush(b) == 0;
+        if (!flushed) {
+            ring_free(b);
+            b->use_uring = 0;
+        }
+    }
+#endif
+    if (!flushed) {
+        plain_flush(b);
+    } else {
+        // Files that replace a link are created again, one by one
+        for (uint32_t i = 0; i < b->count; i++) {
+            if (b->items[i].result[0] == -ELOOP) plain_create(b, &b->items[i]);
+        }
+    }
+    
+    for (uint32_t i = 0; i < b->count; i++) {
+        FileBatchItem *it = &b->items[i];
+        int err = 0;
+        if (it->result[0] < 0) {
+            err = FILE_BATCH_ERR_CREATE;
+        } else if (it->result[1] != (int)it->size || it->result[2] < 0 || it->result[3] < 0) {
+            err = FILE_BATCH_ERR_WRITE;
+        }
+        if (err && it->temp) {
+            unlinkat(b->dir_fd, it->temp, 0);
+            b->syscalls++;
+        }
+        free(it->temp);
+        it->temp = NULL;
+        done(ctx, it->id, err);
+    }
+    b->count = 0;
+}
+
+void file_batch_free(FileBatch *b) {
+#ifdef IORING_FEAT_CQE_SKIP
+    if (b->ring) ring_free(b);
+#endif
+    for (uint32_t i = 0; i < b->count; i++) free(b->items[i].temp);
+    b->count = 0;
+}
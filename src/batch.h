@@ -0,0 +1,62 @@
+// Batched file creation for extraction trees on tmpfs or disk
+#ifndef SSCC_BATCH_H
+#define SSCC_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Files are queued, then created all at once by file_batch_flush: with
+// io_uring, one system call submits every file's openat, write and close,
+// linked so each runs after the previous one, and waits for them. Without it
+// (kernels before 5.17, io_uring disabled by a seccomp filter or
+// SSCC_NO_URING=1), the same calls are made one by one. A batch belongs to
+// one thread.
+//
+// An atomic batch writes each file under a temporary name and renames it
+// into place once complete, for trees read while they are being extracted:
+// a path then never shows a partial file.
+#define FILE_BATCH_MAX 64
+
+#define FILE_BATCH_ERR_CREATE 1
+#define FILE_BATCH_ERR_WRITE 2
+
+#define FILE_BATCH_TEMP_SUFFIX ".sscc-part"
+
+typedef struct {
+    const char *path;           // relative to the batch's directory
+    const void *data;
+    size_t size;
+    uint32_t id;                // the caller's, passed back to done
+    char *temp;                 // temporary name, atomic batches only
+    int result[4];              // of the openat, write, close and rename
+} FileBatchItem;
+
+typedef struct {
+    int dir_fd;                 // directory the paths are relative to
+    int use_uring;              // 0 once io_uring turns out to be unavailable
+    int atomic;                 // set after file_batch_init, see above
+    struct FileBatchRing *ring; // set up on first flush
+    FileBatchItem items[FILE_BATCH_MAX];
+    uint32_t count;
+    uint64_t syscalls;          // system calls made so far, ring setup included
+} FileBatch;
+
+void file_batch_init(FileBatch *b, int dir_fd, int use_uring);
+void file_batch_free(FileBatch *b);
+
+static inline int file_batch_full(const FileBatch *b) {
+    return b->count == FILE_BATCH_MAX;
+}
+
+// Queues a file. path and data must stay valid until the next flush.
+void file_batch_add(FileBatch *b, const char *path, const void *data, size_t size, uint32_t id);
+
+// Creates the queued files and calls done for each, in queue order, with 0
+// or a FILE_BATCH_ERR_* code. The batch is empty afterwards.
+typedef void (*FileBatchDone)(void *ctx, uint32_t id, int err);
+void file_batch_flush(FileBatch *b, FileBatchDone done, void *ctx);
+
+// Whether io_uring can be used at all: not switched off with SSCC_NO_URING
+int file_batch_uring_enabled(void);
+
+#endif
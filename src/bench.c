@@ -0,0 +1,467 @@
+// SSCC benchmark driver (make bench)
+//
+// Runs sscc over the bundled corpus in bench/corpus and measures, per case:
+//   cold     first compile into an empty cache directory (core extraction)
+//   warm     compile against the populated cache, object cache disabled
+//   hit      warm compile answered by the object cache
+//   bare     the extracted tcc run directly with the same arguments
+//   overhead warm - bare, i.e. what the wrapper itself costs
+//   max RSS  peak resident set of sscc and its children, cold and warm
+//   throughput  warm compiles per second with N concurrent invocations
+// Times are medians over --runs repetitions. Results are written as JSON,
+// and --baseline compares them against an earlier file so that extraction
+// and storage changes can be judged on numbers.
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <glob.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#define MAX_PATH 4096
+#define MAX_CASE_ARGS 16
+#define MAX_NAME 64             // Room for what is appended to a corpus or work path
+#define THROUGHPUT_ROUNDS 4     // Compiles per concurrent invocation
+
+typedef struct {
+    const char *name;
+    const char *args[MAX_CASE_ARGS];    // Relative to the corpus directory
+    int needs_gmp;
+} BenchCase;
+
+static const BenchCase cases[] = {
+    { "hello",   { "hello.c", NULL }, 0 },
+    { "headers", { "headers.c", NULL }, 0 },
+    { "multi",   { "multi/main.c", "multi/tokenize.c", "multi/table.c", "multi/hash.c",
+                   "multi/report.c", NULL }, 0 },
+    { "multi-j", { "-j", "multi/main.c", "multi/tokenize.c", "multi/table.c", "multi/hash.c",
+                   "multi/report.c", NULL }, 0 },
+    { "gmp",     { "gmp.c", "-lgmp", NULL }, 1 },
+};
+
+typedef struct {
+    double cold_ms;
+    double warm_ms;
+    double hit_ms;
+    double bare_ms;
+    long cold_rss_kb;
+    long warm_rss_kb;
+    double throughput;
+    int skipped;
+} BenchResult;
+
+static const char *sscc_path;
+static const char *addon_path;
+static char corpus_dir[MAX_PATH];
+static char work_dir[MAX_PATH];
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double median(double *values, int count) {
+    qsort(values, count, sizeof(double), compare_double);
+    return count % 2 ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+static int make_writable_cb(const char *path, const struct stat *sb, int flag, struct FTW *ftwbuf) {
+    (void)ftwbuf;
+    if (flag == FTW_D) chmod(path, sb->st_mode | S_IWUSR | S_IXUSR);
+    return 0;
+}
+
+static int remove_entry_cb(const char *path, const struct stat *sb, int flag, struct FTW *ftwbuf) {
+    (void)sb; (void)ftwbuf;
+    if (flag == FTW_DP) {
+        rmdir(path);
+    } else {
+        unlink(path);
+    }
+    return 0;
+}
+
+// Cached trees are read-only, so reopen directories before unlinking
+static void remove_tree(const char *dir) {
+    nftw(dir, make_writable_cb, 16, FTW_PHYS);
+    nftw(dir, remove_entry_cb, 16, FTW_PHYS | FTW_DEPTH);
+}
+
+// Builds argv for one case: prefix (sscc or the bare tcc with its tree
+// flags), the case arguments with corpus paths resolved, then -o output
+static char **case_argv(const BenchCase *bc, const char *const *prefix, const char *output) {
+    static char paths[MAX_CASE_ARGS][MAX_PATH + MAX_NAME];
+    static char *argv[2 * MAX_CASE_ARGS + 8];
+    int n = 0;
+    
+    for (int i = 0; prefix[i]; i++) {
+        argv[n++] = (char*)prefix[i];
+    }
+    for (int i = 0; bc->args[i]; i++) {
+        if (bc->args[i][0] == '-') {
+            argv[n++] = (char*)bc->args[i];
+        } else {
+            snprintf(paths[i], sizeof(paths[i]), "%s/%s", corpus_dir, bc->args[i]);
+            argv[n++] = paths[i];
+        }
+    }
+    argv[n++] = "-o";
+    argv[n++] = (char*)output;
+    argv[n] = NULL;
+    return argv;
+}
+
+// Starts a compile with output discarded and the given cache settings
+static pid_t start_compile(char **argv, const char *cache_dir, int object_cache) {
+    pid_t pid = fork();
+    if (pid != 0) return pid;
+    
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    dup2(null_fd, STDERR_FILENO);
+    setenv("SSCC_NO_SERVER", "1", 1);
+    if (cache_dir) setenv("SSCC_CACHE_DIR", cache_dir, 1);
+    if (!object_cache) setenv("SSCC_NO_OBJECT_CACHE", "1", 1);
+    execv(argv[0], argv);
+    _exit(127);
+}
+
+// Runs one compile; returns its wall time in ms (negative on failure) and
+// the peak RSS of the process tree through *rss_kb
+static double run_compile(char **argv, const char *cache_dir, int object_cache, long *rss_kb) {
+    double start = now_ms();
+    pid_t pid = start_compile(argv, cache_dir, object_cache);
+    if (pid < 0) return -1;
+    
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) != pid) return -1;
+    double elapsed = now_ms() - start;
+    
+    if (rss_kb && usage.ru_maxrss > *rss_kb) *rss_kb = usage.ru_maxrss;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? elapsed : -1;
+}
+
+// Finds the extracted tree (v<key>) in a cache directory
+static int find_tree(const char *cache_dir, char *tree, size_t tree_size) {
+    char pattern[MAX_PATH + MAX_NAME];
+    glob_t found;
+    if (snprintf(pattern, sizeof(pattern), "%s/v????????????????", cache_dir) >= (int)sizeof(pattern)) {
+        return -1;
+    }
+    if (glob(pattern, GLOB_ONLYDIR, NULL, &found) != 0 || found.gl_pathc == 0) {
+        globfree(&found);
+        return -1;
+    }
+    snprintf(tree, tree_size, "%s", found.gl_pathv[0]);
+    globfree(&found);
+    return 0;
+}
+
+static int run_case(const BenchCase *bc, int runs, int jobs, BenchResult *result) {
+    memset(result, 0, sizeof(*result));
+    if (bc->needs_gmp && !addon_path) {
+        result->skipped = 1;
+        return 0;
+    }
+    
+    const char *sscc_prefix[4] = { sscc_path, NULL, NULL, NULL };
+    if (bc->needs_gmp) {
+        sscc_prefix[1] = "--addon";
+        sscc_prefix[2] = addon_path;
+    }
+    
+    char output[MAX_PATH + MAX_NAME], cache_dir[MAX_PATH + MAX_NAME];
+    snprintf(output, sizeof(output), "%s/%s.out", work_dir, bc->name);
+    double *times = malloc(runs * sizeof(double));
+    char **argv;
+    
+    // Cold: a fresh cache directory for every run
+    for (int r = 0; r < runs; r++) {
+        snprintf(cache_dir, sizeof(cache_dir), "%s/cold-%s-%d", work_dir, bc->name, r);
+        argv = case_argv(bc, sscc_prefix, output);
+        times[r] = run_compile(argv, cache_dir, 0, &result->cold_rss_kb);
+        remove_tree(cache_dir);
+        if (times[r] < 0) goto failed;
+    }
+    result->cold_ms = median(times, runs);
+    
+    // Warm: one populated cache shared by every run
+    snprintf(cache_dir, sizeof(cache_dir), "%s/warm-%s", work_dir, bc->name);
+    argv = case_argv(bc, sscc_prefix, output);
+    if (run_compile(argv, cache_dir, 0, NULL) < 0) goto failed;
+    for (int r = 0; r < runs; r++) {
+        times[r] = run_compile(argv, cache_dir, 0, &result->warm_rss_kb);
+        if (times[r] < 0) goto failed;
+    }
+    result->warm_ms = median(times, runs);
+    
+    // Object cache hits (the first run stores the entry)
+    if (run_compile(argv, cache_dir, 1, NULL) < 0) goto failed;
+    for (int r = 0; r < runs; r++) {
+        times[r] = run_compile(argv, cache_dir, 1, NULL);
+        if (times[r] < 0) goto failed;
+    }
+    result->hit_ms = median(times, runs);
+    
+    // Bare tcc from the warm tree, with the flags sscc would add; -j is a
+    // wrapper option tcc does not know
+    char tree[MAX_PATH], tcc[MAX_PATH + MAX_NAME], inc[MAX_PATH + MAX_NAME], lib[MAX_PATH + MAX_NAME],
+         b[MAX_PATH + MAX_NAME];
+    if (find_tree(cache_dir, tree, sizeof(tree)) != 0) goto failed;
+    snprintf(tcc, sizeof(tcc), "%s/tcc", tree);
+    snprintf(inc, sizeof(inc), "-I%s/include", tree);
+    snprintf(lib, sizeof(lib), "-L%s/lib", tree);
+    snprintf(b, sizeof(b), "-B%s/lib", tree);
+    const char *bare_prefix[] = { tcc, inc, lib, b, "-static", NULL };
+    BenchCase bare_case = *bc;
+    int n = 0;
+    for (int i = 0; bc->args[i]; i++) {
+        if (strcmp(bc->args[i], "-j") != 0) bare_case.args[n++] = bc->args[i];
+    }
+    bare_case.args[n] = NULL;
+    argv = case_argv(&bare_case, bare_prefix, output);
+    for (int r = 0; r < runs; r++) {
+        times[r] = run_compile(argv, NULL, 0, NULL);
+        if (times[r] < 0) goto failed;
+    }
+    result->bare_ms = median(times, runs);
+    
+    // Throughput: jobs concurrent invocations, each compiling a few times
+    double start = now_ms();
+    pid_t *pids = malloc(jobs * sizeof(pid_t));
+    int failures = 0;
+    for (int j = 0; j < jobs; j++) {
+        pids[j] = fork();
+        if (pids[j] == 0) {
+            char job_output[MAX_PATH + MAX_NAME];
+            snprintf(job_output, sizeof(job_output), "%s/%s.%d.out", work_dir, bc->name, j);
+            char **job_argv = case_argv(bc, sscc_prefix, job_output);
+            for (int r = 0; r < THROUGHPUT_ROUNDS; r++) {
+                if (run_compile(job_argv, cache_dir, 0, NULL) < 0) _exit(1);
+            }
+            unlink(job_output);
+            _exit(0);
+        }
+    }
+    for (int j = 0; j < jobs; j++) {
+        int status;
+        if (pids[j] < 0 || waitpid(pids[j], &status, 0) != pids[j] || !WIFEXITED(status) ||
+            WEXITSTATUS(status) != 0) {
+            failures++;
+        }
+    }
+    free(pids);
+    if (failures) goto failed;
+    result->throughput = jobs * THROUGHPUT_ROUNDS / ((now_ms() - start) / 1000.0);
+    
+    remove_tree(cache_dir);
+    unlink(output);
+    free(times);
+    return 0;
+
+failed:
+    fprintf(stderr, "Error: Case '%s' failed to compile\n", bc->name);
+    remove_tree(cache_dir);
+    free(times);
+    return -1;
+}
+
+// Looks up "key": <number> inside the object of the named case in a
+// results file written by this tool; returns -1 if absent
+static double baseline_value(const char *json, const char *name, const char *key) {
+    char needle[128];
+    snprintf(needle, sizeof(needle), "\"name\": \"%s\"", name);
+    const char *object = strstr(json, needle);
+    if (!object) return -1;
+    
+    const char *end = strchr(object, '}');
+    snprintf(needle, sizeof(needle), "\"%s\": ", key);
+    const char *field = strstr(object, needle);
+    if (!field || (end && field > end)) return -1;
+    return atof(field + strlen(needle));
+}
+
+static char *read_text_file(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *text = malloc(size + 1);
+    if (text && fread(text, 1, size, f) != (size_t)size) {
+        free(text);
+        text = NULL;
+    }
+    if (text) text[size] = '\0';
+    fclose(f);
+    return text;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s --sscc PATH [options]\n", prog);
+    fprintf(stderr, "  --addon FILE       GMP addon for the gmp case (skipped without it)\n");
+    fprintf(stderr, "  --corpus DIR       Benchmark sources (default bench/corpus)\n");
+    fprintf(stderr, "  --runs N           Repetitions per measurement (default 5)\n");
+    fprintf(stderr, "  --jobs N           Concurrent invocations for throughput (default: CPUs)\n");
+    fprintf(stderr, "  --output FILE      Write results as JSON\n");
+    fprintf(stderr, "  --baseline FILE    Compare against an earlier results file\n");
+    fprintf(stderr, "  --threshold PCT    Allowed slowdown against the baseline (default 10)\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *corpus = "bench/corpus";
+    const char *output_path = NULL;
+    const char *baseline_path = NULL;
+    double threshold = 10.0;
+    int runs = 5, jobs = 0;
+    
+    for (int i = 1; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "--sscc") == 0 && value) {
+            sscc_path = argv[++i];
+        } else if (strcmp(argv[i], "--addon") == 0 && value) {
+            addon_path = argv[++i];
+        } else if (strcmp(argv[i], "--corpus") == 0 && value) {
+            corpus = argv[++i];
+        } else if (strcmp(argv[i], "--runs") == 0 && value) {
+            runs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--jobs") == 0 && value) {
+            jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--output") == 0 && value) {
+            output_path = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && value) {
+            baseline_path = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && value) {
+            threshold = atof(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!sscc_path) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (runs < 1) runs = 1;
+    if (jobs < 1) jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs < 1) jobs = 1;
+    
+    // Child processes run from other directories' point of view, so every
+    // path they get is absolute
+    char sscc_abs[MAX_PATH], addon_abs[MAX_PATH];
+    if (!realpath(sscc_path, sscc_abs) || !realpath(corpus, corpus_dir)) {
+        fprintf(stderr, "Error: Cannot find %s or %s\n", sscc_path, corpus);
+        return 1;
+    }
+    sscc_path = sscc_abs;
+    if (addon_path) {
+        if (!realpath(addon_path, addon_abs)) {
+            fprintf(stderr, "Warning: Addon %s not found, skipping the gmp case\n", addon_path);
+            addon_path = NULL;
+        } else {
+            addon_path = addon_abs;
+        }
+    }
+    
+    const char *tmpdir = getenv("TMPDIR");
+    snprintf(work_dir, sizeof(work_dir), "%s/sscc_bench_XXXXXX", tmpdir ? tmpdir : "/tmp");
+    if (!mkdtemp(work_dir)) {
+        fprintf(stderr, "Error: Cannot create work directory: %s\n", strerror(errno));
+        return 1;
+    }
+    
+    size_t case_count = sizeof(cases) / sizeof(cases[0]);
+    BenchResult results[sizeof(cases) / sizeof(cases[0])];
+    int failed = 0;
+    
+    printf("%-8s %9s %9s %9s %9s %9s %10s %10s %9s\n", "case", "cold ms", "warm ms", "hit ms",
+           "tcc ms", "overhead", "cold RSS", "warm RSS", "compile/s");
+    for (size_t c = 0; c < case_count; c++) {
+        BenchResult *r = &results[c];
+        if (run_case(&cases[c], runs, jobs, r) != 0) {
+            failed = 1;
+            r->skipped = 1;
+            continue;
+        }
+        if (r->skipped) {
+            printf("%-8s (skipped: no addon)\n", cases[c].name);
+            continue;
+        }
+        printf("%-8s %9.2f %9.2f %9.2f %9.2f %9.2f %8ldKB %8ldKB %9.1f\n", cases[c].name,
+               r->cold_ms, r->warm_ms, r->hit_ms, r->bare_ms, r->warm_ms - r->bare_ms,
+               r->cold_rss_kb, r->warm_rss_kb, r->throughput);
+    }
+    rmdir(work_dir);
+    
+    if (output_path) {
+        FILE *out = fopen(output_path, "w");
+        if (!out) {
+            fprintf(stderr, "Error: Cannot write %s\n", output_path);
+            return 1;
+        }
+        fprintf(out, "{\n  \"sscc\": \"%s\",\n  \"runs\": %d,\n  \"concurrency\": %d,\n  \"cases\": [\n",
+                sscc_path, runs, jobs);
+        for (size_t c = 0; c < case_count; c++) {
+            const BenchResult *r = &results[c];
+            fprintf(out, "    {\"name\": \"%s\", \"skipped\": %s", cases[c].name,
+                    r->skipped ? "true" : "false");
+            if (!r->skipped) {
+                fprintf(out, ", \"cold_ms\": %.3f, \"warm_ms\": %.3f, \"hit_ms\": %.3f, "
+                        "\"bare_tcc_ms\": %.3f, \"overhead_ms\": %.3f, \"cold_max_rss_kb\": %ld, "
+                        "\"warm_max_rss_kb\": %ld, \"throughput_per_s\": %.2f",
+                        r->cold_ms, r->warm_ms, r->hit_ms, r->bare_ms, r->warm_ms - r->bare_ms,
+                        r->cold_rss_kb, r->warm_rss_kb, r->throughput);
+            }
+            fprintf(out, "}%s\n", c + 1 < case_count ? "," : "");
+        }
+        fprintf(out, "  ]\n}\n");
+        fclose(out);
+        printf("Results written to %s\n", output_path);
+    }
+    
+    // Regression check: cold and warm times may grow by at most threshold%
+    if (baseline_path) {
+        char *baseline = read_text_file(baseline_path);
+        if (!baseline) {
+            fprintf(stderr, "Error: Cannot read baseline %s\n", baseline_path);
+            return 1;
+        }
+        
+        static const char *const keys[] = { "cold_ms", "warm_ms" };
+        int regressions = 0;
+        for (size_t c = 0; c < case_count; c++) {
+            if (results[c].skipped) continue;
+            const double current[] = { results[c].cold_ms, results[c].warm_ms };
+            for (int k = 0; k < 2; k++) {
+                double before = baseline_value(baseline, cases[c].name, keys[k]);
+                if (before <= 0) continue;
+                double change = (current[k] - before) / before * 100.0;
+                if (change > threshold) {
+                    printf("REGRESSION %s %s: %.2f -> %.2f ms (+%.1f%%, limit %.1f%%)\n",
+                           cases[c].name, keys[k], before, current[k], change, threshold);
+                    regressions++;
+                }
+            }
+        }
+        free(baseline);
+        if (regressions) return 2;
+        printf("No regressions beyond %.1f%% against %s\n", threshold, baseline_path);
+    }
+    
+    return failed;
+}
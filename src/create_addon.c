@@ -6,124 +6,256 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <stdint.h>
-#include <lzma.h>
+#include "archive.h"
+#include "hash.h"
+#include "payload.h"
+#include "staticlib.h"
 
 #define MAX_PATH 4096
-#define MAX_CORE_FILES 1024
 
-// Dynamic core files list (loaded from embedded archive)
-static char core_files[MAX_CORE_FILES][MAX_PATH];
-static int core_file_count = 0;
+// Open-addressing table from a 64-bit hash to a tree path. Keyed by the hash
+// of the path it finds exact core paths; keyed by content hash it finds an
+// earlier copy of the same bytes (in the core, another addon or this one).
+typedef struct {
+    uint64_t key;
+    uint32_t size;              // content size, for content lookups
+    char *path;                 // NULL marks an empty slot
+    const Archive *archive;     // where a content slot's bytes can be read back:
+    uint32_t entry;             // an entry of the core or a --dedup-with addon,
+    char *file;                 // or a file of this addon's input directories
+} PathSlot;
 
-// External symbols for embedded core archive (same as in sscc.c)
-extern const unsigned char sscc_archive_data[];
-extern const unsigned int sscc_archive_size;
+typedef struct {
+    PathSlot *slots;
+    size_t capacity;            // power of two
+    size_t count;
+} PathTable;
 
-static uint32_t read_uint32(const char **data) {
-    uint32_t val = *(uint32_t*)*data;
-    *data += sizeof(uint32_t);
-    return val;
+static PathTable core_paths;    // exact relative paths of core entries
+static PathTable contents;      // content hash -> first path holding it
+
+static uint64_t path_key(const char *path) {
+    return sscc_hash64(path, strlen(path), SSCC_HASH_INIT);
 }
 
-static int load_core_files_from_archive() {
-    const char *data = (const char*)sscc_archive_data;
-    
-    if (!data || sscc_archive_size < 8) {
-        fprintf(stderr, "Warning: No embedded core archive found, using minimal exclusions\n");
-        // Fallback to basic exclusions
-        strcpy(core_files[0], "libc.a");
-        strcpy(core_files[1], "libm.a");
-        strcpy(core_files[2], "libtcc1.a");
-        core_file_count = 3;
-        return 0;
+// path != NULL matches by path, otherwise by content size
+static const PathSlot *table_find(const PathTable *t, uint64_t key, const char *path, uint32_t size) {
+    if (!t->capacity) return NULL;
+    for (size_t i = key & (t->capacity - 1); t->slots[i].path; i = (i + 1) & (t->capacity - 1)) {
+        const PathSlot *slot = &t->slots[i];
+        if (slot->key == key && (path ? strcmp(slot->path, path) == 0 : slot->size == size)) {
+            return slot;
+        }
     }
-    
-    if (memcmp(data, "CORE", 4) != 0) {
-        fprintf(stderr, "Warning: Invalid core archive format\n");
-        return -1;
+    return NULL;
+}
+
+// Keeps the first path inserted for a key and returns its slot
+static PathSlot *table_insert(PathTable *t, uint64_t key, const char *path, uint32_t size) {
+    if ((t->count + 1) * 2 > t->capacity) {
+        size_t capacity = t->capacity ? t->capacity * 2 : 1024;
+        PathSlot *slots = calloc(capacity, sizeof(PathSlot));
+        if (!slots) return NULL;
+        for (size_t i = 0; i < t->capacity; i++) {
+            if (!t->slots[i].path) continue;
+            size_t j = t->slots[i].key & (capacity - 1);
+            while (slots[j].path) j = (j + 1) & (capacity - 1);
+            slots[j] = t->slots[i];
+        }
+        free(t->slots);
+        t->slots = slots;
+        t->capacity = capacity;
     }
-    data += 4;
     
-    uint32_t file_count = read_uint32(&data);
-    printf("Loading core file list from embedded archive (%u files)...\n", file_count);
-    
-    core_file_count = 0;
-    for (uint32_t i = 0; i < file_count && core_file_count < MAX_CORE_FILES; i++) {
-        uint32_t path_len = read_uint32(&data);
-        if (path_len >= MAX_PATH) {
-            fprintf(stderr, "Warning: Path too long in core archive\n");
+    size_t i = key & (t->capacity - 1);
+    for (; t->slots[i].path; i = (i + 1) & (t->capacity - 1)) {
+        if (t->slots[i].key == key && t->slots[i].size == size) return &t->slots[i];
+    }
+    t->slots[i].path = strdup(path);
+    if (!t->slots[i].path) return NULL;
+    t->slots[i].key = key;
+    t->slots[i].size = size;
+    t->count++;
+    return &t->slots[i];
+}
+
+// Records where the first copy of some content can be read back from:
+// entry of archive a, or file on disk
+static int content_insert(uint64_t hash, const char *path, uint32_t size,
+                          const Archive *a, uint32_t entry, const char *file) {
+    PathSlot *slot = table_insert(&contents, hash, path, size);
+    if (!slot) return -1;
+    if (!slot->archive && !slot->file) {
+        slot->archive = a;
+        slot->entry = entry;
+        slot->file = file ? strdup(file) : NULL;
+    }
+    return 0;
+}
+
+static char *read_whole_file(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    long file_size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *data = file_size > 0 ? malloc(file_size) : NULL;
+    if (!data || fread(data, 1, file_size, f) != (size_t)file_size) {
+        free(data);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+    *size = file_size;
+    return data;
+}
+
+static int is_library_member(const char *path) {
+    return strncmp(path, STATICLIB_MEMBER_DIR, strlen(STATICLIB_MEMBER_DIR)) == 0;
+}
+
+// Content of every entry of an archive that is extracted before this addon.
+// Link entries are skipped: their target is recorded under its own path, and
+// so are library members, which never become files of their own. The archive
+// stays open: candidates are decoded and compared before becoming links.
+static int add_archive_contents(const Archive *a) {
+    for (uint32_t i = 0; i < a->file_count; i++) {
+        const ArchiveEntry *e = &a->entries[i];
+        if (e->codec == ARCHIVE_CODEC_LINK || e->original_size == 0 || e->content_hash == 0) continue;
+        if (is_library_member(archive_path(a, e))) continue;
+        if (content_insert(e->content_hash, archive_path(a, e), e->original_size, a, i, NULL) != 0) {
             return -1;
         }
-        
-        // Extract just the filename for comparison
-        char full_path[MAX_PATH];
-        memcpy(full_path, data, path_len);
-        full_path[path_len] = '\0';
-        data += path_len;
-        
-        // Store the full path for exclusion
-        strcpy(core_files[core_file_count], full_path);
-        core_file_count++;
-        
-        // Skip the file data
-        uint32_t original_size = read_uint32(&data);
-        uint32_t compressed_size = read_uint32(&data);
-        data += compressed_size;
-        
-        (void)original_size; // Suppress unused warning
     }
-    
-    printf("Loaded %d core files for exclusion from addons\n", core_file_count);
     return 0;
 }
 
-static int is_core_file(const char* filename) {
-    // Check against dynamically loaded core files
-    for (int i = 0; i < core_file_count; i++) {
-        // Check if the file path contains this core file
-        if (strstr(filename, core_files[i]) || strstr(core_files[i], filename)) {
-            return 1;
+// Equal hash and size are only a candidate: the bytes must match too
+static int same_content(const PathSlot *slot, const char *data, size_t size) {
+    char *other = NULL;
+    size_t other_size = 0;
+    if (slot->archive) {
+        const ArchiveEntry *e = &slot->archive->entries[slot->entry];
+        other_size = e->original_size;
+        other = malloc(other_size);
+        if (other && archive_decode(slot->archive, e, other) != 0) {
+            free(other);
+            other = NULL;
         }
+    } else if (slot->file) {
+        other = read_whole_file(slot->file, &other_size);
     }
-    return 0;
+    
+    int same = other && other_size == size && memcmp(other, data, size) == 0;
+    free(other);
+    return same;
 }
 
-static int lzma_compress_data(const char *input, size_t input_size, char **output, size_t *output_size) {
-    lzma_stream strm = LZMA_STREAM_INIT;
+// Archives link targets are read back from (see add_archive_contents), and
+// for --dedup-with addons their file and whether a link points into them
+static Archive sources[65];
+static const char *source_files[65];    // NULL for the core
+static int source_linked[65];
+static int source_count = 0;
+
+// --core: a built sscc (whose payload holds the core) or a core archive
+static int load_core_files_from_archive(const char *core_path) {
+    if (!core_path) {
+        fprintf(stderr, "Warning: No core given (--core=sscc), using minimal exclusions\n");
+        // Fallback to basic exclusions
+        const char *minimal[] = { "lib/libc.a", "lib/libm.a", "lib/libtcc1.a" };
+        for (size_t i = 0; i < sizeof(minimal) / sizeof(minimal[0]); i++) {
+            if (!table_insert(&core_paths, path_key(minimal[i]), minimal[i], 0)) return -1;
+        }
+        return 0;
+    }
     
-    lzma_ret ret = lzma_easy_encoder(&strm, 9, LZMA_CHECK_CRC64);
-    if (ret != LZMA_OK) return -1;
+    Payload payload;
+    const char *data = NULL;
+    size_t size = 0;
+    char *file_data = NULL;
+    if (payload_open(&payload, core_path) == 0) {
+        data = (const char*)payload.core;
+        size = payload.core_size;
+    } else {
+        file_data = read_whole_file(core_path, &size);
+        data = file_data;
+    }
     
-    *output_size = input_size + (input_size / 3) + 128;
-    *output = malloc(*output_size);
-    if (!*output) {
-        lzma_end(&strm);
+    // Kept open (with its mapping) until we exit, see add_archive_contents
+    Archive *core = &sources[source_count];
+    if (!data || archive_open(core, data, size) != 0 || core->kind != ARCHIVE_KIND_CORE) {
+        fprintf(stderr, "Warning: No core archive in %s\n", core_path);
+        if (!file_data) payload_close(&payload);
+        free(file_data);
         return -1;
     }
+    source_count++;
     
-    strm.next_in = (const uint8_t*)input;
-    strm.avail_in = input_size;
-    strm.next_out = (uint8_t*)*output;
-    strm.avail_out = *output_size;
+    // The table of contents lists every path and content hash without
+    // decoding anything
+    printf("Loading core file list from %s (%u files)...\n", core_path, core->file_count);
     
-    ret = lzma_code(&strm, LZMA_FINISH);
-    if (ret != LZMA_STREAM_END) {
-        free(*output);
-        lzma_end(&strm);
+    int ret = add_archive_contents(core);
+    for (uint32_t i = 0; i < core->file_count && ret == 0; i++) {
+        const char *path = archive_path(core, &core->entries[i]);
+        ret = table_insert(&core_paths, path_key(path), path, 0) ? 0 : -1;
+        
+        // A library split into members is still lib/X.a to the addon
+        size_t len = strlen(path), dir_len = strlen(STATICLIB_MEMBER_DIR);
+        size_t index_len = strlen("/" STATICLIB_INDEX_NAME);
+        if (ret == 0 && is_library_member(path) && len > dir_len + index_len &&
+            strcmp(path + len - index_len, "/" STATICLIB_INDEX_NAME) == 0) {
+            char lib_path[4096];
+            snprintf(lib_path, sizeof(lib_path), "lib/%.*s", (int)(len - dir_len - index_len), path + dir_len);
+            ret = table_insert(&core_paths, path_key(lib_path), lib_path, 0) ? 0 : -1;
+        }
+    }
+    if (ret != 0) {
+        fprintf(stderr, "Warning: Out of memory loading core file list\n");
         return -1;
     }
     
-    *output_size = strm.total_out;
-    lzma_end(&strm);
+    printf("Loaded %zu core files for exclusion from addons\n", core_paths.count);
     return 0;
 }
 
-static void scan_and_add_files(const char* dir_path, const char* prefix, FILE* addon, uint32_t* file_count) {
-    DIR* dir = opendir(dir_path);
-    if (!dir) return;
+// --dedup-with: files of an addon loaded before this one may be referenced
+static int load_dedup_addon(const char *path) {
+    size_t size;
+    char *data = read_whole_file(path, &size);
+    if (!data) {
+        fprintf(stderr, "Error: Cannot read addon %s\n", path);
+        return -1;
+    }
+    
+    Archive *addon = &sources[source_count];
+    if (archive_open(addon, data, size) != 0 || addon->kind != ARCHIVE_KIND_ADDON) {
+        fprintf(stderr, "Error: Invalid addon file format: %s\n", path);
+        free(data);
+        return -1;
+    }
+    source_files[source_count++] = path;
+    printf("Deduplicating against addon '%s' (%u files)\n", addon->name, addon->file_count);
+    return add_archive_contents(addon);
+}
+
+static int excluded_count = 0;
+static int link_count = 0;
+static size_t link_bytes = 0;
+
+static int compare_names(const struct dirent **a, const struct dirent **b) {
+    return strcmp((*a)->d_name, (*b)->d_name);
+}
+
+static void scan_and_add_files(const char* dir_path, const char* prefix, ArchiveBuilder* addon) {
+    // Sorted, so the archive does not depend on the filesystem's order
+    struct dirent **names;
+    int name_count = scandir(dir_path, &names, NULL, compare_names);
+    if (name_count < 0) return;
     
-    struct dirent* entry;
-    while ((entry = readdir(dir)) != NULL) {
+    for (int n = 0; n < name_count; n++) {
+        struct dirent *entry = names[n];
         if (entry->d_name[0] == '.') continue;
         
         char full_path[MAX_PATH];
@@ -135,13 +267,14 @@ static void scan_and_add_files(const char* dir_path, const char* prefix, FILE* a
         if (S_ISDIR(st.st_mode)) {
             char new_prefix[MAX_PATH];
             snprintf(new_prefix, sizeof(new_prefix), "%s%s%s", prefix, strlen(prefix) ? "/" : "", entry->d_name);
-            scan_and_add_files(full_path, new_prefix, addon, file_count);
+            scan_and_add_files(full_path, new_prefix, addon);
         } else if (S_ISREG(st.st_mode)) {
             char rel_path[MAX_PATH];
             snprintf(rel_path, sizeof(rel_path), "%s%s%s", prefix, strlen(prefix) ? "/" : "", entry->d_name);
             
-            // Skip core files
-            if (is_core_file(entry->d_name)) {
+            // Skip files the core already provides at the same path
+            if (table_find(&core_paths, path_key(rel_path), rel_path, 0)) {
+                excluded_count++;
                 continue;
             }
             
@@ -170,43 +303,80 @@ static void scan_and_add_files(const char* dir_path, const char* prefix, FILE* a
             }
             fclose(f);
             
-            char* compressed_data;
-            size_t compressed_size;
-            if (lzma_compress_data(file_data, file_size, &compressed_data, &compressed_size) == 0) {
-                uint32_t path_len = strlen(rel_path);
-                uint32_t original_size = file_size;
-                uint32_t comp_size = compressed_size;
-                
-                fwrite(&path_len, sizeof(uint32_t), 1, addon);
-                fwrite(rel_path, 1, path_len, addon);
-                fwrite(&original_size, sizeof(uint32_t), 1, addon);
-                fwrite(&comp_size, sizeof(uint32_t), 1, addon);
-                fwrite(compressed_data, 1, compressed_size, addon);
-                
-                (*file_count)++;
-                printf("  %s (%ld -> %zu bytes, %.1f%%)\n", 
-                       rel_path, file_size, compressed_size, 
-                       (float)compressed_size / file_size * 100);
-                
-                free(compressed_data);
+            // Bytes already present elsewhere in the tree are stored as a
+            // reference to that path
+            uint64_t hash = sscc_hash64(file_data, file_size, SSCC_HASH_INIT);
+            const PathSlot *same = file_size > 0 ? table_find(&contents, hash, NULL, file_size) : NULL;
+            if (same && same_content(same, file_data, file_size)) {
+                if (archive_builder_add_link(addon, rel_path, same->path, file_size, hash) == 0) {
+                    if (same->archive) source_linked[same->archive - sources] = 1;
+                    printf("  %s (%ld bytes, same as %s)\n", rel_path, file_size, same->path);
+                    link_count++;
+                    link_bytes += file_size;
+                }
+                free(file_data);
+                continue;
+            }
+            
+            if (archive_builder_add(addon, rel_path, file_data, file_size) == 0) {
+                if (file_size > 0) content_insert(hash, rel_path, file_size, NULL, 0, full_path);
+                const ArchiveBuildEntry *e = &addon->entries[addon->count - 1];
+                printf("  %s (%ld bytes, %s)\n", rel_path, file_size,
+                       e->codec == ARCHIVE_CODEC_SOLID ? "solid block" : archive_codec_name(e->codec));
             }
             free(file_data);
         }
     }
-    closedir(dir);
+    for (int n = 0; n < name_count; n++) free(names[n]);
+    free(names);
 }
 
 int main(int argc, char* argv[]) {
+    int codec = ARCHIVE_CODEC_LZMA;
+    const char *core_path = NULL;
+    const char *hot_set = NULL;
+    const char *blob_cache = NULL;
+    const char *dedup_with[64];
+    int dedup_count = 0;
+    while (argc > 1 && strncmp(argv[1], "--", 2) == 0) {
+        if (strncmp(argv[1], "--codec=", 8) == 0) {
+            codec = archive_codec_from_name(argv[1] + 8);
+            if (codec < 0 || codec == ARCHIVE_CODEC_LINK) {
+                fprintf(stderr, "Error: Unknown codec '%s' (stored, lz, lzma, solid)\n", argv[1] + 8);
+                return 1;
+            }
+        } else if (strncmp(argv[1], "--core=", 7) == 0) {
+            core_path = argv[1] + 7;
+        } else if (strncmp(argv[1], "--hot-set=", 10) == 0) {
+            hot_set = argv[1] + 10;
+        } else if (strncmp(argv[1], "--blob-cache=", 13) == 0) {
+            blob_cache = argv[1] + 13;
+        } else if (strncmp(argv[1], "--dedup-with=", 13) == 0 &&
+                   dedup_count < (int)(sizeof(dedup_with) / sizeof(dedup_with[0]))) {
+            dedup_with[dedup_count++] = argv[1] + 13;
+        } else {
+            fprintf(stderr, "Error: Unknown option '%s'\n", argv[1]);
+            return 1;
+        }
+        argv++;
+        argc--;
+    }
+    
     if (argc != 6) {
-        fprintf(stderr, "Usage: %s <addon_name> <description> <include_dir> <lib_dir> <output.addon>\n", argv[0]);
-        fprintf(stderr, "Example: %s libextra \"Extended musl libraries\" include lib sscc-libextra.addon\n", argv[0]);
+        fprintf(stderr, "Usage: %s [--codec=stored|lz|lzma|solid] [--core=SSCC] [--dedup-with=ADDON]... [--hot-set=MANIFEST] [--blob-cache=DIR] <addon_name> <description> <include_dir> <lib_dir> <output.addon>\n", argv[0]);
+        fprintf(stderr, "Example: %s --core=sscc libextra \"Extended musl libraries\" include lib sscc-libextra.addon\n", argv[0]);
+        fprintf(stderr, "Files identical to ones in the core or a --dedup-with addon are stored as\n");
+        fprintf(stderr, "references; such addons must be loaded after the addons they reference.\n");
         return 1;
     }
     
-    // Load core files from embedded archive for automatic exclusion
-    if (load_core_files_from_archive() != 0) {
+    // Load core files for automatic exclusion
+    if (load_core_files_from_archive(core_path) != 0) {
         fprintf(stderr, "Warning: Could not load core files list, proceeding with minimal exclusions\n");
     }
+    for (int i = 0; i < dedup_count; i++) {
+        if (load_dedup_addon(dedup_with[i]) != 0) return 1;
+    }
     
     const char* addon_name = argv[1];
     const char* description = argv[2];
@@ -223,46 +393,87 @@ int main(int argc, char* argv[]) {
     printf("Creating addon: %s\n", addon_name);
     printf("Description: %s\n", description);
     
-    // Write magic
-    fwrite("ADDON", 5, 1, addon);
-    
-    // Write addon name
-    uint32_t name_len = strlen(addon_name);
-    fwrite(&name_len, sizeof(uint32_t), 1, addon);
-    fwrite(addon_name, 1, name_len, addon);
-    
-    // Write description
-    uint32_t desc_len = strlen(description);
-    fwrite(&desc_len, sizeof(uint32_t), 1, addon);
-    fwrite(description, 1, desc_len, addon);
-    
-    // Placeholder for file count
-    long count_pos = ftell(addon);
-    uint32_t file_count = 0;
-    fwrite(&file_count, sizeof(uint32_t), 1, addon);
+    ArchiveBuilder builder;
+    archive_builder_init(&builder, ARCHIVE_KIND_ADDON, addon_name, description);
+    builder.codec = codec;
+    builder.blob_cache = blob_cache;
     
     // Add files from include directory
     if (access(include_dir, F_OK) == 0) {
         printf("Adding headers from %s:\n", include_dir);
-        scan_and_add_files(include_dir, "include", addon, &file_count);
+        scan_and_add_files(include_dir, "include", &builder);
     }
     
     // Add files from lib directory
     if (access(lib_dir, F_OK) == 0) {
         printf("Adding libraries from %s:\n", lib_dir);
-        scan_and_add_files(lib_dir, "lib", addon, &file_count);
+        scan_and_add_files(lib_dir, "lib", &builder);
     }
     
-    // Write actual file count
-    fseek(addon, count_pos, SEEK_SET);
-    fwrite(&file_count, sizeof(uint32_t), 1, addon);
+    // Files profiled compiles opened come first (see sscc --sscc-profile)
+    if (hot_set) {
+        int hot = archive_builder_order_hot(&builder, hot_set);
+        if (hot < 0) {
+            fprintf(stderr, "Error: Cannot read hot-set manifest %s\n", hot_set);
+            fclose(addon);
+            return 1;
+        }
+        printf("Hot set: %d of %u files first\n", hot, builder.count);
+    }
+    
+    // Addons carry their own path index (the core's is built by sscc_payload)
+    uint32_t file_count = builder.count;
+    if (archive_builder_write(&builder, addon, 1) != 0) {
+        fprintf(stderr, "Error: Cannot write addon file\n");
+        fclose(addon);
+        return 1;
+    }
+    if (blob_cache) {
+        printf("Blobs: %u compressed, %u reused from %s\n", builder.blob_count - builder.blobs_reused,
+               builder.blobs_reused, blob_cache);
+    }
+    archive_builder_free(&builder);
     
     fclose(addon);
     
+    // What the addon provides, so sscc activates it without opening it
+    size_t addon_size;
+    char *addon_data = read_whole_file(output_file, &addon_size);
+    char manifest_path[MAX_PATH + 16];
+    snprintf(manifest_path, sizeof(manifest_path), "%s.manifest", output_file);
+    Archive written;
+    FILE *manifest = NULL;
+    if (!addon_data || archive_open(&written, addon_data, addon_size) != 0) {
+        fprintf(stderr, "Error: Cannot read back %s\n", output_file);
+        free(addon_data);
+        return 1;
+    }
+    
+    // Addons this one links into are named so sscc activates them with it
+    const char *needs[64];
+    int need_count = 0;
+    for (int i = 0; i < source_count; i++) {
+        if (!source_files[i] || !source_linked[i]) continue;
+        const char *slash = strrchr(source_files[i], '/');
+        needs[need_count++] = slash ? slash + 1 : source_files[i];
+    }
+    if (!(manifest = fopen(manifest_path, "w")) ||
+        archive_write_manifest(&written, needs, need_count, manifest) != 0 ||
+        fclose(manifest) != 0) {
+        fprintf(stderr, "Error: Cannot write %s\n", manifest_path);
+        archive_close(&written);
+        free(addon_data);
+        return 1;
+    }
+    archive_close(&written);
+    free(addon_data);
+    
     struct stat st;
     stat(output_file, &st);
     printf("\nAddon created: %u files, %ld bytes\n", file_count, st.st_size);
-    printf("File: %s\n", output_file);
+    printf("Excluded %d core files, %d files stored as references (%zu bytes)\n",
+           excluded_count, link_count, link_bytes);
+    printf("File: %s (manifest: %s)\n", output_file, manifest_path);
     
     return 0;
 }
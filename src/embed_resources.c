@@ -7,9 +7,15 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <stdint.h>
-#include <lzma.h>
+#include <time.h>
+#include "archive.h"
+#include "staticlib.h"
 
 #define MAX_PATH 4096
+#define REPORT_ROUNDS 5
+
+static int verbose = 1;   // per-file lines, off while building report tiers
+static const char *blob_cache;   // --blob-cache: blobs reused across builds
 
 // Include ALL musl headers (no filtering)
 // const char* core_includes[] = { NULL }; // Not used - include everything
@@ -19,52 +25,63 @@
 
 // const char* core_objects[] = { NULL }; // Not used - include everything
 
-static int lzma_compress_data(const char *input, size_t input_size, char **output, size_t *output_size) {
-    lzma_stream strm = LZMA_STREAM_INIT;
-    
-    // Initialize with maximum compression
-    lzma_ret ret = lzma_easy_encoder(&strm, 9, LZMA_CHECK_CRC64);
-    if (ret != LZMA_OK) return -1;
+static int should_include_file(const char* path) {
+    // Include ALL headers and libraries - no filtering for complete musl functionality
+    if (strstr(path, "include/") || strstr(path, "lib/")) {
+        return 1; // Include everything
+    }
     
-    *output_size = input_size + (input_size / 3) + 128; // Buffer
-    *output = malloc(*output_size);
-    if (!*output) {
-        lzma_end(&strm);
+    return 0;
+}
+
+// Stores lib/X.a as its index plus one entry per member (see staticlib.h),
+// so sscc decodes only the members a program links. Members are compressed
+// one by one, never into solid blocks, to decode on their own. Returns -1
+// for archives that are not split (thin, BSD or with non-ELF64 members).
+static int add_static_library(ArchiveBuilder *archive, const char *rel_path,
+                              const unsigned char *data, size_t size) {
+    ArMember *members;
+    uint32_t count;
+    unsigned char *index;
+    size_t index_size;
+    if (strncmp(rel_path, "lib/", 4) != 0 || ar_parse(data, size, &members, &count) != 0) return -1;
+    if (staticlib_build_index(members, count, &index, &index_size) != 0) {
+        free(members);
         return -1;
     }
     
-    strm.next_in = (const uint8_t*)input;
-    strm.avail_in = input_size;
-    strm.next_out = (uint8_t*)*output;
-    strm.avail_out = *output_size;
-    
-    ret = lzma_code(&strm, LZMA_FINISH);
-    if (ret != LZMA_STREAM_END) {
-        free(*output);
-        lzma_end(&strm);
-        return -1;
+    int codec = archive->codec;
+    if (codec == ARCHIVE_CODEC_SOLID) archive->codec = ARCHIVE_CODEC_LZMA;
+    char path[MAX_PATH + 32];
+    snprintf(path, sizeof(path), "%s%s/%s", STATICLIB_MEMBER_DIR, rel_path + 4, STATICLIB_INDEX_NAME);
+    int ret = archive_builder_add(archive, path, index, index_size);
+    for (uint32_t i = 0; i < count && ret == 0; i++) {
+        snprintf(path, sizeof(path), "%s%s/%u", STATICLIB_MEMBER_DIR, rel_path + 4, i);
+        ret = archive_builder_add(archive, path, members[i].data, members[i].size);
     }
+    archive->codec = codec;
     
-    *output_size = strm.total_out;
-    lzma_end(&strm);
-    return 0;
+    if (ret == 0 && verbose) {
+        printf("Core: %s (%zu bytes, %u members + %zu byte index, split)\n",
+               rel_path, size, count, index_size);
+    }
+    free(index);
+    free(members);
+    return ret;
 }
 
-static int should_include_file(const char* path) {
-    // Include ALL headers and libraries - no filtering for complete musl functionality
-    if (strstr(path, "include/") || strstr(path, "lib/")) {
-        return 1; // Include everything
-    }
-    
-    return 0;
+static int compare_names(const struct dirent **a, const struct dirent **b) {
+    return strcmp((*a)->d_name, (*b)->d_name);
 }
 
-static void scan_directory(const char* dir_path, const char* prefix, FILE* archive, uint32_t* file_count) {
-    DIR* dir = opendir(dir_path);
-    if (!dir) return;
+static void scan_directory(const char* dir_path, const char* prefix, ArchiveBuilder* archive) {
+    // Sorted, so the archive does not depend on the filesystem's order
+    struct dirent **names;
+    int name_count = scandir(dir_path, &names, NULL, compare_names);
+    if (name_count < 0) return;
     
-    struct dirent* entry;
-    while ((entry = readdir(dir)) != NULL) {
+    for (int n = 0; n < name_count; n++) {
+        struct dirent *entry = names[n];
         if (entry->d_name[0] == '.') continue;
         
         char full_path[MAX_PATH];
@@ -76,7 +93,7 @@ static void scan_directory(const char* dir_path, const char* prefix, FILE* archi
         if (S_ISDIR(st.st_mode)) {
             char new_prefix[MAX_PATH];
             snprintf(new_prefix, sizeof(new_prefix), "%s%s%s", prefix, strlen(prefix) ? "/" : "", entry->d_name);
-            scan_directory(full_path, new_prefix, archive, file_count);
+            scan_directory(full_path, new_prefix, archive);
         } else if (S_ISREG(st.st_mode)) {
             char rel_path[MAX_PATH];
             snprintf(rel_path, sizeof(rel_path), "%s%s%s", prefix, strlen(prefix) ? "/" : "", entry->d_name);
@@ -90,7 +107,10 @@ static void scan_directory(const char* dir_path, const char* prefix, FILE* archi
             long file_size = ftell(f);
             fseek(f, 0, SEEK_SET);
             
-            if (file_size > 512*1024) { // Skip files larger than 512KB
+            // Skip files larger than 512KB, except static libraries stored as
+            // members (checked once the file is read)
+            int is_library = file_size > 8 && strcmp(rel_path + strlen(rel_path) - 2, ".a") == 0;
+            if (file_size > 512*1024 && !is_library) {
                 fclose(f);
                 continue;
             }
@@ -109,35 +129,133 @@ static void scan_directory(const char* dir_path, const char* prefix, FILE* archi
             }
             fclose(f);
             
-            char* compressed_data;
-            size_t compressed_size;
-            if (lzma_compress_data(file_data, file_size, &compressed_data, &compressed_size) == 0) {
-                uint32_t path_len = strlen(rel_path);
-                uint32_t original_size = file_size;
-                uint32_t comp_size = compressed_size;
-                
-                fwrite(&path_len, sizeof(uint32_t), 1, archive);
-                fwrite(rel_path, 1, path_len, archive);
-                fwrite(&original_size, sizeof(uint32_t), 1, archive);
-                fwrite(&comp_size, sizeof(uint32_t), 1, archive);
-                fwrite(compressed_data, 1, compressed_size, archive);
-                
-                (*file_count)++;
-                printf("Core: %s (%ld -> %zu bytes, %.1f%%)\n", 
-                       rel_path, file_size, compressed_size, 
-                       (float)compressed_size / file_size * 100);
-                
-                free(compressed_data);
+            if (is_library && add_static_library(archive, rel_path, (unsigned char*)file_data, file_size) == 0) {
+                free(file_data);
+                continue;
+            }
+            if (file_size > 512*1024) {
+                free(file_data);
+                continue;
+            }
+            
+            if (archive_builder_add(archive, rel_path, file_data, file_size) == 0) {
+                const ArchiveBuildEntry *e = &archive->entries[archive->count - 1];
+                if (verbose) {
+                    printf("Core: %s (%ld bytes, %s)\n", rel_path, file_size,
+                           e->codec == ARCHIVE_CODEC_SOLID ? "solid block" : archive_codec_name(e->codec));
+                }
+            } else {
+                fprintf(stderr, "Warning: Could not add %s\n", full_path);
             }
             free(file_data);
         }
     }
-    closedir(dir);
+    for (int n = 0; n < name_count; n++) free(names[n]);
+    free(names);
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Build the core with every codec tier in memory and compare archive size
+// against the time to decode all of it on one thread
+static int report_tiers(const char *include_dir, const char *lib_dir) {
+    static const int tiers[] = { ARCHIVE_CODEC_STORED, ARCHIVE_CODEC_LZ, ARCHIVE_CODEC_LZMA, ARCHIVE_CODEC_SOLID };
+    
+    verbose = 0;
+    printf("Codec tiers for the core archive (decode: one thread, best of %d):\n", REPORT_ROUNDS);
+    printf("  %-8s %12s %8s %12s\n", "codec", "bytes", "ratio", "decode ms");
+    
+    for (size_t t = 0; t < sizeof(tiers) / sizeof(tiers[0]); t++) {
+        ArchiveBuilder builder;
+        archive_builder_init(&builder, ARCHIVE_KIND_CORE, "musl", "Complete C standard library");
+        builder.codec = tiers[t];
+        builder.blob_cache = blob_cache;
+        scan_directory(include_dir, "include", &builder);
+        scan_directory(lib_dir, "lib", &builder);
+        
+        char *data = NULL;
+        size_t size = 0;
+        FILE *mem = open_memstream(&data, &size);
+        if (!mem || archive_builder_write(&builder, mem, 0) != 0) {
+            fprintf(stderr, "Error: Cannot build %s archive\n", archive_codec_name(tiers[t]));
+            if (mem) fclose(mem);
+            free(data);
+            archive_builder_free(&builder);
+            return 1;
+        }
+        fclose(mem);
+        archive_builder_free(&builder);
+        
+        Archive archive;
+        if (archive_open(&archive, data, size) != 0 || archive_verify(&archive) != 0) {
+            fprintf(stderr, "Error: Cannot read back %s archive\n", archive_codec_name(tiers[t]));
+            free(data);
+            return 1;
+        }
+        
+        size_t original = 0;
+        double best = 0;
+        for (int round = 0; round < REPORT_ROUNDS; round++) {
+            double start = now_ms();
+            original = 0;
+            for (uint32_t i = 0; i < archive.file_count; ) {
+                size_t unit_size;
+                uint32_t end = archive_unit_end(&archive, i, &unit_size);
+                char *out = malloc(unit_size ? unit_size : 1);
+                if (!out || archive_decode_unit(&archive, i, out, unit_size) != 0) {
+                    fprintf(stderr, "Error: Cannot decode %s\n", archive_path(&archive, &archive.entries[i]));
+                    free(out);
+                    archive_close(&archive);
+                    free(data);
+                    return 1;
+                }
+                free(out);
+                for (; i < end; i++) original += archive.entries[i].original_size;
+            }
+            double ms = now_ms() - start;
+            if (round == 0 || ms < best) best = ms;
+        }
+        
+        printf("  %-8s %12zu %7.1f%% %12.2f\n", archive_codec_name(tiers[t]), size,
+               original ? (double)size / original * 100 : 0, best);
+        archive_close(&archive);
+        free(data);
+    }
+    return 0;
 }
 
 int main(int argc, char* argv[]) {
+    int codec = ARCHIVE_CODEC_LZMA;
+    const char *hot_set = NULL;
+    
+    // Options come before the positional arguments
+    while (argc > 1 && strncmp(argv[1], "--", 2) == 0) {
+        if (strncmp(argv[1], "--codec=", 8) == 0) {
+            codec = archive_codec_from_name(argv[1] + 8);
+            if (codec < 0) {
+                fprintf(stderr, "Error: Unknown codec '%s' (stored, lz, lzma, solid)\n", argv[1] + 8);
+                return 1;
+            }
+        } else if (strncmp(argv[1], "--hot-set=", 10) == 0) {
+            hot_set = argv[1] + 10;
+        } else if (strncmp(argv[1], "--blob-cache=", 13) == 0) {
+            blob_cache = argv[1] + 13;
+        } else if (strcmp(argv[1], "--report") == 0 && argc == 4) {
+            return report_tiers(argv[2], argv[3]);
+        } else {
+            break;
+        }
+        argv++;
+        argc--;
+    }
+    
     if (argc != 4) {
-        fprintf(stderr, "Usage: %s <include_dir> <lib_dir> <output_file>\n", argv[0]);
+        fprintf(stderr, "Usage: %s [--codec=stored|lz|lzma|solid] [--hot-set=MANIFEST] [--blob-cache=DIR] <include_dir> <lib_dir> <output_file>\n", argv[0]);
+        fprintf(stderr, "       %s [--blob-cache=DIR] --report <include_dir> <lib_dir>\n", argv[0]);
         return 1;
     }
     
@@ -147,22 +265,41 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
-    // Write magic
-    fwrite("CORE", 4, 1, archive);
+    ArchiveBuilder builder;
+    archive_builder_init(&builder, ARCHIVE_KIND_CORE, "musl", "Complete C standard library");
+    builder.codec = codec;
+    builder.blob_cache = blob_cache;
     
-    // Placeholder for file count
-    long count_pos = ftell(archive);
-    uint32_t file_count = 0;
-    fwrite(&file_count, sizeof(uint32_t), 1, archive);
+    printf("Creating complete musl core archive with all headers and libraries (%s)...\n",
+           archive_codec_name(codec));
     
-    printf("Creating complete musl core archive with all headers and libraries...\n");
+    scan_directory(argv[1], "include", &builder);
+    scan_directory(argv[2], "lib", &builder);
     
-    scan_directory(argv[1], "include", archive, &file_count);
-    scan_directory(argv[2], "lib", archive, &file_count);
+    // Files most compiles open go first, so sscc can start compiling as
+    // soon as they are extracted (see --sscc-profile)
+    if (hot_set) {
+        int hot = archive_builder_order_hot(&builder, hot_set);
+        if (hot < 0) {
+            fprintf(stderr, "Error: Cannot read hot-set manifest %s\n", hot_set);
+            fclose(archive);
+            return 1;
+        }
+        printf("Hot set: %d of %u files first\n", hot, builder.count);
+    }
     
-    // Write actual file count
-    fseek(archive, count_pos, SEEK_SET);
-    fwrite(&file_count, sizeof(uint32_t), 1, archive);
+    // The path index is generated from this file by sscc_payload
+    uint32_t file_count = builder.count;
+    if (archive_builder_write(&builder, archive, 0) != 0) {
+        fprintf(stderr, "Error: Cannot write core archive\n");
+        fclose(archive);
+        return 1;
+    }
+    if (blob_cache) {
+        printf("Blobs: %u compressed, %u reused from %s\n", builder.blob_count - builder.blobs_reused,
+               builder.blobs_reused, blob_cache);
+    }
+    archive_builder_free(&builder);
     
     fclose(archive);
     
@@ -0,0 +1,27 @@
+// Content hashing shared by the SSCC build tools and runtime
+#ifndef SSCC_HASH_H
+#define SSCC_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 64-bit FNV-1a. Hashes can be chained by passing the previous result as
+// the seed, which is how multi-part keys (core + tcc + addons) are built.
+#define SSCC_HASH_INIT 0xcbf29ce484222325ULL
+#define SSCC_HASH_PRIME 0x100000001b3ULL
+
+static inline uint64_t sscc_hash64(const void *data, size_t size, uint64_t seed) {
+    const unsigned char *p = (const unsigned char*)data;
+    uint64_t h = seed;
+    for (size_t i = 0; i < size; i++) {
+        h ^= p[i];
+        h *= SSCC_HASH_PRIME;
+    }
+    return h;
+}
+
+static inline uint64_t sscc_hash_u64(uint64_t value, uint64_t seed) {
+    return sscc_hash64(&value, sizeof(value), seed);
+}
+
+#endif
@@ -0,0 +1,74 @@
+// Payload trailer reader (see payload.h for the layout)
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "payload.h"
+
+static int section_ok(const PayloadTrailer *t, uint64_t offset, uint64_t size, uint64_t end) {
+    return offset >= t->image_size && offset <= end && size <= end - offset;
+}
+
+int payload_read_trailer(int fd, PayloadTrailer *t) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(*t)) return -1;
+    
+    uint64_t end = st.st_size - sizeof(*t);
+    if (pread(fd, t, sizeof(*t), end) != (ssize_t)sizeof(*t) ||
+        memcmp(t->magic, PAYLOAD_MAGIC, sizeof(t->magic)) != 0) {
+        return -1;
+    }
+    if (t->image_size > end || t->core_offset % PAYLOAD_ALIGN || t->tcc_offset % PAYLOAD_ALIGN ||
+        t->index_offset % sizeof(uint32_t) || t->index_size > UINT32_MAX ||
+        t->index_offset < t->core_offset || t->tcc_offset < t->core_offset ||
+        !section_ok(t, t->core_offset, t->core_size, end) ||
+        !section_ok(t, t->index_offset, t->index_size * sizeof(uint32_t), end) ||
+        !section_ok(t, t->tcc_offset, t->tcc_size, end)) {
+        return -1;
+    }
+    return 0;
+}
+
+int payload_open(Payload *p, const char *path) {
+    memset(p, 0, sizeof(*p));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    
+    PayloadTrailer *t = &p->trailer;
+    if (payload_read_trailer(fd, t) != 0) {
+        close(fd);
+        return -1;
+    }
+    
+    // One mapping from the core (the first section) to the trailer
+    uint64_t start = t->core_offset;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+    p->map_size = st.st_size - start;
+    p->map = mmap(NULL, p->map_size, PROT_READ, MAP_PRIVATE, fd, start);
+    close(fd);
+    if (p->map == MAP_FAILED) {
+        p->map = NULL;
+        return -1;
+    }
+    
+    const unsigned char *base = (const unsigned char*)p->map - start;
+    p->core = base + t->core_offset;
+    p->core_size = t->core_size;
+    p->core_hash = t->core_hash;
+    p->index = t->index_size ? (const uint32_t*)(base + t->index_offset) : NULL;
+    p->index_size = t->index_size;
+    p->tcc = base + t->tcc_offset;
+    p->tcc_size = t->tcc_size;
+    p->tcc_hash = t->tcc_hash;
+    return 0;
+}
+
+void payload_close(Payload *p) {
+    if (p->map) munmap(p->map, p->map_size);
+    memset(p, 0, sizeof(*p));
+}
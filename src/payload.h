@@ -0,0 +1,57 @@
+// Payload trailer: the core archive, its path index and the TCC binary are
+// appended to the sscc executable (by sscc_payload) and mapped at runtime
+#ifndef SSCC_PAYLOAD_H
+#define SSCC_PAYLOAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Layout, from the start of the file:
+//   executable image               as linked, image_size bytes
+//   core archive                   page-aligned
+//   u32 index[index_size]          perfect-hash path index of the core
+//   TCC binary                     page-aligned
+//   PayloadTrailer                 last bytes of the file
+//
+// Sections start on page boundaries so the whole payload is one read-only
+// mapping and entries are decoded straight from the page cache. Replacing
+// the payload only rewrites what follows image_size.
+#define PAYLOAD_MAGIC "SSCCPAY1"
+#define PAYLOAD_ALIGN 4096
+
+typedef struct {
+    uint64_t image_size;        // executable size without the payload
+    uint64_t core_offset;
+    uint64_t core_size;
+    uint64_t core_hash;         // sscc_hash64 of the core archive
+    uint64_t index_offset;
+    uint64_t index_size;        // in u32 words, 0 if the core has no index
+    uint64_t tcc_offset;
+    uint64_t tcc_size;
+    uint64_t tcc_hash;          // sscc_hash64 of the TCC binary
+    char magic[8];
+} PayloadTrailer;
+
+typedef struct {
+    const unsigned char *core;
+    size_t core_size;
+    uint64_t core_hash;
+    const uint32_t *index;
+    uint32_t index_size;
+    const unsigned char *tcc;
+    size_t tcc_size;
+    uint64_t tcc_hash;
+    PayloadTrailer trailer;
+    void *map;
+    size_t map_size;
+} Payload;
+
+// Reads and checks the trailer of an open file. Returns 0 if the file
+// carries a payload whose sections all lie inside it.
+int payload_read_trailer(int fd, PayloadTrailer *t);
+
+// Maps the payload of the executable at path. Returns -1 if there is none.
+int payload_open(Payload *p, const char *path);
+void payload_close(Payload *p);
+
+#endif
@@ -0,0 +1,173 @@
+// Work-stealing thread pool (see pool.h)
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "pool.h"
+
+// Each worker owns a queue dealt round-robin from the priority order, so
+// every queue is itself largest-first. Owners take from the front; idle
+// workers steal from the back of other queues, which holds the small items
+// that are cheapest to rebalance near the end.
+typedef struct {
+    pthread_mutex_t lock;
+    uint32_t *items;
+    uint32_t head;
+    uint32_t tail;
+} PoolQueue;
+
+typedef struct {
+    PoolQueue *queues;
+    int threads;
+    PoolTask task;
+    void *ctx;
+    pthread_mutex_t error_lock;
+    int failed;
+    int failed_ret;
+    uint32_t failed_item;
+} Pool;
+
+typedef struct {
+    Pool *pool;
+    int id;
+} PoolWorker;
+
+static int pool_take(Pool *p, int self, uint32_t *item) {
+    PoolQueue *q = &p->queues[self];
+    pthread_mutex_lock(&q->lock);
+    if (q->head < q->tail) {
+        *item = q->items[q->head++];
+        pthread_mutex_unlock(&q->lock);
+        return 1;
+    }
+    pthread_mutex_unlock(&q->lock);
+    
+    for (int v = 1; v < p->threads; v++) {
+        PoolQueue *victim = &p->queues[(self + v) % p->threads];
+        pthread_mutex_lock(&victim->lock);
+        if (victim->head < victim->tail) {
+            *item = victim->items[--victim->tail];
+            pthread_mutex_unlock(&victim->lock);
+            return 1;
+        }
+        pthread_mutex_unlock(&victim->lock);
+    }
+    return 0;
+}
+
+static void pool_record(Pool *p, uint32_t item, int ret) {
+    pthread_mutex_lock(&p->error_lock);
+    if (!p->failed || item < p->failed_item) {
+        p->failed = 1;
+        p->failed_item = item;
+        p->failed_ret = ret;
+    }
+    pthread_mutex_unlock(&p->error_lock);
+}
+
+static void *pool_worker(void *arg) {
+    PoolWorker *w = arg;
+    uint32_t item;
+    while (pool_take(w->pool, w->id, &item)) {
+        int ret = w->pool->task(w->pool->ctx, item);
+        if (ret != 0) {
+            pool_record(w->pool, item, ret);
+        }
+    }
+    return NULL;
+}
+
+int pool_default_threads(void) {
+    const char *env = getenv("SSCC_THREADS");
+    if (env && atoi(env) > 0) {
+        return atoi(env);
+    }
+    
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int)cpus : 1;
+}
+
+static const uint32_t *sort_sizes;
+
+static int compare_by_size(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    if (sort_sizes[x] != sort_sizes[y]) return sort_sizes[x] < sort_sizes[y] ? 1 : -1;
+    return x < y ? -1 : (x > y);
+}
+
+void pool_order_by_size(uint32_t *order, const uint32_t *sizes, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) order[i] = i;
+    sort_sizes = sizes;
+    qsort(order, count, sizeof(uint32_t), compare_by_size);
+    sort_sizes = NULL;
+}
+
+int pool_run(uint32_t count, const uint32_t *order, int threads,
+             PoolTask task, void *ctx, uint32_t *failed_item) {
+    if (threads < 1) threads = 1;
+    if ((uint32_t)threads > count) threads = count ? (int)count : 1;
+    
+    Pool p;
+    memset(&p, 0, sizeof(p));
+    p.threads = threads;
+    p.task = task;
+    p.ctx = ctx;
+    pthread_mutex_init(&p.error_lock, NULL);
+    
+    p.queues = calloc(threads, sizeof(PoolQueue));
+    uint32_t *items = malloc((count + 1) * sizeof(uint32_t));
+    PoolWorker *workers = calloc(threads, sizeof(PoolWorker));
+    pthread_t *tids = calloc(threads, sizeof(pthread_t));
+    if (!p.queues || !items || !workers || !tids) {
+        free(p.queues);
+        free(items);
+        free(workers);
+        free(tids);
+        return -1;
+    }
+    
+    // Deal the priority order round-robin into contiguous per-worker slices
+    uint32_t offset = 0;
+    for (int w = 0; w < threads; w++) {
+        PoolQueue *q = &p.queues[w];
+        pthread_mutex_init(&q->lock, NULL);
+        q->items = items + offset;
+        for (uint32_t k = w; k < count; k += threads) {
+            q->items[q->tail++] = order ? order[k] : k;
+        }
+        offset += q->tail;
+    }
+    
+    // The calling thread is worker 0; if a thread cannot be created its
+    // queue is simply drained by the others
+    for (int w = 0; w < threads; w++) {
+        workers[w].pool = &p;
+        workers[w].id = w;
+    }
+    int *started = calloc(threads, sizeof(int));
+    for (int w = 1; w < threads; w++) {
+        if (started && pthread_create(&tids[w], NULL, pool_worker, &workers[w]) == 0) {
+            started[w] = 1;
+        }
+    }
+    pool_worker(&workers[0]);
+    for (int w = 1; w < threads; w++) {
+        if (started && started[w]) pthread_join(tids[w], NULL);
+    }
+    free(started);
+    
+    for (int w = 0; w < threads; w++) {
+        pthread_mutex_destroy(&p.queues[w].lock);
+    }
+    pthread_mutex_destroy(&p.error_lock);
+    free(p.queues);
+    free(items);
+    free(workers);
+    free(tids);
+    
+    if (p.failed) {
+        if (failed_item) *failed_item = p.failed_item;
+        return p.failed_ret;
+    }
+    return 0;
+}
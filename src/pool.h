@@ -0,0 +1,23 @@
+// Work-stealing thread pool for independent archive entries
+#ifndef SSCC_POOL_H
+#define SSCC_POOL_H
+
+#include <stdint.h>
+
+// Runs task(ctx, item) for item = 0..count-1. Items are handed out in the
+// order given by `order` (typically largest first); NULL means 0..count-1.
+// Returns 0 if every task succeeded. Otherwise every task still runs and the
+// lowest failing item is reported through *failed_item with its return code
+// returned, so error reporting does not depend on thread scheduling.
+typedef int (*PoolTask)(void *ctx, uint32_t item);
+
+int pool_run(uint32_t count, const uint32_t *order, int threads,
+             PoolTask task, void *ctx, uint32_t *failed_item);
+
+// Thread count from SSCC_THREADS, or the number of online CPUs
+int pool_default_threads(void);
+
+// Sort helper: fills order[] with 0..count-1 by descending size
+void pool_order_by_size(uint32_t *order, const uint32_t *sizes, uint32_t count);
+
+#endif
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
@@ -12,8 +13,32 @@
 #include <glob.h>
 #include <lzma.h>
 #include <fcntl.h>
+#include <dirent.h>
+#include <ftw.h>
+#include <time.h>
+#include <sys/file.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mount.h>
+#include <sched.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+#include "archive.h"
+#include "hash.h"
+#include "pool.h"
+#include "trace.h"
+#include "payload.h"
+#include "staticlib.h"
+#include "batch.h"
+#ifdef SSCC_USE_LIBTCC
+#include "libtcc.h"
+#endif
 
 #define MAX_PATH 4096
+#define MAX_MEMFD_FILES 1024
+#define SERVER_DEFAULT_IDLE 600     // seconds before an unused server exits
 #define TEMP_DIR_TEMPLATE "/tmp/sscc_XXXXXX"
 #define RAM_FS_TEMPLATE "/tmp/sscc_ram_XXXXXX"
 
@@ -25,7 +50,20 @@
 // Global variables for RAM usage tracking
 static size_t total_ram_used = 0;
 static int use_ram_filesystem = 1;  // Try RAM filesystem first
-static int ram_method = 0;  // 0=failed, 1=memfd, 2=shm, 3=disk
+static int ram_method = 0;  // 0=failed, 1=memfd, 2=shm, 3=disk, 4=cache, 5=private tmpfs
+static int use_namespace = 1;     // Try a private tmpfs before memfd/shm/disk
+static int tmpfs_root_fd = -1;    // Root of the private tmpfs (ram_method 5)
+static int use_cache = 1;   // Reuse a persistent extracted tree when possible
+static int decode_threads = 0;  // 0 = SSCC_THREADS or the CPU count
+static int use_header_cache = 1;  // Reuse preprocessed preambles (cached trees only)
+static int use_object_cache = 1;  // Reuse objects and executables by content hash
+static uint64_t core_key = 0;     // compute_cache_key() of this run, 0 if unknown
+static int use_lazy = 1;          // Extract only the core's hot set before compiling
+static const char *profile_path = NULL;  // --sscc-profile: record the files compiles open
+
+// Core archive, its path index and the TCC binary, mapped from the trailer
+// of our own executable by load_payload() (see payload.h)
+static Payload payload;
 
 // Check if memfd_create is available
 static int try_memfd_create() {
@@ -69,17 +107,140 @@ static int create_memfd_directory(char *temp_dir) {
         return -1;  // memfd not available
     }
     
-    // Create a regular directory for the symlink structure
-    snprintf(temp_dir, MAX_PATH, "/tmp/sscc_memfd_%d", getpid());
-    if (mkdir(temp_dir, 0755) != 0) {
+    // The directory only holds symlinks to the memfds, so prefer a tmpfs
+    // (/dev/shm, then the per-user runtime dir) and never put file data in it
+    const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+    const char *bases[] = { "/dev/shm", runtime_dir, "/tmp" };
+    int created = 0;
+    for (size_t i = 0; i < sizeof(bases) / sizeof(bases[0]) && !created; i++) {
+        if (!bases[i] || !*bases[i] || access(bases[i], W_OK) != 0) continue;
+        snprintf(temp_dir, MAX_PATH, "%s/sscc_memfd_%d", bases[i], getpid());
+        created = mkdir(temp_dir, 0755) == 0;
+    }
+    if (!created) {
         return -1;
     }
     
+    // Every extracted file holds a descriptor until the compiler exits
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < MAX_MEMFD_FILES + 64) {
+        rl.rlim_cur = rl.rlim_max < MAX_MEMFD_FILES + 64 ? rl.rlim_max : MAX_MEMFD_FILES + 64;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+    
     printf("Created memory filesystem using memfd_create: %s\n", temp_dir);
     ram_method = 1;
     return 0;
 }
 
+static int write_proc_file(const char *path, const char *text) {
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ssize_t len = (ssize_t)strlen(text);
+    int ok = write(fd, text, len) == len;
+    close(fd);
+    return ok ? 0 : -1;
+}
+
+// Helper child: enter a mount namespace of its own (inside a new user
+// namespace unless we are root), mount a tmpfs over /tmp there and send its
+// root directory back. Exits with 1 if any step is not permitted.
+static void mount_private_tmpfs(int sock) {
+    uid_t uid = geteuid();
+    gid_t gid = getegid();
+    if (unshare(uid == 0 ? CLONE_NEWNS : CLONE_NEWUSER | CLONE_NEWNS) != 0) _exit(1);
+    if (uid != 0) {
+        char map[64];
+        write_proc_file("/proc/self/setgroups", "deny");
+        snprintf(map, sizeof(map), "%u %u 1", (unsigned)uid, (unsigned)uid);
+        if (write_proc_file("/proc/self/uid_map", map) != 0) _exit(1);
+        snprintf(map, sizeof(map), "%u %u 1", (unsigned)gid, (unsigned)gid);
+        if (write_proc_file("/proc/self/gid_map", map) != 0) _exit(1);
+    }
+    mount(NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL);
+    if (mount("sscc", "/tmp", "tmpfs", MS_NOSUID | MS_NODEV, "mode=0700") != 0) _exit(1);
+    int root = open("/tmp", O_RDONLY | O_DIRECTORY);
+    if (root < 0) _exit(1);
+    umount2("/tmp", MNT_DETACH);
+    
+    char byte = 0;
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+    struct iovec iov = { &byte, 1 };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &root, sizeof(int));
+    _exit(sendmsg(sock, &msg, MSG_NOSIGNAL) == 1 ? 0 : 1);
+}
+
+// Private tmpfs that nobody else can see and that needs no teardown: the
+// mount is already detached when we receive it, so the kernel frees the
+// whole tree once the last descriptor to its root is closed, even if we are
+// killed. We stay in our own namespaces; only the helper child changes them.
+// The tree is addressed as /proc/self/fd/N, which every process we fork or
+// exec inherits unchanged.
+static int create_namespace_directory(char *temp_dir) {
+#ifdef __linux__
+    if (!use_namespace) return -1;
+    
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0) return -1;
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(sv[0]);
+        mount_private_tmpfs(sv[1]);
+    }
+    close(sv[1]);
+    if (pid < 0) {
+        close(sv[0]);
+        return -1;
+    }
+    
+    // Not close-on-exec: tcc must resolve /proc/self/fd/N to the same tree
+    int root = -1;
+    char byte;
+    char control[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = { &byte, 1 };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(sv[0], &msg, 0) == 1) {
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+            cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+            memcpy(&root, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+    close(sv[0]);
+    waitpid(pid, NULL, 0);
+    if (root < 0) {
+        return -1;
+    }
+    
+    tmpfs_root_fd = root;
+    snprintf(temp_dir, MAX_PATH, "/proc/self/fd/%d", root);
+    printf("Created private tmpfs in a mount namespace: %s\n", temp_dir);
+    ram_method = 5;
+    return 0;
+#else
+    (void)temp_dir;
+    return -1;
+#endif
+}
+
 static int create_shm_directory(char *temp_dir) {
     // Try /dev/shm first (most systems have this as tmpfs)
     if (access("/dev/shm", W_OK) == 0) {
@@ -107,7 +268,12 @@ static int create_disk_directory(char *temp_dir) {
 }
 
 static int create_ram_filesystem(char *temp_dir) {
-    // Priority order: memfd > /dev/shm > disk
+    // Priority order: private tmpfs > memfd > /dev/shm > disk
+    
+    // 0. Private tmpfs via user + mount namespaces (nothing to clean up)
+    if (create_namespace_directory(temp_dir) == 0) {
+        return 0;
+    }
     
     // 1. Try memfd_create() first (pure memory, no sudo needed)
     if (create_memfd_directory(temp_dir) == 0) {
@@ -131,7 +297,10 @@ static int create_ram_filesystem(char *temp_dir) {
 static int create_temp_directory(char *temp_dir) {
     if (use_ram_filesystem) {
         // Try RAM filesystem first
-        if (create_ram_filesystem(temp_dir) == 0) {
+        uint64_t start = trace_now();
+        int created = create_ram_filesystem(temp_dir);
+        trace_span("create_ram_filesystem", start, temp_dir);
+        if (created == 0) {
             return 0;
         }
         // If RAM filesystem failed, we already have a directory created
@@ -152,50 +321,74 @@ static int create_temp_directory(char *temp_dir) {
 }
 
 // Memory file support for memfd_create
-#define MAX_MEMFD_FILES 1024
 
 typedef struct {
     char name[MAX_PATH];
     int fd;
     size_t size;
     int used;
+    int linked;                 // symlink created in the extraction tree
 } MemfdFile;
 
 static MemfdFile memfd_files[MAX_MEMFD_FILES];
 static int memfd_count = 0;
+static pthread_mutex_t memfd_lock = PTHREAD_MUTEX_INITIALIZER;
 
-static int create_memfd_file(const char *relative_path, const void *data, size_t size) {
-    if (memfd_count >= MAX_MEMFD_FILES || ram_method != 1) {
-        return -1;  // Not using memfd or too many files
-    }
-    
 #ifdef __linux__
-    // Create memory-backed file
+// Entries are decoded on several threads, so only the slot is reserved
+// under the lock; it stays unused until memfd_publish fills it in
+static int memfd_reserve(void) {
+    pthread_mutex_lock(&memfd_lock);
+    int slot = memfd_count < MAX_MEMFD_FILES ? memfd_count++ : -1;
+    pthread_mutex_unlock(&memfd_lock);
+    return slot;
+}
+
+// An empty memory-backed file of the given size
+static int memfd_open(const char *relative_path, size_t size) {
     char name[256];
     snprintf(name, sizeof(name), "sscc_%s", strrchr(relative_path, '/') ? strrchr(relative_path, '/') + 1 : relative_path);
     
     int fd = memfd_create(name, MFD_CLOEXEC);
-    if (fd < 0) {
+    if (fd >= 0 && ftruncate(fd, size) < 0) {
+        close(fd);
         return -1;
     }
+    return fd;
+}
+
+static void memfd_publish(int slot, const char *relative_path, int fd, size_t size) {
+    strncpy(memfd_files[slot].name, relative_path, MAX_PATH - 1);
+    memfd_files[slot].name[MAX_PATH - 1] = '\0';
+    memfd_files[slot].fd = fd;
+    memfd_files[slot].size = size;
+    memfd_files[slot].linked = 0;
+    memfd_files[slot].used = 1;
+}
+#endif
+
+static int create_memfd_file(const char *relative_path, const void *data, size_t size) {
+    if (ram_method != 1) {
+        return -1;  // Not using memfd
+    }
+    
+#ifdef __linux__
+    int slot = memfd_reserve();
+    if (slot < 0) {
+        return -1;  // Too many files
+    }
     
-    // Set size and write data
-    if (ftruncate(fd, size) < 0 || write(fd, data, size) != (ssize_t)size) {
+    int fd = memfd_open(relative_path, size);
+    if (fd < 0) {
+        return -1;
+    }
+    if (pwrite(fd, data, size, 0) != (ssize_t)size) {
         close(fd);
         return -1;
     }
     
-    // Reset file position
-    lseek(fd, 0, SEEK_SET);
-    
-    // Store file info
-    strncpy(memfd_files[memfd_count].name, relative_path, MAX_PATH - 1);
-    memfd_files[memfd_count].name[MAX_PATH - 1] = '\0';
-    memfd_files[memfd_count].fd = fd;
-    memfd_files[memfd_count].size = size;
-    memfd_files[memfd_count].used = 1;
-    
-    return memfd_count++;
+    memfd_publish(slot, relative_path, fd, size);
+    return slot;
 #else
     return -1;
 #endif
@@ -204,12 +397,17 @@ static int create_memfd_file(const char *relative_path, const void *data, size_t
 // Forward declaration
 static int create_directory_recursive(const char *path);
 
+// Expose each memfd in the extraction tree as a symlink to /proc/self/fd/N.
+// Nothing is copied: the compiler opens the link, which reopens the memfd
+// itself, both in-process and in the exec'd tcc (see keep_memfds_on_exec).
 static int create_memfd_files(const char *temp_dir) {
     if (ram_method != 1) return 0;
     
-    // For TCC compatibility, create regular files from memfd content instead of symlinks
+    // Files of a directory tend to follow each other, so its mkdir -p runs
+    // once per run of them rather than once per file
+    char last_dir[MAX_PATH] = "";
     for (int i = 0; i < memfd_count; i++) {
-        if (!memfd_files[i].used) continue;
+        if (!memfd_files[i].used || memfd_files[i].linked) continue;
         
         char file_path[MAX_PATH];
         snprintf(file_path, sizeof(file_path), "%s/%s", temp_dir, memfd_files[i].name);
@@ -218,26 +416,38 @@ static int create_memfd_files(const char *temp_dir) {
         char *last_slash = strrchr(file_path, '/');
         if (last_slash && last_slash != file_path) {
             *last_slash = '\0';
-            create_directory_recursive(file_path);
+            if (strcmp(file_path, last_dir) != 0) {
+                create_directory_recursive(file_path);
+                snprintf(last_dir, sizeof(last_dir), "%s", file_path);
+            }
             *last_slash = '/';
         }
         
-        // Read data from memfd and write to regular file
-        lseek(memfd_files[i].fd, 0, SEEK_SET);
-        char *buffer = malloc(memfd_files[i].size);
-        if (buffer && read(memfd_files[i].fd, buffer, memfd_files[i].size) == (ssize_t)memfd_files[i].size) {
-            FILE *f = fopen(file_path, "wb");
-            if (f) {
-                fwrite(buffer, 1, memfd_files[i].size, f);
-                fclose(f);
-            }
+        char target[64];
+        snprintf(target, sizeof(target), "/proc/self/fd/%d", memfd_files[i].fd);
+        
+        // A later addon may replace a file, as it did with regular files
+        unlink(file_path);
+        if (symlink(target, file_path) != 0) {
+            fprintf(stderr, "Error: Cannot link %s: %s\n", file_path, strerror(errno));
+            return -1;
         }
-        if (buffer) free(buffer);
+        memfd_files[i].linked = 1;
     }
     
     return 0;
 }
 
+// The memfds are created close-on-exec; the tcc child must inherit them at
+// the same numbers for /proc/self/fd/N to resolve
+static void keep_memfds_on_exec() {
+    for (int i = 0; i < memfd_count; i++) {
+        if (memfd_files[i].used && memfd_files[i].fd >= 0) {
+            fcntl(memfd_files[i].fd, F_SETFD, 0);
+        }
+    }
+}
+
 static void cleanup_memfd_files() {
     if (ram_method != 1) return;
     
@@ -251,284 +461,4397 @@ static void cleanup_memfd_files() {
 }
 
 static void track_file_size(const char *path, size_t size) {
-    total_ram_used += size;
+    __atomic_add_fetch(&total_ram_used, size, __ATOMIC_RELAXED);
     // Only track totals, don't print individual file info
 }
 
-static uint32_t read_uint32(const char **data) {
-    uint32_t val = *(uint32_t*)*data;
-    *data += sizeof(uint32_t);
-    return val;
-}
+// System calls extraction made to put files in place, for
+// --sscc-bench=extract
+static uint64_t tree_syscalls;
 
-static int lzma_decompress_data(const char *input, size_t input_size, char *output, size_t output_size) {
-    lzma_stream strm = LZMA_STREAM_INIT;
-    
-    lzma_ret ret = lzma_stream_decoder(&strm, UINT64_MAX, LZMA_CONCATENATED);
-    if (ret != LZMA_OK) return -1;
-    
-    strm.next_in = (const uint8_t*)input;
-    strm.avail_in = input_size;
-    strm.next_out = (uint8_t*)output;
-    strm.avail_out = output_size;
-    
-    ret = lzma_code(&strm, LZMA_FINISH);
-    lzma_end(&strm);
-    
-    return (ret == LZMA_STREAM_END) ? 0 : -1;
+static void count_syscalls(uint64_t n) {
+    __atomic_add_fetch(&tree_syscalls, n, __ATOMIC_RELAXED);
 }
 
-static int create_directory_recursive(const char *path) {
+// mkdir -p without diagnostics, safe to race with other extraction threads
+static int make_directories(const char *path) {
     char *path_copy = strdup(path);
+    if (!path_copy) return -1;
     char *p = path_copy;
     
     while ((p = strchr(p + 1, '/')) != NULL) {
         *p = '\0';
+        count_syscalls(1);
         if (mkdir(path_copy, 0755) != 0 && errno != EEXIST) {
-            fprintf(stderr, "Error: Cannot create directory %s: %s\n", path_copy, strerror(errno));
             free(path_copy);
             return -1;
         }
         *p = '/';
     }
     
-    if (mkdir(path_copy, 0755) != 0 && errno != EEXIST) {
-        fprintf(stderr, "Error: Cannot create directory %s: %s\n", path_copy, strerror(errno));
-        free(path_copy);
+    count_syscalls(1);
+    int ret = (mkdir(path_copy, 0755) != 0 && errno != EEXIST) ? -1 : 0;
+    free(path_copy);
+    return ret;
+}
+
+static int create_directory_recursive(const char *path) {
+    if (make_directories(path) != 0) {
+        fprintf(stderr, "Error: Cannot create directory %s: %s\n", path, strerror(errno));
         return -1;
     }
-    
-    free(path_copy);
     return 0;
 }
 
-static int extract_core_archive(const char *archive_data, size_t archive_size, const char *temp_dir) {
-    const char *data = archive_data;
+// Extraction failures, reported by the caller once all threads are done
+#define EXTRACT_ERR_MEMORY -1
+#define EXTRACT_ERR_DECODE -2
+#define EXTRACT_ERR_CREATE -3
+#define EXTRACT_ERR_WRITE -4
+#define EXTRACT_ERR_LINK -5
+
+static const char *extract_error_string(int err) {
+    switch (err) {
+        case EXTRACT_ERR_MEMORY: return "out of memory";
+        case EXTRACT_ERR_DECODE: return "corrupt compressed data";
+        case EXTRACT_ERR_CREATE: return "cannot create file";
+        case EXTRACT_ERR_WRITE: return "write failed";
+        case EXTRACT_ERR_LINK: return "referenced file missing (load the core or addon it comes from first)";
+        default: return "unknown error";
+    }
+}
+
+// Members of split static libraries (entries under STATICLIB_MEMBER_DIR)
+static int is_library_member(const Archive *archive, uint32_t i) {
+    const ArchiveEntry *e = &archive->entries[i];
+    return e->path_len > strlen(STATICLIB_MEMBER_DIR) &&
+           memcmp(archive_path(archive, e), STATICLIB_MEMBER_DIR, strlen(STATICLIB_MEMBER_DIR)) == 0;
+}
+
+// Phase-selective extraction
+//
+// A private tree only gets the subtrees the invocation reads: headers for
+// -c/-E/-M compiles of sources, crt objects and libraries for links of
+// objects, both for anything else (see invocation_phases). Cached trees are
+// shared, so they always hold everything.
+#define PHASE_INCLUDE 1
+#define PHASE_LIB 2
+#define PHASE_ALL (PHASE_INCLUDE | PHASE_LIB)
+
+static int extract_phases = PHASE_ALL;
+
+// Entries of the archive being extracted that are needed at all (see
+// Automatic addons), or NULL for every entry
+static const uint8_t *entry_selection;
+
+static int phase_wants(const char *path) {
+    if (strncmp(path, "include/", 8) == 0) return extract_phases & PHASE_INCLUDE;
+    if (strncmp(path, "lib/", 4) == 0) return extract_phases & PHASE_LIB;
+    return 1;
+}
+
+static int entry_wanted(const Archive *archive, uint32_t i) {
+    // Library members are only written as part of their library
+    return (!entry_selection || entry_selection[i]) && !is_library_member(archive, i) &&
+           phase_wants(archive_path(archive, &archive->entries[i]));
+}
+
+// Set in the lazy extractor (see Lazy extraction): the compile reads the
+// tree meanwhile, so files are written under a temporary name and renamed
+// into place once complete, here and in batches (FileBatch.atomic)
+static int extract_atomic = 0;
+
+// A later archive may write a regular file where an earlier one put a link
+// entry (a symlink): opening it would follow the link and overwrite its
+// target, so the link is removed and the file created again
+static int open_tree_file(const char *full_path, int flags) {
+    flags |= O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC;
+    int fd = open(full_path, flags, 0666);
+    if (fd < 0 && errno == ELOOP && unlink(full_path) == 0) {
+        count_syscalls(2);
+        fd = open(full_path, flags, 0666);
+    }
+    return fd;
+}
+
+// Write one file into the extraction directory (or a memfd). Runs on pool
+// threads, so it returns an EXTRACT_ERR_* code instead of printing.
+static int write_tree_file(const char *temp_dir, const char *path, const void *data, size_t size) {
+    // Try memfd first, fallback to regular file
+    if (ram_method == 1) {
+        int memfd_id = create_memfd_file(path, data, size);
+        if (memfd_id >= 0) {
+            count_syscalls(3);
+            track_file_size(path, size);
+            return 0;
+        }
+    }
     
-    if (memcmp(data, "CORE", 4) != 0) {
-        fprintf(stderr, "Error: Invalid core archive format\n");
-        return -1;
+    // Regular file creation (for /dev/shm, tmpfs, or disk)
+    char full_path[MAX_PATH];
+    snprintf(full_path, sizeof(full_path), "%s/%s", temp_dir, path);
+    
+    char *last_slash = strrchr(full_path, '/');
+    if (last_slash) {
+        *last_slash = '\0';
+        make_directories(full_path);
+        *last_slash = '/';
     }
-    data += 4;
     
-    uint32_t file_count = read_uint32(&data);
-    size_t core_ram_used = 0;
+    char temp_path[MAX_PATH];
+    const char *name = full_path;
+    if (extract_atomic) {
+        if (snprintf(temp_path, sizeof(temp_path), "%s" FILE_BATCH_TEMP_SUFFIX, full_path) >=
+            (int)sizeof(temp_path)) {
+            return EXTRACT_ERR_CREATE;
+        }
+        name = temp_path;
+    }
     
-    for (uint32_t i = 0; i < file_count; i++) {
-        uint32_t path_len = read_uint32(&data);
-        char path[MAX_PATH];
-        memcpy(path, data, path_len);
-        path[path_len] = '\0';
-        data += path_len;
-        
-        uint32_t original_size = read_uint32(&data);
-        uint32_t compressed_size = read_uint32(&data);
-        
-        char *decompressed = malloc(original_size);
-        if (!decompressed) {
-            fprintf(stderr, "Error: Memory allocation failed\n");
-            return -1;
+    // Written straight from the caller's buffer; stdio would copy it once more
+    int fd = open_tree_file(name, O_WRONLY);
+    count_syscalls(2);          // and the close
+    if (fd < 0) {
+        return EXTRACT_ERR_CREATE;
+    }
+    
+    const char *p = data;
+    int failed = 0;
+    for (size_t left = size; left > 0; ) {
+        ssize_t n = write(fd, p, left);
+        count_syscalls(1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            failed = 1;
+            break;
         }
-        
-        if (lzma_decompress_data(data, compressed_size, decompressed, original_size) != 0) {
-            fprintf(stderr, "Error: Failed to decompress core file %s\n", path);
-            free(decompressed);
-            return -1;
+        p += n;
+        left -= n;
+    }
+    if (close(fd) != 0) failed = 1;
+    if (extract_atomic) {
+        count_syscalls(1);
+        if (failed || rename(temp_path, full_path) != 0) {
+            unlink(temp_path);
+            return EXTRACT_ERR_WRITE;
         }
-        
-        // Try memfd first, fallback to regular file
-        if (ram_method == 1) {
-            int memfd_id = create_memfd_file(path, decompressed, original_size);
-            if (memfd_id >= 0) {
-                track_file_size(path, original_size);
-                core_ram_used += original_size;
-                free(decompressed);
-                data += compressed_size;
-                continue;
-            }
+    }
+    if (failed) {
+        return EXTRACT_ERR_WRITE;
+    }
+    
+    // Track RAM usage for this file
+    track_file_size(full_path, size);
+    return 0;
+}
+
+// Large entries are decoded straight into the pages of their file (or
+// memfd): it is created at its final size, its space is reserved so that a
+// full tmpfs fails here rather than with SIGBUS on a store into the mapping,
+// and it is mapped shared. Returns -1 if the file cannot be mapped, for the
+// caller to fall back to write_tree_file.
+typedef struct {
+    char full_path[MAX_PATH];
+    char temp_path[MAX_PATH];   // written here until complete (extract_atomic)
+    int fd;
+    int memfd_slot;             // -1 for a file in the tree
+    void *map;
+    size_t size;
+} MappedTreeFile;
+
+// Drops a file whose content will not be complete
+static void discard_tree_file(MappedTreeFile *f) {
+    if (f->map) munmap(f->map, f->size);
+    close(f->fd);
+    if (f->temp_path[0]) unlink(f->temp_path);
+}
+
+static int map_tree_file(const char *temp_dir, const char *path, size_t size, MappedTreeFile *f) {
+    f->fd = -1;
+    f->memfd_slot = -1;
+    f->size = size;
+    f->temp_path[0] = '\0';
+    snprintf(f->full_path, sizeof(f->full_path), "%s/%s", temp_dir, path);
+#ifdef __linux__
+    // A slot that ends up unused stays empty, as when create_memfd_file fails
+    if (ram_method == 1 && (f->memfd_slot = memfd_reserve()) >= 0) {
+        f->fd = memfd_open(path, size);
+        count_syscalls(2);
+        if (f->fd < 0) f->memfd_slot = -1;
+    }
+#endif
+    
+    // Its directory was created with the rest (see create_unit_directories)
+    if (f->fd < 0) {
+        if (extract_atomic && snprintf(f->temp_path, sizeof(f->temp_path), "%s" FILE_BATCH_TEMP_SUFFIX,
+                                       f->full_path) >= (int)sizeof(f->temp_path)) {
+            return EXTRACT_ERR_CREATE;
         }
-        
-        // Regular file creation (for /dev/shm, tmpfs, or disk)
-        char full_path[MAX_PATH];
-        snprintf(full_path, sizeof(full_path), "%s/%s", temp_dir, path);
-        
-        char *last_slash = strrchr(full_path, '/');
-        if (last_slash) {
-            *last_slash = '\0';
-            create_directory_recursive(full_path);
-            *last_slash = '/';
+        f->fd = open_tree_file(f->temp_path[0] ? f->temp_path : f->full_path, O_RDWR);
+        count_syscalls(1);
+        if (f->fd < 0) {
+            return EXTRACT_ERR_CREATE;
         }
-        
-        FILE *f = fopen(full_path, "wb");
-        if (!f) {
-            fprintf(stderr, "Error: Cannot create file %s\n", full_path);
-            free(decompressed);
-            return -1;
+    }
+    
+    count_syscalls(2);
+    f->map = NULL;
+    if (fallocate(f->fd, 0, 0, size) != 0 ||
+        (f->map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, f->fd, 0)) == MAP_FAILED) {
+        f->map = NULL;
+        discard_tree_file(f);
+        return -1;
+    }
+    return 0;
+}
+
+// Unmaps the file once its content is complete
+static int unmap_tree_file(MappedTreeFile *f, const char *path) {
+    munmap(f->map, f->size);
+    count_syscalls(1);
+#ifdef __linux__
+    if (f->memfd_slot >= 0) {
+        memfd_publish(f->memfd_slot, path, f->fd, f->size);
+        track_file_size(path, f->size);
+        return 0;
+    }
+#endif
+    count_syscalls(1);
+    if (close(f->fd) != 0) {
+        if (f->temp_path[0]) unlink(f->temp_path);
+        return EXTRACT_ERR_WRITE;
+    }
+    if (f->temp_path[0]) {
+        count_syscalls(1);
+        if (rename(f->temp_path, f->full_path) != 0) {
+            unlink(f->temp_path);
+            return EXTRACT_ERR_WRITE;
+        }
+    }
+    track_file_size(f->full_path, f->size);
+    return 0;
+}
+
+// A link entry becomes a relative symlink to the path holding its content,
+// which is either in the same archive (possibly not written yet) or must
+// already be in the tree
+static int write_link(const Archive *archive, const ArchiveEntry *e, const char *temp_dir) {
+    const char *path = archive_path(archive, e);
+    char target[MAX_PATH];
+    char full_path[MAX_PATH];
+    if (archive_link_target(archive, e, target, sizeof(target)) != 0) {
+        return EXTRACT_ERR_DECODE;
+    }
+    // Its content is in a subtree this invocation does not read
+    if (!phase_wants(target)) {
+        return 0;
+    }
+    if (archive_find(archive, target) < 0) {
+        count_syscalls(1);
+        if (snprintf(full_path, sizeof(full_path), "%s/%s", temp_dir, target) >= (int)sizeof(full_path) ||
+            access(full_path, F_OK) != 0) {
+            return EXTRACT_ERR_LINK;
         }
-        
-        fwrite(decompressed, 1, original_size, f);
-        fclose(f);
-        
-        // Track RAM usage for this file
-        track_file_size(full_path, original_size);
-        core_ram_used += original_size;
-        
-        free(decompressed);
-        data += compressed_size;
     }
     
-    // Create files for memfd files
-    if (ram_method == 1) {
-        create_memfd_files(temp_dir);
+    // One "../" per directory level of path leads back to the tree root
+    char relative[MAX_PATH];
+    size_t pos = 0;
+    for (const char *p = strchr(path, '/'); p && pos + 3 < sizeof(relative); p = strchr(p + 1, '/')) {
+        memcpy(relative + pos, "../", 3);
+        pos += 3;
     }
+    snprintf(relative + pos, sizeof(relative) - pos, "%s", target);
     
-    // Show core summary like addon loading
-    char core_size_str[64];
-    format_bytes(core_ram_used, core_size_str, sizeof(core_size_str));
-    printf("Loading core 'musl': Complete C standard library (%u files)\n", file_count);
-    printf("Core 'musl' loaded: %s in RAM\n", core_size_str);
+    // Its directory was created with the rest (see create_unit_directories)
+    snprintf(full_path, sizeof(full_path), "%s/%s", temp_dir, path);
     
+    // A later archive may replace a file, as it does with regular entries
+    count_syscalls(2);
+    unlink(full_path);
+    if (symlink(relative, full_path) != 0) {
+        return EXTRACT_ERR_CREATE;
+    }
     return 0;
 }
 
-static int load_addon_file(const char *addon_path, const char *temp_dir) {
-    FILE *f = fopen(addon_path, "rb");
-    if (!f) {
-        fprintf(stderr, "Warning: Cannot open addon file %s\n", addon_path);
-        return -1;
+// One pool item: a single entry, or a solid block decoded once for all of
+// its members
+typedef struct {
+    uint32_t first;
+    uint32_t end;
+    size_t size;                // decoded size
+    uint32_t failed;            // entry that failed, for the error message
+    int err;                    // and its EXTRACT_ERR_* code, 0 if none
+} ExtractUnit;
+
+// Entries up to this size are decoded into the arena and written from there
+// while still in cache: mapping a file costs more than that second copy of a
+// few kilobytes. Every solid member fits.
+#define EXTRACT_SMALL_FILE ARCHIVE_SOLID_MAX_FILE
+// A slice of the arena holds the small files of a batch until it is flushed
+// (see batch.h), then scratch for solid-block bytes nobody wants
+#define EXTRACT_BATCH_BYTES (4 * EXTRACT_SMALL_FILE)
+#define EXTRACT_SCRATCH_SIZE (16 * 1024)
+#define EXTRACT_SLICE_SIZE (EXTRACT_BATCH_BYTES + EXTRACT_SCRATCH_SIZE)
+
+// Whether batches may use io_uring, and whether one did; --sscc-bench=extract
+// compares both ways
+static int extract_uring = 1;
+static int extract_uring_used;
+
+typedef struct {
+    unsigned char *buffer;
+    size_t used;                // by files queued in batch
+    FileBatch batch;
+    ArchiveSink sink;           // and its decoder state
+} ExtractSlice;
+
+typedef struct {
+    const Archive *archive;
+    const char *temp_dir;
+    int dir_fd;                 // temp_dir, for the batches; -1 writes one by one
+    ExtractUnit *units;         // in archive order
+    uint32_t unit_count;
+    size_t bytes;               // uncompressed size of the entries extracted
+    // The only scratch memory of an extraction: one arena, a slice per task
+    // running at a time. A slice's batch outlives the task that queued it.
+    unsigned char *arena;
+    ExtractSlice *slices;
+    int *free_slices;
+    int free_count;
+    pthread_mutex_t lock;
+} ExtractJob;
+
+typedef struct {
+    ExtractJob *job;
+    ExtractUnit *unit;
+    ExtractSlice *slice;
+    MappedTreeFile file;
+    int mapped;                 // the entry being decoded goes to file
+    char *heap;                 // or to this, when its file cannot be mapped
+} ExtractTask;
+
+// Files are written after their task returns, so failures are kept with
+// the unit; the lowest entry of a unit wins
+static void extract_failed(ExtractUnit *unit, uint32_t i, int err) {
+    if (unit->err == 0 || i < unit->failed) {
+        unit->err = err;
+        unit->failed = i;
     }
-    
-    // Read magic
-    char magic[6];
-    if (fread(magic, 1, 5, f) != 5 || memcmp(magic, "ADDON", 5) != 0) {
-        fprintf(stderr, "Warning: Invalid addon file format: %s\n", addon_path);
-        fclose(f);
-        return -1;
+}
+
+static ExtractUnit *extract_unit_of(ExtractJob *job, uint32_t i) {
+    uint32_t lo = 0, hi = job->unit_count;
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (job->units[mid].first <= i) lo = mid;
+        else hi = mid;
+    }
+    return &job->units[lo];
+}
+
+static void extract_written(void *ctx, uint32_t i, int err) {
+    ExtractJob *job = ctx;
+    const ArchiveEntry *e = &job->archive->entries[i];
+    if (err == 0) {
+        __atomic_add_fetch(&job->bytes, e->original_size, __ATOMIC_RELAXED);
+        track_file_size(archive_path(job->archive, e), e->original_size);
+    } else {
+        extract_failed(extract_unit_of(job, i), i,
+                       err == FILE_BATCH_ERR_CREATE ? EXTRACT_ERR_CREATE : EXTRACT_ERR_WRITE);
+    }
+}
+
+static void extract_flush(ExtractJob *job, ExtractSlice *slice) {
+    if (slice->batch.count == 0) return;
+    uint64_t start = trace_now();
+    uint32_t count = slice->batch.count;
+    file_batch_flush(&slice->batch, extract_written, job);
+    slice->used = 0;
+    if (trace_enabled()) {
+        char detail[32];
+        snprintf(detail, sizeof(detail), "%u files", count);
+        trace_span("write_batch", start, detail);
+    }
+}
+
+// Room for a file of size bytes in the slice's batch, flushing it if full
+static void extract_reserve(ExtractJob *job, ExtractSlice *slice, size_t size) {
+    if (file_batch_full(&slice->batch) || slice->used + size > EXTRACT_BATCH_BYTES) {
+        extract_flush(job, slice);
+    }
+}
+
+// Writes a complete small file: queued with the slice's batch (room for it
+// was made by extract_reserve), or at once for memfd trees
+static void extract_write(ExtractTask *t, uint32_t i, const void *data) {
+    ExtractJob *job = t->job;
+    const ArchiveEntry *e = &job->archive->entries[i];
+    const char *path = archive_path(job->archive, e);
+    if (job->dir_fd >= 0) {
+        file_batch_add(&t->slice->batch, path, data, e->original_size, i);
+        return;
     }
     
-    // Read addon name
-    uint32_t name_len;
-    fread(&name_len, sizeof(uint32_t), 1, f);
-    char *addon_name = malloc(name_len + 1);
-    fread(addon_name, 1, name_len, f);
-    addon_name[name_len] = '\0';
+    uint64_t start = trace_now();
+    int err = write_tree_file(job->temp_dir, path, data, e->original_size);
+    trace_span("write", start, path);
+    if (err == 0) {
+        __atomic_add_fetch(&job->bytes, e->original_size, __ATOMIC_RELAXED);
+    } else {
+        extract_failed(t->unit, i, err);
+    }
+}
+
+static void *extract_begin(void *ctx, uint32_t i) {
+    ExtractTask *t = ctx;
+    const Archive *archive = t->job->archive;
+    const ArchiveEntry *e = &archive->entries[i];
+    if (!entry_wanted(archive, i)) return NULL;
+    if (e->original_size <= EXTRACT_SMALL_FILE) {
+        extract_reserve(t->job, t->slice, e->original_size);
+        return t->slice->buffer + t->slice->used;
+    }
     
-    // Read description
-    uint32_t desc_len;
-    fread(&desc_len, sizeof(uint32_t), 1, f);
-    char *description = malloc(desc_len + 1);
-    fread(description, 1, desc_len, f);
-    description[desc_len] = '\0';
+    int err = map_tree_file(t->job->temp_dir, archive_path(archive, e), e->original_size, &t->file);
+    if (err == 0) {
+        t->mapped = 1;
+        return t->file.map;
+    }
+    if (err == EXTRACT_ERR_CREATE) {
+        extract_failed(t->unit, i, err);
+        return NULL;
+    }
+    t->heap = malloc(e->original_size);
+    if (!t->heap) extract_failed(t->unit, i, EXTRACT_ERR_MEMORY);
+    return t->heap;
+}
+
+static void extract_done(void *ctx, uint32_t i, void *data) {
+    ExtractTask *t = ctx;
+    const Archive *archive = t->job->archive;
+    const ArchiveEntry *e = &archive->entries[i];
+    const char *path = archive_path(archive, e);
     
-    // Read file count
-    uint32_t file_count;
-    fread(&file_count, sizeof(uint32_t), 1, f);
+    if (data == t->slice->buffer + t->slice->used) {
+        if (t->job->dir_fd >= 0) t->slice->used += e->original_size;
+        extract_write(t, i, data);
+        return;
+    }
     
-    printf("Loading addon '%s': %s (%u files)\n", addon_name, description, file_count);
+    uint64_t start = trace_now();
+    int err;
+    if (t->mapped) {
+        err = unmap_tree_file(&t->file, path);
+        t->mapped = 0;
+    } else {
+        err = write_tree_file(t->job->temp_dir, path, data, e->original_size);
+    }
+    free(t->heap);
+    t->heap = NULL;
+    trace_span("write", start, path);
     
-    size_t addon_ram_used = 0;
+    if (err == 0) {
+        __atomic_add_fetch(&t->job->bytes, e->original_size, __ATOMIC_RELAXED);
+    } else {
+        extract_failed(t->unit, i, err);
+    }
+}
+
+static int extract_task(void *ctx, uint32_t item) {
+    ExtractJob *job = ctx;
+    ExtractUnit *unit = &job->units[item];
+    const Archive *archive = job->archive;
     
-    // Extract files
-    for (uint32_t i = 0; i < file_count; i++) {
-        uint32_t path_len;
-        fread(&path_len, sizeof(uint32_t), 1, f);
-        
-        char path[MAX_PATH];
-        fread(path, 1, path_len, f);
-        path[path_len] = '\0';
-        
-        uint32_t original_size, compressed_size;
-        fread(&original_size, sizeof(uint32_t), 1, f);
-        fread(&compressed_size, sizeof(uint32_t), 1, f);
-        
-        char *compressed_data = malloc(compressed_size);
-        fread(compressed_data, 1, compressed_size, f);
-        
-        char *decompressed = malloc(original_size);
-        if (lzma_decompress_data(compressed_data, compressed_size, decompressed, original_size) == 0) {
-            // Try memfd first for addons too
-            if (ram_method == 1) {
-                int memfd_id = create_memfd_file(path, decompressed, original_size);
-                if (memfd_id >= 0) {
-                    track_file_size(path, original_size);
-                    addon_ram_used += original_size;
-                    free(compressed_data);
-                    free(decompressed);
-                    continue;
-                }
-            }
-            
-            // Regular file creation
-            char full_path[MAX_PATH];
-            snprintf(full_path, sizeof(full_path), "%s/%s", temp_dir, path);
-            
-            char *last_slash = strrchr(full_path, '/');
-            if (last_slash) {
-                *last_slash = '\0';
-                create_directory_recursive(full_path);
-                *last_slash = '/';
-            }
-            
-            FILE *out = fopen(full_path, "wb");
-            if (out) {
-                fwrite(decompressed, 1, original_size, out);
-                fclose(out);
-                
-                // Track RAM usage for this addon file
-                track_file_size(full_path, original_size);
-                addon_ram_used += original_size;
-            }
-        }
-        
-        free(compressed_data);
-        free(decompressed);
+    const ArchiveEntry *first = &archive->entries[unit->first];
+    if (first->codec == ARCHIVE_CODEC_LINK) {
+        int err = write_link(archive, first, job->temp_dir);
+        if (err == 0) __atomic_add_fetch(&job->bytes, first->original_size, __ATOMIC_RELAXED);
+        else extract_failed(unit, unit->first, err);
+        return 0;
     }
     
-    // Show addon summary
-    if (use_ram_filesystem && addon_ram_used > 0) {
-        char addon_size_str[64];
-        format_bytes(addon_ram_used, addon_size_str, sizeof(addon_size_str));
-        printf("Addon '%s' loaded: %s in RAM\n", addon_name, addon_size_str);
+    // At most one task per pool thread runs at a time, so a slice is free
+    pthread_mutex_lock(&job->lock);
+    int slice = job->free_slices[--job->free_count];
+    pthread_mutex_unlock(&job->lock);
+    
+    ExtractTask task = { job, unit, &job->slices[slice] };
+    const void *stored = archive_stored_data(archive, first);
+    if (stored) {
+        // Stored entries are written from the payload itself
+        if (entry_wanted(archive, unit->first)) {
+            extract_reserve(job, task.slice, 0);
+            extract_write(&task, unit->first, stored);
+        }
+    } else {
+        ArchiveSink *sink = &task.slice->sink;
+        sink->ctx = &task;
+        uint64_t start = trace_now();
+        if (archive_decode_unit_to(archive, unit->first, sink) != 0) {
+            // Whatever the entry being decoded had is dropped with it
+            if (task.mapped) discard_tree_file(&task.file);
+            free(task.heap);
+            extract_failed(unit, unit->first, EXTRACT_ERR_DECODE);
+        }
+        trace_span("decode", start, archive_path(archive, first));
     }
     
-    free(addon_name);
-    free(description);
-    fclose(f);
+    pthread_mutex_lock(&job->lock);
+    job->free_slices[job->free_count++] = slice;
+    pthread_mutex_unlock(&job->lock);
     return 0;
 }
 
-static void load_addons(const char *temp_dir, char **addon_files, int addon_count) {
-    // Load explicitly specified addon files only
-    for (int i = 0; i < addon_count; i++) {
-        load_addon_file(addon_files[i], temp_dir);
+static int compare_dir_names(const void *a, const void *b) {
+    return strcmp(*(const char *const*)a, *(const char *const*)b);
+}
+
+// The directories the units' files go into are created once, up front,
+// parents first, rather than mkdir -p for every file
+static void create_unit_directories(ExtractJob *job) {
+    const Archive *archive = job->archive;
+    uint8_t *marked = calloc(archive->dir_count + 1, 1);
+    const char **dirs = malloc((archive->dir_count + 1) * sizeof(char*));
+    if (!marked || !dirs) {
+        free(marked);
+        free(dirs);
+        return;
     }
     
-    // Create files for memfd addon files
-    if (ram_method == 1) {
-        create_memfd_files(temp_dir);
+    uint32_t count = 0;
+    for (uint32_t u = 0; u < job->unit_count; u++) {
+        for (uint32_t i = job->units[u].first; i < job->units[u].end; i++) {
+            uint32_t d = archive->entries[i].dir_id;
+            if (d >= archive->dir_count || marked[d] || !entry_wanted(archive, i)) continue;
+            marked[d] = 1;
+            if (*archive_dir(archive, d)) dirs[count++] = archive_dir(archive, d);
+        }
     }
+    
+    // A parent sorts before its children; one that is not itself a file's
+    // directory is made on the way (ENOENT)
+    qsort(dirs, count, sizeof(char*), compare_dir_names);
+    for (uint32_t k = 0; k < count; k++) {
+        count_syscalls(1);
+        if (job->dir_fd >= 0 && mkdirat(job->dir_fd, dirs[k], 0755) == 0) continue;
+        if (job->dir_fd >= 0 && errno == EEXIST) continue;
+        char full_path[MAX_PATH];
+        snprintf(full_path, sizeof(full_path), "%s/%s", job->temp_dir, dirs[k]);
+        make_directories(full_path);
+    }
+    free(marked);
+    free(dirs);
 }
 
-static void cleanup_temp_dir(const char *temp_dir) {
+// Decode entries first..end-1 of an archive on the thread pool, largest
+// units first so that the long LZMA streams never end up as the tail. The
+// range must start and end on unit boundaries. Returns 0 or the
+// EXTRACT_ERR_* code of the lowest-numbered failing entry.
+static int extract_entries(const Archive *archive, uint32_t first, uint32_t end, const char *temp_dir,
+                           int threads, size_t *bytes, uint32_t *failed_item) {
+    ExtractUnit *units = malloc((end - first + 1) * sizeof(ExtractUnit));
+    uint32_t *sizes = calloc(end - first + 1, sizeof(uint32_t));
+    uint32_t *order = malloc((end - first + 1) * sizeof(uint32_t));
+    if (!units || !sizes || !order) {
+        free(units);
+        free(sizes);
+        free(order);
+        *failed_item = first;
+        return EXTRACT_ERR_MEMORY;
+    }
+    
+    uint32_t count = 0;
+    for (uint32_t i = first; i < end; ) {
+        // Units with nothing to write are not decoded at all
+        uint32_t unit_end = archive_unit_end(archive, i, &units[count].size);
+        int wanted = 0;
+        for (uint32_t j = i; j < unit_end && !wanted; j++) wanted = entry_wanted(archive, j);
+        if (wanted) {
+            units[count].first = i;
+            units[count].end = unit_end;
+            units[count].err = 0;
+            sizes[count] = units[count].size > UINT32_MAX ? UINT32_MAX : units[count].size;
+            count++;
+        }
+        i = unit_end;
+    }
+    pool_order_by_size(order, sizes, count);
+    
+    // pool_run never runs more tasks at once than there are units
+    int slices = threads < 1 ? 1 : threads;
+    if ((uint32_t)slices > count) slices = count ? (int)count : 1;
+    ExtractJob job = { archive, temp_dir, -1, units, count, 0 };
+    if (ram_method != 1) job.dir_fd = open(temp_dir, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    job.arena = malloc((size_t)slices * EXTRACT_SLICE_SIZE);
+    job.slices = calloc(slices, sizeof(ExtractSlice));
+    job.free_slices = malloc(slices * sizeof(int));
+    pthread_mutex_init(&job.lock, NULL);
+    int ret = EXTRACT_ERR_MEMORY;
+    if (job.arena && job.slices && job.free_slices) {
+        int uring = extract_uring && file_batch_uring_enabled();
+        for (int k = 0; k < slices; k++) {
+            ExtractSlice *slice = &job.slices[k];
+            slice->buffer = job.arena + (size_t)k * EXTRACT_SLICE_SIZE;
+            slice->sink = (ArchiveSink){ extract_begin, extract_done, NULL, slice->buffer + EXTRACT_BATCH_BYTES,
+                                         EXTRACT_SCRATCH_SIZE, NULL };
+            file_batch_init(&slice->batch, job.dir_fd, uring);
+            slice->batch.atomic = extract_atomic;
+            job.free_slices[job.free_count++] = k;
+        }
+        
+        uint64_t start = trace_now();
+        create_unit_directories(&job);
+        trace_span("create_directories", start, NULL);
+        
+        uint32_t failed_unit;
+        pool_run(count, order, threads, extract_task, &job, &failed_unit);
+        for (int k = 0; k < slices; k++) {
+            extract_flush(&job, &job.slices[k]);
+            if (job.slices[k].batch.ring) extract_uring_used = 1;
+            file_batch_free(&job.slices[k].batch);
+            count_syscalls(job.slices[k].batch.syscalls);
+            archive_sink_release(&job.slices[k].sink);
+        }
+        
+        // Units are in archive order, so the first failure is the lowest entry
+        ret = 0;
+        for (uint32_t u = 0; u < count && ret == 0; u++) {
+            if (units[u].err != 0) {
+                ret = units[u].err;
+                *failed_item = units[u].failed;
+            }
+        }
+    } else {
+        *failed_item = first;
+    }
+    if (bytes) *bytes = job.bytes;
+    
+    if (job.dir_fd >= 0) close(job.dir_fd);
+    pthread_mutex_destroy(&job.lock);
+    free(job.arena);
+    free(job.slices);
+    free(job.free_slices);
+    free(units);
+    free(sizes);
+    free(order);
+    return ret;
+}
+
+static int extract_all_entries(const Archive *archive, const char *temp_dir, int threads,
+                               size_t *bytes, uint32_t *failed_item) {
+    return extract_entries(archive, 0, archive->file_count, temp_dir, threads, bytes, failed_item);
+}
+
+static int get_decode_threads(void) {
+    return decode_threads > 0 ? decode_threads : pool_default_threads();
+}
+
+// Lazy extraction
+//
+// A core built with a hot set (embed_resources --hot-set) starts with the
+// files most compiles open. For a private tree only those are extracted up
+// front; a forked child writes the rest while the compile already runs.
+// A compile that fails before the child is done is rerun once it finishes
+// (see compile_lazily). A missing file can also change a compile that
+// succeeds: one found instead in a user include directory, or tested with
+// __has_include. Such invocations wait for the whole core (see
+// lazy_compile_safe), so a cold file that was not there yet never shows.
+// The child renames each file into place once written (extract_atomic), so
+// the compile never reads one half-written.
+// memfd trees are excluded: their files only exist in the process that
+// created them.
+static pid_t lazy_pid = -1;
+static int lazy_status = 0;     // exit status of the extractor once reaped
+
+// Records the extractor's exit when a waitpid() elsewhere reaped it.
+// Returns 1 if pid was the extractor.
+static int lazy_reaped(pid_t pid, int status) {
+    if (pid <= 0 || pid != lazy_pid) return 0;
+    lazy_pid = -1;
+    lazy_status = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+    return 1;
+}
+
+static int lazy_pending(void) {
+    int status;
+    if (lazy_pid > 0 && waitpid(lazy_pid, &status, WNOHANG) == lazy_pid) {
+        lazy_reaped(lazy_pid, status);
+    }
+    return lazy_pid > 0;
+}
+
+// Waits for the rest of the core; returns 0 once the whole tree is in place
+static int finish_lazy_extraction(void) {
+    uint64_t start = trace_now();
+    int waited = lazy_pid > 0;
+    while (lazy_pid > 0) {
+        int status;
+        pid_t pid = waitpid(lazy_pid, &status, 0);
+        if (pid == lazy_pid) {
+            lazy_reaped(pid, status);
+        } else if (pid < 0 && errno != EINTR) {
+            lazy_pid = -1;
+            lazy_status = 1;
+        }
+    }
+    if (waited) trace_span("lazy_wait", start, NULL);
+    return lazy_status;
+}
+
+// The tree is about to go away, so the files nobody asked for are not needed
+static void cancel_lazy_extraction(void) {
+    if (lazy_pid > 0) kill(lazy_pid, SIGKILL);
+    finish_lazy_extraction();
+}
+
+// Split static libraries
+//
+// The core stores each lib/X.a as its members plus a symbol index (see
+// staticlib.h). Cached trees and trees with addons get every library
+// written in full with the rest of the core. Other private trees start
+// without them: a link of object files gets archives of just the
+// members its symbols can reach (see run_link), anything else gets the full
+// libraries first. The core stays mapped for that, so a compile that never
+// links never decodes a library member.
+// Symbol name -> u32 table for the link closure. Keys point into library
+// indexes and mapped objects, which outlive the table.
+typedef struct {
+    const char **keys;
+    uint32_t *values;
+    uint32_t capacity;          // power of two
+    uint32_t count;
+} SymbolTable;
+
+static uint32_t symbol_slot(const SymbolTable *t, const char *name) {
+    uint32_t i = (uint32_t)sscc_hash64(name, strlen(name), SSCC_HASH_INIT) & (t->capacity - 1);
+    while (t->keys[i] && strcmp(t->keys[i], name) != 0) i = (i + 1) & (t->capacity - 1);
+    return i;
+}
+
+static int symbol_find(const SymbolTable *t, const char *name, uint32_t *value) {
+    if (!t->capacity) return 0;
+    uint32_t i = symbol_slot(t, name);
+    if (!t->keys[i]) return 0;
+    if (value) *value = t->values[i];
+    return 1;
+}
+
+// Keeps the first value added for a name. Returns 1 if name was added, 0 if
+// it was there already, -1 if out of memory.
+static int symbol_add(SymbolTable *t, const char *name, uint32_t value) {
+    if ((t->count + 1) * 2 > t->capacity) {
+        SymbolTable grown = { NULL, NULL, t->capacity ? t->capacity * 2 : 1024, t->count };
+        grown.keys = calloc(grown.capacity, sizeof(char*));
+        grown.values = malloc(grown.capacity * sizeof(uint32_t));
+        if (!grown.keys || !grown.values) {
+            free(grown.keys);
+            free(grown.values);
+            return -1;
+        }
+        for (uint32_t i = 0; i < t->capacity; i++) {
+            if (!t->keys[i]) continue;
+            uint32_t j = symbol_slot(&grown, t->keys[i]);
+            grown.keys[j] = t->keys[i];
+            grown.values[j] = t->values[i];
+        }
+        free(t->keys);
+        free(t->values);
+        *t = grown;
+    }
+    
+    uint32_t i = symbol_slot(t, name);
+    if (t->keys[i]) return 0;
+    t->keys[i] = name;
+    t->values[i] = value;
+    t->count++;
+    return 1;
+}
+
+static void symbol_table_free(SymbolTable *t) {
+    free(t->keys);
+    free(t->values);
+    memset(t, 0, sizeof(*t));
+}
+
+typedef struct {
+    char name[256];             // X.a
+    char *index_data;
+    StaticLibIndex index;
+    uint32_t *entries;          // core entry of each member
+    SymbolTable symbols;        // symbol -> first member defining it
+} SplitLibrary;
+
+static Archive split_core;
+static SplitLibrary *split_libs;
+static int split_lib_count;
+static int libraries_deferred;  // lib/X.a not written in full yet
+
+static void close_split_libraries(void) {
+    for (int l = 0; l < split_lib_count; l++) {
+        free(split_libs[l].index_data);
+        free(split_libs[l].entries);
+        symbol_table_free(&split_libs[l].symbols);
+    }
+    free(split_libs);
+    split_libs = NULL;
+    split_lib_count = 0;
+    libraries_deferred = 0;
+}
+
+// Finds lib/.members/<name>/index entries, then the members of each
+static int open_split_libraries(const Archive *core) {
+    close_split_libraries();
+    size_t dir_len = strlen(STATICLIB_MEMBER_DIR);
+    size_t index_len = strlen("/" STATICLIB_INDEX_NAME);
+    for (uint32_t i = 0; i < core->file_count; i++) {
+        const ArchiveEntry *e = &core->entries[i];
+        const char *path = archive_path(core, e);
+        size_t name_len = e->path_len - dir_len - index_len;
+        if (!is_library_member(core, i) || e->path_len <= dir_len + index_len ||
+            memcmp(path + e->path_len - index_len, "/" STATICLIB_INDEX_NAME, index_len) != 0 ||
+            name_len >= sizeof(split_libs[0].name)) {
+            continue;
+        }
+        
+        SplitLibrary *libs = realloc(split_libs, (split_lib_count + 1) * sizeof(SplitLibrary));
+        if (!libs) return -1;
+        split_libs = libs;
+        SplitLibrary *lib = &split_libs[split_lib_count];
+        memset(lib, 0, sizeof(*lib));
+        memcpy(lib->name, path + dir_len, name_len);
+        lib->index_data = malloc(e->original_size ? e->original_size : 1);
+        if (!lib->index_data || archive_decode(core, e, lib->index_data) != 0 ||
+            staticlib_open_index(&lib->index, lib->index_data, e->original_size) != 0 ||
+            !(lib->entries = malloc((lib->index.member_count + 1) * sizeof(uint32_t)))) {
+            fprintf(stderr, "Error: Corrupt library index %s\n", path);
+            free(lib->index_data);
+            return -1;
+        }
+        memset(lib->entries, 0xff, lib->index.member_count * sizeof(uint32_t));
+        split_lib_count++;
+    }
+    
+    for (uint32_t i = 0; i < core->file_count && split_lib_count > 0; i++) {
+        const ArchiveEntry *e = &core->entries[i];
+        const char *path = archive_path(core, e);
+        if (!is_library_member(core, i)) continue;
+        
+        const char *slash = memchr(path + dir_len, '/', e->path_len - dir_len);
+        char *end;
+        unsigned long member = slash ? strtoul(slash + 1, &end, 10) : 0;
+        if (!slash || !isdigit((unsigned char)slash[1]) || end != path + e->path_len) continue;
+        for (int l = 0; l < split_lib_count; l++) {
+            SplitLibrary *lib = &split_libs[l];
+            if (strlen(lib->name) == (size_t)(slash - path - dir_len) &&
+                memcmp(lib->name, path + dir_len, slash - path - dir_len) == 0 &&
+                member < lib->index.member_count) {
+                lib->entries[member] = i;
+            }
+        }
+    }
+    
+    for (int l = 0; l < split_lib_count; l++) {
+        for (uint32_t m = 0; m < split_libs[l].index.member_count; m++) {
+            if (split_libs[l].entries[m] == UINT32_MAX) {
+                fprintf(stderr, "Error: Library %s is missing member %u\n", split_libs[l].name, m);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+typedef struct {
+    int library;
+    uint32_t member;
+} MemberRef;
+
+typedef struct {
+    MemberRef *refs;
+    unsigned char ***data;      // data[library][member]
+} MemberDecodeJob;
+
+static int decode_member_task(void *ctx, uint32_t item) {
+    MemberDecodeJob *job = ctx;
+    const MemberRef *ref = &job->refs[item];
+    const ArchiveEntry *e = &split_core.entries[split_libs[ref->library].entries[ref->member]];
+    unsigned char *data = malloc(e->original_size ? e->original_size : 1);
+    if (!data) return EXTRACT_ERR_MEMORY;
+    if (e->codec == ARCHIVE_CODEC_LINK || archive_decode(&split_core, e, data) != 0) {
+        free(data);
+        return EXTRACT_ERR_DECODE;
+    }
+    job->data[ref->library][ref->member] = data;
+    return 0;
+}
+
+// Writes lib/X.a for every split library with selected[l] != NULL, holding
+// the members set in selected[l]; selected == NULL writes every library in
+// full. Members are decoded on the thread pool.
+static int write_libraries(const char *temp_dir, uint8_t *const *selected) {
+    if (split_lib_count <= 0) return 0;
+    
+    uint64_t start = trace_now();
+    uint32_t total = 0;
+    for (int l = 0; l < split_lib_count; l++) total += split_libs[l].index.member_count;
+    
+    MemberDecodeJob job;
+    job.refs = malloc((total + 1) * sizeof(MemberRef));
+    job.data = calloc((unsigned)split_lib_count, sizeof(unsigned char**));
+    uint32_t *sizes = malloc((total + 1) * sizeof(uint32_t));
+    uint32_t *order = malloc((total + 1) * sizeof(uint32_t));
+    int ret = job.refs && job.data && sizes && order ? 0 : EXTRACT_ERR_MEMORY;
+    
+    uint32_t count = 0;
+    for (int l = 0; l < split_lib_count && ret == 0; l++) {
+        SplitLibrary *lib = &split_libs[l];
+        if (selected && !selected[l]) continue;
+        job.data[l] = calloc(lib->index.member_count + 1, sizeof(unsigned char*));
+        if (!job.data[l]) {
+            ret = EXTRACT_ERR_MEMORY;
+            break;
+        }
+        for (uint32_t m = 0; m < lib->index.member_count; m++) {
+            if (selected && !selected[l][m]) continue;
+            job.refs[count].library = l;
+            job.refs[count].member = m;
+            sizes[count] = lib->index.members[m].size;
+            count++;
+        }
+    }
+    
+    uint32_t failed = 0;
+    if (ret == 0) {
+        pool_order_by_size(order, sizes, count);
+        ret = pool_run(count, order, get_decode_threads(), decode_member_task, &job, &failed);
+    }
+    if (ret != 0) {
+        fprintf(stderr, "Error: Failed to extract library %s: %s\n",
+                count ? split_libs[job.refs[failed].library].name : "?", extract_error_string(ret));
+    }
+    trace_span("library_decode", start, NULL);
+    
+    start = trace_now();
+    for (int l = 0; l < split_lib_count && ret == 0; l++) {
+        SplitLibrary *lib = &split_libs[l];
+        if (selected && !selected[l]) continue;
+        
+        unsigned char *archive;
+        size_t archive_size;
+        char path[MAX_PATH];
+        snprintf(path, sizeof(path), "lib/%s", lib->name);
+        if (staticlib_write(&lib->index, (const unsigned char *const *)job.data[l],
+                            selected ? selected[l] : NULL, &archive, &archive_size) != 0) {
+            ret = EXTRACT_ERR_MEMORY;
+        } else {
+            ret = write_tree_file(temp_dir, path, archive, archive_size);
+            free(archive);
+        }
+        if (ret != 0) {
+            fprintf(stderr, "Error: Failed to write %s: %s\n", path, extract_error_string(ret));
+        }
+    }
+    if (ret == 0 && ram_method == 1) {
+        ret = create_memfd_files(temp_dir);
+    }
+    char detail[64];
+    snprintf(detail, sizeof(detail), "%u of %u members", count, total);
+    trace_span("library_write", start, detail);
+    
+    for (int l = 0; l < split_lib_count && job.data; l++) {
+        for (uint32_t m = 0; job.data[l] && m < split_libs[l].index.member_count; m++) {
+            free(job.data[l][m]);
+        }
+        free(job.data[l]);
+    }
+    free(job.data);
+    free(job.refs);
+    free(sizes);
+    free(order);
+    return ret == 0 ? 0 : -1;
+}
+
+// Completes a tree whose libraries were deferred (before addons are loaded,
+// or for a link run_link cannot narrow down)
+static int write_deferred_libraries(const char *temp_dir) {
+    if (!libraries_deferred) return 0;
+    if (write_libraries(temp_dir, NULL) != 0) return -1;
+    libraries_deferred = 0;
+    return 0;
+}
+
+static int extract_core_archive(const char *archive_data, size_t archive_size, const char *temp_dir,
+                                int lazy) {
+    uint64_t start = trace_now();
+    Archive core;
+    if (archive_open(&core, archive_data, archive_size) != 0 || core.kind != ARCHIVE_KIND_CORE) {
+        fprintf(stderr, "Error: Invalid core archive format\n");
+        return -1;
+    }
+    archive_set_index(&core, payload.index, payload.index_size);
+    if (archive_verify(&core) != 0) {
+        fprintf(stderr, "Error: Core archive checksum mismatch\n");
+        archive_close(&core);
+        return -1;
+    }
+    
+    size_t core_ram_used = 0;
+    uint32_t failed;
+    
+    // The hot set ends on a unit boundary: solid blocks never straddle it
+    uint32_t hot_end = core.file_count;
+    if (lazy && core.hot_count > 0 && (ram_method == 2 || ram_method == 3 || ram_method == 5)) {
+        size_t unit_size;
+        hot_end = 0;
+        while (hot_end < core.hot_count) hot_end = archive_unit_end(&core, hot_end, &unit_size);
+    }
+    
+    int ret = extract_entries(&core, 0, hot_end, temp_dir, get_decode_threads(), &core_ram_used, &failed);
+    if (ret == 0 && hot_end < core.file_count) {
+        fflush(stdout);
+        fflush(stderr);
+        lazy_pid = fork();
+        if (lazy_pid == 0) {
+            uint64_t cold_start = trace_now();
+            extract_atomic = 1;
+            ret = extract_entries(&core, hot_end, core.file_count, temp_dir, get_decode_threads(),
+                                  NULL, &failed);
+            if (ret != 0) {
+                fprintf(stderr, "Error: Failed to extract core file %s: %s\n",
+                        archive_path(&core, &core.entries[failed]), extract_error_string(ret));
+            }
+            trace_span("lazy_extract", cold_start, temp_dir);
+            _exit(ret != 0);
+        }
+        if (lazy_pid < 0) {
+            // No background process: extract the rest now
+            size_t cold_ram_used = 0;
+            ret = extract_entries(&core, hot_end, core.file_count, temp_dir, get_decode_threads(),
+                                  &cold_ram_used, &failed);
+            core_ram_used += cold_ram_used;
+            hot_end = core.file_count;
+        }
+    }
+    if (ret != 0) {
+        fprintf(stderr, "Error: Failed to extract core file %s: %s\n",
+                failed < core.file_count ? archive_path(&core, &core.entries[failed]) : "?",
+                extract_error_string(ret));
+        archive_close(&core);
+        return -1;
+    }
+    
+    // Create files for memfd files
+    if (ram_method == 1) {
+        create_memfd_files(temp_dir);
+    }
+    
+    // Static libraries are left for the link unless the tree must be complete
+    if ((extract_phases & PHASE_LIB) && open_split_libraries(&core) != 0) {
+        archive_close(&core);
+        return -1;
+    }
+    split_core = core;
+    libraries_deferred = split_lib_count > 0;
+    if (!lazy && write_deferred_libraries(temp_dir) != 0) {
+        archive_close(&core);
+        return -1;
+    }
+    
+    // Show core summary like addon loading
+    char core_size_str[64];
+    format_bytes(core_ram_used, core_size_str, sizeof(core_size_str));
+    printf("Loading core '%s': %s (%u files)\n", core.name, core.description, core.file_count);
+    if (hot_end < core.file_count) {
+        printf("Core '%s' loaded: %s in RAM (%u hot files, %u more in the background)\n",
+               core.name, core_size_str, hot_end, core.file_count - hot_end);
+    } else {
+        printf("Core '%s' loaded: %s in RAM\n", core.name, core_size_str);
+    }
+    if (libraries_deferred) {
+        printf("Core '%s': %d static libraries written at link time\n", core.name, split_lib_count);
+    }
+    if (extract_phases != PHASE_ALL) {
+        printf("Core '%s': only %s extracted for this invocation\n", core.name,
+               extract_phases == PHASE_INCLUDE ? "include/" : "lib/");
+    }
+    
+    // The libraries decode their members from the core until then
+    if (!libraries_deferred) archive_close(&core);
+    trace_span("extract_core_archive", start, temp_dir);
+    return 0;
+}
+
+// Maps a whole regular file read-only. Returns NULL with errno set on
+// failure; an empty file is reported as EINVAL.
+static const char *map_file(const char *path, size_t *size) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    
+    struct stat st;
+    void *data = MAP_FAILED;
+    if (fstat(fd, &st) == 0) {
+        if (S_ISREG(st.st_mode) && st.st_size > 0) {
+            data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        } else {
+            errno = EINVAL;
+        }
+    }
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    if (data == MAP_FAILED) return NULL;
+    
+    *size = st.st_size;
+    return data;
+}
+
+// Options whose value may be given as the following argument
+static int tcc_option_takes_arg(const char *arg) {
+    static const char *const options[] = {
+        "-o", "-I", "-D", "-U", "-L", "-B", "-l", "-x", "-MF", "-soname",
+        "-isystem", "-include", "-mfloat-abi", NULL
+    };
+    for (int i = 0; options[i]; i++) {
+        if (strcmp(arg, options[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+// Automatic addons
+//
+// Addons found in SSCC_ADDON_PATH (colon-separated directories, by default
+// ../lib/sscc/addons from sscc's own directory, which holds nothing else)
+// are loaded only when an invocation needs them: it
+// links -lNAME and the addon has libNAME, or a source #includes one of the
+// addon's headers. Names the core, a -I or a -L directory already provides
+// never activate an addon. What an addon provides is read from the manifest
+// create_addon writes next to it (see archive_write_manifest), or from its
+// table of contents when the manifest is missing or stale, so unused addons
+// are never mapped. A private tree only gets the headers of an activated
+// addon and the libraries asked for; cached trees get all of it.
+//
+// An addon built with create_addon --dedup-with has links into the addons
+// its manifest "needs": those are activated with it and loaded before it,
+// and give a private tree the targets of its links.
+//
+// Includes are found textually, so an include inside #if counts as well.
+// Headers found next to the including file or in a -I directory are
+// scanned in turn.
+#define AUTO_ADDON_MAX_LIBS 16
+#define INCLUDE_SCAN_MAX_FILES 256
+#define INCLUDE_SCAN_MAX_DEPTH 32
+
+typedef struct {
+    char path[MAX_PATH];
+    char *manifest;             // NUL-terminated manifest text
+    int headers;                // a source includes one of its headers
+    const char *libs[AUTO_ADDON_MAX_LIBS];  // -l names it was activated for
+    int lib_count;
+    char **targets;             // paths links of addons needing it point to
+    int target_count;
+    int listed;                 // already in the load order
+} AutoAddon;
+
+static AutoAddon *auto_addons;
+static int auto_addon_count;
+static int use_auto_addons = 1;
+
+// Iterates the values of the manifest's "kind VALUE" lines: returns the next
+// one (len bytes, not NUL-terminated) or NULL
+static const char *manifest_next(const char **cursor, const char *kind, size_t *len) {
+    size_t kind_len = strlen(kind);
+    while (**cursor) {
+        const char *line = *cursor;
+        const char *end = strchr(line, '\n');
+        size_t line_len = end ? (size_t)(end - line) : strlen(line);
+        *cursor = line + line_len + (end ? 1 : 0);
+        if (line_len > kind_len + 1 && strncmp(line, kind, kind_len) == 0 && line[kind_len] == ' ') {
+            *len = line_len - kind_len - 1;
+            return line + kind_len + 1;
+        }
+    }
+    return NULL;
+}
+
+static int manifest_provides(const char *manifest, const char *kind, const char *name, size_t len) {
+    size_t value_len;
+    for (const char *value; (value = manifest_next(&manifest, kind, &value_len)); ) {
+        if (value_len == len && strncmp(value, name, len) == 0) return 1;
+    }
+    return 0;
+}
+
+// Reads path.manifest, or builds the manifest from the addon's table of
+// contents if there is none or it is stale: older than the addon, or
+// describing a file of another size. Which addons it needs is only known to
+// create_addon, so those lines are kept from a stale manifest.
+static char *read_addon_manifest(const char *path, const struct stat *addon_st) {
+    char manifest_path[MAX_PATH + 16];
+    struct stat st;
+    size_t size;
+    const char *data = NULL;
+    if (snprintf(manifest_path, sizeof(manifest_path), "%s.manifest", path) < (int)sizeof(manifest_path) &&
+        stat(manifest_path, &st) == 0) {
+        data = map_file(manifest_path, &size);
+    }
+    char *text = NULL;
+    if (data) {
+        text = strndup(data, size);
+        munmap((void*)data, size);
+        const char *line = text ? strstr(text, "\nsize ") : NULL;
+        int fresh = st.st_mtim.tv_sec > addon_st->st_mtim.tv_sec ||
+                    (st.st_mtim.tv_sec == addon_st->st_mtim.tv_sec &&
+                     st.st_mtim.tv_nsec >= addon_st->st_mtim.tv_nsec);
+        if (fresh && line && strtoull(line + 6, NULL, 10) == (unsigned long long)addon_st->st_size) return text;
+    }
+    
+    char *needs[64];
+    int need_count = 0;
+    const char *cursor = text ? text : "";
+    size_t len;
+    for (const char *value; need_count < 64 && (value = manifest_next(&cursor, "needs", &len)); ) {
+        if ((needs[need_count] = strndup(value, len))) need_count++;
+    }
+    free(text);
+    
+    char *built = NULL;
+    data = map_file(path, &size);
+    if (data) {
+        size_t built_size = 0;
+        Archive addon;
+        if (archive_open(&addon, data, size) == 0) {
+            FILE *out = addon.kind == ARCHIVE_KIND_ADDON ? open_memstream(&built, &built_size) : NULL;
+            if (out) {
+                int ret = archive_write_manifest(&addon, (const char *const *)needs, need_count, out);
+                fclose(out);
+                if (ret != 0) {
+                    free(built);
+                    built = NULL;
+                }
+            }
+            archive_close(&addon);
+        }
+        munmap((void*)data, size);
+    }
+    for (int i = 0; i < need_count; i++) free(needs[i]);
+    return built;
+}
+
+// SSCC_ADDON_PATH, or its default in buffer; NULL if there is none
+static const char *addon_search_path(char *buffer, size_t size) {
+    const char *search = getenv("SSCC_ADDON_PATH");
+    if (search) return search;
+    
+    ssize_t n = readlink("/proc/self/exe", buffer, size - 1);
+    if (n <= 0) return NULL;
+    buffer[n] = '\0';
+    char *slash = strrchr(buffer, '/');
+    if (!slash || (size_t)(slash - buffer) + sizeof("/../lib/sscc/addons") > size) return NULL;
+    memcpy(slash, "/../lib/sscc/addons", sizeof("/../lib/sscc/addons"));
+    return buffer;
+}
+
+// Every *.addon of the search path, in path order and by name within a
+// directory, except files already given with --addon
+static void find_auto_addons(char **addon_files, int addon_count) {
+    char self_dir[MAX_PATH];
+    const char *search = addon_search_path(self_dir, sizeof(self_dir));
+    if (!search) return;
+    
+    struct stat given[64];
+    for (int i = 0; i < addon_count; i++) {
+        if (stat(addon_files[i], &given[i]) != 0) memset(&given[i], 0, sizeof(given[i]));
+    }
+    
+    char *dirs = strdup(search);
+    char *saveptr = NULL;
+    for (char *dir = dirs ? strtok_r(dirs, ":", &saveptr) : NULL; dir; dir = strtok_r(NULL, ":", &saveptr)) {
+        struct dirent **names;
+        int count = scandir(dir, &names, NULL, alphasort);
+        if (count < 0) continue;
+        for (int n = 0; n < count; n++) {
+            const char *name = names[n]->d_name;
+            size_t len = strlen(name);
+            char path[MAX_PATH];
+            struct stat st;
+            if (len <= 6 || strcmp(name + len - 6, ".addon") != 0 ||
+                snprintf(path, sizeof(path), "%s/%s", dir, name) >= (int)sizeof(path) ||
+                stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+                continue;
+            }
+            int seen = 0;
+            for (int i = 0; i < addon_count && !seen; i++) {
+                seen = given[i].st_ino == st.st_ino && given[i].st_dev == st.st_dev;
+            }
+            for (int i = 0; i < auto_addon_count && !seen; i++) {
+                seen = strcmp(auto_addons[i].path, path) == 0;
+            }
+            char *manifest = seen ? NULL : read_addon_manifest(path, &st);
+            AutoAddon *grown = manifest ? realloc(auto_addons, (auto_addon_count + 1) * sizeof(AutoAddon)) : NULL;
+            if (!grown) {
+                free(manifest);
+                continue;
+            }
+            auto_addons = grown;
+            AutoAddon *a = &auto_addons[auto_addon_count++];
+            memset(a, 0, sizeof(*a));
+            snprintf(a->path, sizeof(a->path), "%s", path);
+            a->manifest = manifest;
+        }
+        for (int n = 0; n < count; n++) free(names[n]);
+        free(names);
+    }
+    free(dirs);
+}
+
+typedef struct {
+    char *names[INCLUDE_SCAN_MAX_FILES];    // includes no local file satisfies
+    int name_count;
+    char *visited[INCLUDE_SCAN_MAX_FILES];
+    int visited_count;
+    char **dirs;                // -I directories
+    int dir_count;
+    int has_include;            // a scanned file uses __has_include(_next)
+} IncludeScan;
+
+// For "..." next to the including file, then in the -I directories
+static int find_local_header(const IncludeScan *scan, const char *from, const char *name, int quoted,
+                             char *path, size_t size) {
+    if (quoted) {
+        const char *slash = strrchr(from, '/');
+        if (snprintf(path, size, "%.*s%s", slash ? (int)(slash - from + 1) : 0, from, name) < (int)size &&
+            access(path, R_OK) == 0) {
+            return 1;
+        }
+    }
+    for (int i = 0; i < scan->dir_count; i++) {
+        if (snprintf(path, size, "%s/%s", scan->dirs[i], name) < (int)size && access(path, R_OK) == 0) return 1;
+    }
+    return 0;
+}
+
+static void scan_includes(IncludeScan *scan, const char *path, int depth) {
+    for (int i = 0; i < scan->visited_count; i++) {
+        if (strcmp(scan->visited[i], path) == 0) return;
+    }
+    if (depth > INCLUDE_SCAN_MAX_DEPTH || scan->visited_count == INCLUDE_SCAN_MAX_FILES) return;
+    scan->visited[scan->visited_count] = strdup(path);
+    if (!scan->visited[scan->visited_count]) return;
+    scan->visited_count++;
+    
+    size_t size;
+    const char *src = map_file(path, &size);
+    if (!src) return;
+    if (memmem(src, size, "__has_include", 13)) scan->has_include = 1;
+    for (const char *line = src, *limit = src + size; line < limit; ) {
+        const char *end = memchr(line, '\n', limit - line);
+        if (!end) end = limit;
+        const char *p = line;
+        line = end + 1;
+        
+        while (p < end && (*p == ' ' || *p == '\t')) p++;
+        if (p == end || *p != '#') continue;
+        for (p++; p < end && (*p == ' ' || *p == '\t'); p++);
+        if (end - p < 8 || strncmp(p, "include", 7) != 0 || (p[7] != ' ' && p[7] != '\t' &&
+                                                           p[7] != '<' && p[7] != '"')) {
+            continue;
+        }
+        for (p += 7; p < end && (*p == ' ' || *p == '\t'); p++);
+        if (p == end || (*p != '<' && *p != '"')) continue;
+        char close = *p == '<' ? '>' : '"';
+        const char *name = ++p;
+        while (p < end && *p != close) p++;
+        if (p == end || p == name || p - name >= MAX_PATH / 2) continue;
+        
+        char include[MAX_PATH], local[MAX_PATH];
+        snprintf(include, sizeof(include), "%.*s", (int)(p - name), name);
+        if (find_local_header(scan, path, include, close == '"', local, sizeof(local))) {
+            scan_includes(scan, local, depth + 1);
+        } else if (scan->name_count < INCLUDE_SCAN_MAX_FILES) {
+            scan->names[scan->name_count] = strdup(include);
+            if (scan->names[scan->name_count]) scan->name_count++;
+        }
+    }
+    munmap((void*)src, size);
+}
+
+// Whether a compile may start before the cold part of the core is in place
+// (see Lazy extraction). A missing header only makes it fail and be rerun,
+// but a header of the same name in a user include directory, or a
+// __has_include test, lets it succeed with other output instead. So it
+// waits for the whole core if the invocation has include directories of its
+// own, or if its sources, the local headers they include or a -include file
+// use __has_include; the core's own headers do not.
+static int lazy_compile_safe(int argc, char **args, const char *script) {
+    static const char *const environment[] = { "CPATH", "C_INCLUDE_PATH", NULL };
+    for (int i = 0; environment[i]; i++) {
+        const char *value = getenv(environment[i]);
+        if (value && *value) return 0;
+    }
+    
+    IncludeScan *scan = calloc(1, sizeof(IncludeScan));
+    if (!scan) return 0;
+    int safe = 1;
+    for (int i = 1; i < argc && safe; i++) {
+        const char *arg = args[i];
+        if (strncmp(arg, "-I", 2) == 0 || strncmp(arg, "-isystem", 8) == 0 ||
+            strncmp(arg, "-iquote", 7) == 0 || strncmp(arg, "-idirafter", 10) == 0) {
+            safe = 0;
+        } else if (strcmp(arg, "-include") == 0 && i + 1 < argc) {
+            scan_includes(scan, args[++i], 0);
+        } else if (arg[0] != '-') {
+            const char *ext = strrchr(arg, '.');
+            if (ext && (strcmp(ext, ".c") == 0 || strcmp(ext, ".h") == 0)) scan_includes(scan, arg, 0);
+        } else if (tcc_option_takes_arg(arg) && i + 1 < argc) {
+            i++;
+        }
+    }
+    if (safe && script) scan_includes(scan, script, 0);
+    safe = safe && !scan->has_include && scan->visited_count < INCLUDE_SCAN_MAX_FILES;
+    
+    for (int n = 0; n < scan->name_count; n++) free(scan->names[n]);
+    for (int n = 0; n < scan->visited_count; n++) free(scan->visited[n]);
+    free(scan);
+    return safe;
+}
+
+static int library_in(const Archive *core, char **dirs, int dir_count, const char *name) {
+    char path[MAX_PATH];
+    snprintf(path, sizeof(path), "lib/lib%.200s.a", name);
+    if (archive_find(core, path) >= 0) return 1;
+    snprintf(path, sizeof(path), "lib/lib%.200s.so", name);
+    if (archive_find(core, path) >= 0) return 1;
+    snprintf(path, sizeof(path), "%slib%.200s.a/%s", STATICLIB_MEMBER_DIR, name, STATICLIB_INDEX_NAME);
+    if (archive_find(core, path) >= 0) return 1;
+    for (int i = 0; i < dir_count; i++) {
+        snprintf(path, sizeof(path), "%s/lib%.200s.a", dirs[i], name);
+        if (access(path, R_OK) == 0) return 1;
+        snprintf(path, sizeof(path), "%s/lib%.200s.so", dirs[i], name);
+        if (access(path, R_OK) == 0) return 1;
+    }
+    return 0;
+}
+
+static int same_file_name(const char *path, const char *name, size_t len) {
+    const char *slash = strrchr(path, '/');
+    const char *base = slash ? slash + 1 : path;
+    return strlen(base) == len && strncmp(base, name, len) == 0;
+}
+
+static AutoAddon *auto_addon_named(const char *name, size_t len) {
+    for (int a = 0; a < auto_addon_count; a++) {
+        if (same_file_name(auto_addons[a].path, name, len)) return &auto_addons[a];
+    }
+    return NULL;
+}
+
+// Appends an activated addon to addon_files after the addons it needs. Those
+// are in the search path, or among the first `given` (--addon) files, which
+// are loaded whole and first anyway. create_addon only links to addons that
+// exist already, so there are no cycles; listed guards against edited
+// manifests all the same.
+static void list_auto_addon(AutoAddon *addon, char **addon_files, int *addon_count, int given) {
+    if (addon->listed) return;
+    addon->listed = 1;
+    
+    const char *cursor = addon->manifest, *name;
+    size_t len;
+    while ((name = manifest_next(&cursor, "needs", &len))) {
+        AutoAddon *need = auto_addon_named(name, len);
+        if (need) {
+            list_auto_addon(need, addon_files, addon_count, given);
+            continue;
+        }
+        int found = 0;
+        for (int i = 0; i < given && !found; i++) found = same_file_name(addon_files[i], name, len);
+        if (!found) {
+            fprintf(stderr, "Warning: Addon %s needs %.*s, which is not in the addon path\n",
+                    addon->path, (int)len, name);
+        }
+    }
+    if (*addon_count < 64) addon_files[(*addon_count)++] = addon->path;
+}
+
+static uint8_t *select_addon_entries(const Archive *addon, const AutoAddon *needs);
+
+static void add_link_target(AutoAddon *addon, const char *target) {
+    for (int t = 0; t < addon->target_count; t++) {
+        if (strcmp(addon->targets[t], target) == 0) return;
+    }
+    char **grown = realloc(addon->targets, (addon->target_count + 1) * sizeof(char*));
+    if (!grown) return;
+    addon->targets = grown;
+    if ((grown[addon->target_count] = strdup(target))) addon->target_count++;
+}
+
+// Hands the targets of the links a private tree gets from each activated
+// addon to the addons it needs. Walking the load order backwards, an
+// addon has its own targets from later addons before its links are read.
+static void collect_link_targets(char **addon_files, int first, int count) {
+    for (int k = count - 1; k >= first; k--) {
+        AutoAddon *addon = NULL;
+        for (int a = 0; a < auto_addon_count && !addon; a++) {
+            if (auto_addons[a].path == addon_files[k]) addon = &auto_addons[a];
+        }
+        const char *cursor = addon ? addon->manifest : "";
+        size_t len;
+        if (!manifest_next(&cursor, "needs", &len)) continue;
+        
+        size_t size;
+        const char *data = map_file(addon->path, &size);
+        Archive archive;
+        if (!data) continue;
+        if (archive_open(&archive, data, size) != 0) {
+            munmap((void*)data, size);
+            continue;
+        }
+        uint8_t *selection = select_addon_entries(&archive, addon);
+        for (uint32_t i = 0; selection && i < archive.file_count; i++) {
+            char target[MAX_PATH];
+            if (!selection[i] || archive_link_target(&archive, &archive.entries[i], target, sizeof(target)) != 0 ||
+                archive_find(&archive, target) >= 0) {
+                continue;
+            }
+            // Every addon it needs gets the path; those without it ignore it
+            cursor = addon->manifest;
+            for (const char *name; (name = manifest_next(&cursor, "needs", &len)); ) {
+                AutoAddon *need = auto_addon_named(name, len);
+                if (need) add_link_target(need, target);
+            }
+        }
+        free(selection);
+        archive_close(&archive);
+        munmap((void*)data, size);
+    }
+}
+
+// Appends the addons this invocation needs (sources and -l options in
+// args, plus the --run script) to addon_files, each after the addons it
+// needs
+static void activate_auto_addons(int argc, char **args, const char *script,
+                                 char **addon_files, int *addon_count) {
+    find_auto_addons(addon_files, *addon_count);
+    if (auto_addon_count == 0) return;
+    
+    Archive core;
+    if (archive_open(&core, payload.core, payload.core_size) != 0) return;
+    archive_set_index(&core, payload.index, payload.index_size);
+    
+    // Directories first: -I and -L may follow the files they apply to
+    IncludeScan *scan = calloc(1, sizeof(IncludeScan));
+    char **include_dirs = calloc(argc + 1, sizeof(char*));
+    char **lib_dirs = calloc(argc + 1, sizeof(char*));
+    int lib_dir_count = 0;
+    if (!scan || !include_dirs || !lib_dirs) {
+        free(scan);
+        free(include_dirs);
+        free(lib_dirs);
+        archive_close(&core);
+        return;
+    }
+    scan->dirs = include_dirs;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(args[i], "-I", 2) == 0 || strncmp(args[i], "-L", 2) == 0) {
+            const char *dir = args[i][2] ? args[i] + 2 : (i + 1 < argc ? args[i + 1] : NULL);
+            if (dir && args[i][1] == 'I') include_dirs[scan->dir_count++] = (char*)dir;
+            if (dir && args[i][1] == 'L') lib_dirs[lib_dir_count++] = (char*)dir;
+        }
+    }
+    
+    for (int i = 1; i < argc; i++) {
+        const char *arg = args[i];
+        if (strncmp(arg, "-l", 2) == 0) {
+            const char *name = arg[2] ? arg + 2 : (i + 1 < argc ? args[++i] : NULL);
+            if (!name || library_in(&core, lib_dirs, lib_dir_count, name)) continue;
+            for (int a = 0; a < auto_addon_count; a++) {
+                AutoAddon *addon = &auto_addons[a];
+                if (addon->lib_count < AUTO_ADDON_MAX_LIBS &&
+                    manifest_provides(addon->manifest, "lib", name, strlen(name))) {
+                    addon->libs[addon->lib_count++] = name;
+                }
+            }
+        } else if (arg[0] != '-') {
+            const char *ext = strrchr(arg, '.');
+            if (ext && (strcmp(ext, ".c") == 0 || strcmp(ext, ".h") == 0)) scan_includes(scan, arg, 0);
+        } else if (tcc_option_takes_arg(arg) && i + 1 < argc) {
+            i++;
+        }
+    }
+    if (script) scan_includes(scan, script, 0);
+    
+    for (int n = 0; n < scan->name_count; n++) {
+        const char *name = scan->names[n];
+        char path[MAX_PATH];
+        snprintf(path, sizeof(path), "include/%s", name);
+        if (archive_find(&core, path) >= 0) continue;
+        
+        // Headers are listed by their first path component
+        const char *slash = strchr(name, '/');
+        size_t len = slash ? (size_t)(slash - name) + 1 : strlen(name);
+        for (int a = 0; a < auto_addon_count; a++) {
+            if (manifest_provides(auto_addons[a].manifest, "include", name, len)) auto_addons[a].headers = 1;
+        }
+    }
+    
+    int given = *addon_count;
+    for (int a = 0; a < auto_addon_count; a++) {
+        if (auto_addons[a].headers || auto_addons[a].lib_count > 0) {
+            list_auto_addon(&auto_addons[a], addon_files, addon_count, given);
+        }
+    }
+    collect_link_targets(addon_files, given, *addon_count);
+    
+    for (int n = 0; n < scan->name_count; n++) free(scan->names[n]);
+    for (int n = 0; n < scan->visited_count; n++) free(scan->visited[n]);
+    free(scan);
+    free(include_dirs);
+    free(lib_dirs);
+    archive_close(&core);
+}
+
+static const AutoAddon *auto_addon_for(const char *path) {
+    for (int a = 0; a < auto_addon_count; a++) {
+        if (auto_addons[a].path == path) return &auto_addons[a];
+    }
+    return NULL;
+}
+
+// The entries of an activated addon an invocation reads: its headers if
+// any was included (they include each other), the libraries it was
+// activated for, the targets of links among them and those of links of
+// the addons that need it
+static uint8_t *select_addon_entries(const Archive *addon, const AutoAddon *needs) {
+    uint8_t *selection = calloc(addon->file_count + 1, 1);
+    if (!selection) return NULL;
+    
+    for (uint32_t i = 0; i < addon->file_count; i++) {
+        const char *path = archive_path(addon, &addon->entries[i]);
+        if (needs->headers && strncmp(path, "include/", 8) == 0) selection[i] = 1;
+        for (int l = 0; l < needs->lib_count && !selection[i]; l++) {
+            size_t len = strlen(needs->libs[l]);
+            const char *ext = path + 7 + len;
+            selection[i] = strncmp(path, "lib/lib", 7) == 0 && strncmp(path + 7, needs->libs[l], len) == 0 &&
+                           (strcmp(ext, ".a") == 0 ||
+                            (strncmp(ext, ".so", 3) == 0 && (ext[3] == '\0' || ext[3] == '.')));
+        }
+    }
+    for (int t = 0; t < needs->target_count; t++) {
+        int j = archive_find(addon, needs->targets[t]);
+        if (j >= 0) selection[j] = 1;
+    }
+    for (uint32_t i = 0; i < addon->file_count; i++) {
+        char target[MAX_PATH];
+        if (!selection[i] || addon->entries[i].codec != ARCHIVE_CODEC_LINK ||
+            archive_link_target(addon, &addon->entries[i], target, sizeof(target)) != 0) {
+            continue;
+        }
+        int j = archive_find(addon, target);
+        if (j >= 0) selection[j] = 1;
+    }
+    return selection;
+}
+
+// Addons are decoded straight out of a read-only mapping: the pages are
+// faulted in by the decoder threads (prefetched by the kernel) and there is
+// no intermediate copy of the compressed data
+static int load_addon_file(const char *addon_path, const char *temp_dir, const AutoAddon *needs) {
+    size_t file_size;
+    const char *data = map_file(addon_path, &file_size);
+    if (!data) {
+        fprintf(stderr, "Warning: Cannot open addon file %s: %s\n", addon_path, strerror(errno));
+        return -1;
+    }
+    madvise((void*)data, file_size, MADV_WILLNEED);
+    
+    // Both v2 addons and existing v1 ("ADDON") files are accepted
+    Archive addon;
+    if (archive_open(&addon, data, file_size) != 0 || addon.kind != ARCHIVE_KIND_ADDON) {
+        fprintf(stderr, "Warning: Invalid addon file format: %s\n", addon_path);
+        munmap((void*)data, file_size);
+        return -1;
+    }
+    if (archive_verify(&addon) != 0) {
+        fprintf(stderr, "Warning: Addon file is corrupt (checksum mismatch): %s\n", addon_path);
+        archive_close(&addon);
+        munmap((void*)data, file_size);
+        return -1;
+    }
+    
+    printf("Loading addon '%s': %s (%u files)\n", addon.name, addon.description, addon.file_count);
+    
+    // An automatically activated addon only contributes what was asked for
+    uint8_t *selection = needs ? select_addon_entries(&addon, needs) : NULL;
+    if (selection) {
+        uint32_t selected = 0;
+        for (uint32_t i = 0; i < addon.file_count; i++) selected += selection[i];
+        const char *sep = " ";
+        printf("Addon '%s': activated for", addon.name);
+        if (needs->headers) {
+            printf("%sits headers", sep);
+            sep = ", ";
+        }
+        for (int l = 0; l < needs->lib_count; l++) {
+            printf("%s-l%s", sep, needs->libs[l]);
+            sep = ", ";
+        }
+        if (needs->target_count > 0 || (!needs->headers && needs->lib_count == 0)) {
+            printf("%sthe addons that need it", sep);
+        }
+        printf(" (%u of %u files needed)\n", selected, addon.file_count);
+    }
+    
+    size_t addon_ram_used = 0;
+    uint32_t failed;
+    
+    // Extract files; a broken entry is skipped like before, but reported
+    entry_selection = selection;
+    int ret = extract_all_entries(&addon, temp_dir, get_decode_threads(), &addon_ram_used, &failed);
+    entry_selection = NULL;
+    free(selection);
+    if (ret != 0) {
+        fprintf(stderr, "Warning: Cannot extract %s from addon '%s': %s\n",
+                failed < addon.file_count ? archive_path(&addon, &addon.entries[failed]) : "?",
+                addon.name, extract_error_string(ret));
+    }
+    
+    // Show addon summary
+    if (use_ram_filesystem && addon_ram_used > 0) {
+        char addon_size_str[64];
+        format_bytes(addon_ram_used, addon_size_str, sizeof(addon_size_str));
+        printf("Addon '%s' loaded: %s in RAM\n", addon.name, addon_size_str);
+    }
+    
+    archive_close(&addon);
+    munmap((void*)data, file_size);
+    return 0;
+}
+
+// --sscc-list-addon: everything shown comes from the table of contents, so
+// no payload is decoded or even paged in
+static int list_addon(const char *addon_path) {
+    size_t file_size;
+    const char *data = map_file(addon_path, &file_size);
+    if (!data) {
+        fprintf(stderr, "Error: Cannot open addon file %s: %s\n", addon_path, strerror(errno));
+        return 1;
+    }
+    
+    Archive addon;
+    if (archive_open(&addon, data, file_size) != 0 || addon.kind != ARCHIVE_KIND_ADDON) {
+        fprintf(stderr, "Error: Invalid addon file format: %s\n", addon_path);
+        munmap((void*)data, file_size);
+        return 1;
+    }
+    
+    printf("Addon '%s': %s\n", addon.name, addon.description);
+    printf("Format v%d, %u files", addon.version, addon.file_count);
+    if (addon.hot_count > 0) printf(", the first %u hot", addon.hot_count);
+    printf("\n");
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < addon.file_count; i++) {
+        const ArchiveEntry *e = &addon.entries[i];
+        char target[MAX_PATH];
+        if (archive_link_target(&addon, e, target, sizeof(target)) == 0) {
+            printf("%10u  %-6s  %s -> %s\n", e->original_size, archive_codec_name(e->codec),
+                   archive_path(&addon, e), target);
+            total += e->original_size;
+            continue;
+        }
+        printf("%10u  %-6s  %s\n", e->original_size, archive_codec_name(e->codec), archive_path(&addon, e));
+        total += e->original_size;
+    }
+    printf("%10llu  total (%zu bytes on disk)\n", (unsigned long long)total, file_size);
+    
+    archive_close(&addon);
+    munmap((void*)data, file_size);
+    return 0;
+}
+
+// Addons given with --addon are extracted whole, and so are automatic ones
+// when the tree must be complete (cached trees)
+static void load_addons(const char *temp_dir, char **addon_files, int addon_count, int complete) {
+    uint64_t start = trace_now();
+    
+    for (int i = 0; i < addon_count; i++) {
+        uint64_t addon_start = trace_now();
+        load_addon_file(addon_files[i], temp_dir, complete ? NULL : auto_addon_for(addon_files[i]));
+        
+        // Create files for memfd addon files; later addons may link to them
+        if (ram_method == 1) {
+            create_memfd_files(temp_dir);
+        }
+        trace_span("load_addon", addon_start, addon_files[i]);
+    }
+    trace_span("load_addons", start, NULL);
+}
+
+// Removes name (relative to parent_fd) and everything below it. Entries are
+// unlinked relative to their directory's descriptor, so no path is resolved
+// twice and names with spaces or leading dashes need no quoting.
+static void remove_tree_at(int parent_fd, const char *name) {
+    int fd = openat(parent_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd >= 0) {
+        DIR *dir = fdopendir(fd);
+        if (dir) {
+            struct dirent *ent;
+            while ((ent = readdir(dir)) != NULL) {
+                if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
+                if (ent->d_type == DT_DIR ||
+                    (unlinkat(fd, ent->d_name, 0) != 0 && errno == EISDIR)) {
+                    remove_tree_at(fd, ent->d_name);
+                }
+            }
+            closedir(dir);
+        } else {
+            close(fd);
+        }
+    }
+    unlinkat(parent_fd, name, AT_REMOVEDIR);
+}
+
+static void cleanup_temp_dir(const char *temp_dir) {
+    uint64_t start = trace_now();
     if (use_ram_filesystem) {
         // Cleanup memfd files
         cleanup_memfd_files();
     }
     
-    // Remove the directory (works for all methods)
-    char cmd[MAX_PATH + 20];
-    snprintf(cmd, sizeof(cmd), "rm -rf %s", temp_dir);
-    system(cmd);
+    // A private tmpfs goes away with its last descriptor
+    if (tmpfs_root_fd >= 0) {
+        close(tmpfs_root_fd);
+        tmpfs_root_fd = -1;
+        trace_span("cleanup_temp_dir", start, temp_dir);
+        return;
+    }
+    
+    // Otherwise remove the tree off the exit path so tcc's status is
+    // returned at once. The remover gets its own session and /dev/null for
+    // stdio: it must neither die with our terminal's ^C nor keep a pipe
+    // open that our caller reads to EOF.
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid == 0) {
+        setsid();
+        int null_fd = open("/dev/null", O_RDWR);
+        if (null_fd >= 0) {
+            dup2(null_fd, STDIN_FILENO);
+            dup2(null_fd, STDOUT_FILENO);
+            dup2(null_fd, STDERR_FILENO);
+        }
+        remove_tree_at(AT_FDCWD, temp_dir);
+        _exit(0);
+    }
+    if (pid < 0) {
+        remove_tree_at(AT_FDCWD, temp_dir);
+    }
+    trace_span("cleanup_temp_dir", start, temp_dir);
+}
+
+
+static int write_tcc_binary(const char *dir, char *tcc_path, size_t tcc_path_size) {
+    snprintf(tcc_path, tcc_path_size, "%s/tcc", dir);
+    
+    // Written under a temporary name and renamed, so parallel jobs falling
+    // back to disk never exec a half-written binary
+    char temp_path[MAX_PATH];
+    snprintf(temp_path, sizeof(temp_path), "%s/tcc.XXXXXX", dir);
+    int fd = mkstemp(temp_path);
+    FILE *tcc_file = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    if (!tcc_file) {
+        if (fd >= 0) close(fd);
+        fprintf(stderr, "Error: Cannot create TCC binary at %s\n", tcc_path);
+        return -1;
+    }
+    fwrite(payload.tcc, 1, payload.tcc_size, tcc_file);
+    fchmod(fd, 0755); // Make executable
+    if (fclose(tcc_file) != 0 || rename(temp_path, tcc_path) != 0) {
+        unlink(temp_path);
+        fprintf(stderr, "Error: Cannot create TCC binary at %s\n", tcc_path);
+        return -1;
+    }
+    
+    // Track TCC binary size
+    track_file_size(tcc_path, payload.tcc_size);
+    return 0;
+}
+
+// Load the embedded TCC binary into a sealed memfd so it can be run with
+// fexecve without ever existing on a filesystem. Returns -1 where memfd or
+// sealing is unavailable; callers then fall back to write_tcc_binary.
+static int create_tcc_memfd() {
+#ifdef __linux__
+    int fd = memfd_create("tcc", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        return -1;
+    }
+    
+    size_t written = 0;
+    while (written < payload.tcc_size) {
+        ssize_t n = write(fd, payload.tcc + written, payload.tcc_size - written);
+        if (n <= 0) {
+            close(fd);
+            return -1;
+        }
+        written += n;
+    }
+    
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+#else
+    return -1;
+#endif
+}
+
+// Runs in the forked child: exec TCC from its memfd if there is one, else
+// from disk, writing it out first if the memfd exec was refused (no /proc,
+// noexec policies)
+static void exec_tcc(int tcc_fd, const char *dir, char *tcc_path, size_t tcc_path_size, char **tcc_args) {
+    if (tcc_fd >= 0) {
+        fexecve(tcc_fd, tcc_args, environ);
+        if (write_tcc_binary(dir, tcc_path, tcc_path_size) != 0) {
+            exit(1);
+        }
+    }
+    execv(tcc_path, tcc_args);
+}
+
+// Persistent extraction cache
+//
+// Extracted trees live in <cache_root>/v<key>, where the key hashes the core
+// archive, the TCC binary and the contents of every loaded addon. A tree is
+// populated in a private v<key>.tmpXXXXXX directory and renamed into place,
+// so its presence means it is complete. v<key>.lock serializes population
+// (exclusive flock) and marks the tree as in use (shared flock) so that the
+// garbage collector never removes a tree under a running compile.
+#define CACHE_TOUCH_INTERVAL 3600       // Refresh last-use stamp at most hourly
+#define CACHE_DEFAULT_MAX_AGE_DAYS 30
+
+static int get_cache_root(char *root, size_t root_size) {
+    const char *dir = getenv("SSCC_CACHE_DIR");
+    if (dir && *dir) {
+        snprintf(root, root_size, "%s", dir);
+        return 0;
+    }
+    
+    dir = getenv("XDG_CACHE_HOME");
+    if (dir && *dir) {
+        snprintf(root, root_size, "%s/sscc", dir);
+        return 0;
+    }
+    
+    dir = getenv("HOME");
+    if (dir && *dir) {
+        snprintf(root, root_size, "%s/.cache/sscc", dir);
+        return 0;
+    }
+    
+    return -1;
+}
+
+static int hash_file(const char *path, uint64_t *hash) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    
+    char buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+        *hash = sscc_hash64(buffer, n, *hash);
+    }
+    
+    int failed = ferror(f);
+    fclose(f);
+    return failed ? -1 : 0;
+}
+
+// Stands in for hash_file where reading the whole file would cost too much
+// (addons, addon directories): mixes its device, inode, size and mtime into
+// *hash. Rebuilding or copying over a file changes its mtime, so this tells
+// versions apart as a content hash would. A missing path has an identity as
+// well, so one created later shows.
+static int file_identity(const char *path, uint64_t *hash) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        if (errno != ENOENT) return -1;
+        *hash = sscc_hash64("missing", 7, *hash);
+        return 0;
+    }
+    *hash = sscc_hash_u64(st.st_dev, *hash);
+    *hash = sscc_hash_u64(st.st_ino, *hash);
+    *hash = sscc_hash_u64(st.st_size, *hash);
+    *hash = sscc_hash_u64(st.st_mtim.tv_sec, *hash);
+    *hash = sscc_hash_u64(st.st_mtim.tv_nsec, *hash);
+    return 0;
+}
+
+// What every key starts from: this sscc, its core and its TCC
+static uint64_t payload_key(uint64_t core_hash, uint64_t tcc_hash) {
+    uint64_t h = SSCC_HASH_INIT;
+    h = sscc_hash64(SSCC_VERSION, strlen(SSCC_VERSION), h);
+    h = sscc_hash_u64(core_hash, h);
+    return sscc_hash_u64(tcc_hash, h);
+}
+
+// payload_key() from the trailer alone, for paths that must not map the
+// payload (the server client, run cache hits): one pread
+static int trailer_key(uint64_t *key) {
+    static uint64_t cached = 0;
+    if (!cached) {
+        PayloadTrailer t;
+        int fd = open("/proc/self/exe", O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return -1;
+        int ret = payload_read_trailer(fd, &t);
+        close(fd);
+        if (ret != 0) return -1;
+        cached = payload_key(t.core_hash, t.tcc_hash);
+    }
+    *key = cached;
+    return 0;
+}
+
+static int compute_cache_key(char **addon_files, int addon_count, uint64_t *key) {
+    uint64_t h = payload_key(payload.core_hash, payload.tcc_hash);
+    
+    // Addons are keyed by identity, in load order, since later addons may
+    // overwrite files from earlier ones. Every compile and server request
+    // computes this key, so addons are not read in full.
+    for (int i = 0; i < addon_count; i++) {
+        if (access(addon_files[i], R_OK) != 0 || file_identity(addon_files[i], &h) != 0) {
+            return -1;
+        }
+    }
+    
+    *key = h;
+    return 0;
+}
+
+static int make_readonly_cb(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    (void)ftw;
+    if (type == FTW_F) {
+        chmod(path, (st->st_mode & 0111) ? 0555 : 0444);
+    } else if (type == FTW_DP) {
+        chmod(path, 0555);
+    }
+    return 0;
+}
+
+static int make_writable_cb(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    (void)st; (void)ftw;
+    if (type == FTW_D) {
+        chmod(path, 0755);
+    }
+    return 0;
+}
+
+static int remove_entry_cb(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    (void)st; (void)ftw;
+    if (type == FTW_DP) {
+        rmdir(path);
+    } else {
+        unlink(path);
+    }
+    return 0;
+}
+
+static void remove_cache_tree(const char *dir) {
+    // Cached trees are read-only, so reopen directories before unlinking
+    nftw(dir, make_writable_cb, 16, FTW_PHYS);
+    nftw(dir, remove_entry_cb, 16, FTW_PHYS | FTW_DEPTH);
+}
+
+static int populate_cache_tree(const char *dir, char **addon_files, int addon_count) {
+    // Cached trees are always plain files, never memfd-backed
+    int saved_method = ram_method;
+    ram_method = 4;
+    
+    char tcc_path[MAX_PATH];
+    if (extract_core_archive((const char*)payload.core, payload.core_size, dir, 0) != 0 ||
+        write_tcc_binary(dir, tcc_path, sizeof(tcc_path)) != 0) {
+        ram_method = saved_method;
+        return -1;
+    }
+    load_addons(dir, addon_files, addon_count, 1);
+    
+    nftw(dir, make_readonly_cb, 16, FTW_PHYS | FTW_DEPTH);
+    ram_method = saved_method;
+    return 0;
+}
+
+// cache_gc unlinks the lock files of the trees it evicts, and flock()
+// conversions are not atomic, so a lock may end up held on a file that no
+// longer has a name and protects nothing. Returns 1 when that happened and
+// the caller has to open the lock file again.
+static int cache_lock(int fd, const char *lock_path, int op) {
+    struct stat held, named;
+    if (flock(fd, op) != 0 || fstat(fd, &held) != 0) return -1;
+    if (stat(lock_path, &named) != 0 || held.st_dev != named.st_dev || held.st_ino != named.st_ino) {
+        return 1;
+    }
+    return 0;
+}
+
+// key is compute_cache_key() for the same addons
+static int cache_acquire(char *tree_dir, uint64_t key, char **addon_files, int addon_count, int *lock_fd) {
+    char root[MAX_PATH];
+    if (get_cache_root(root, sizeof(root)) != 0) {
+        return -1;
+    }
+    
+    char lock_path[MAX_PATH];
+    if (snprintf(tree_dir, MAX_PATH, "%s/v%016llx", root, (unsigned long long)key) >= MAX_PATH ||
+        snprintf(lock_path, sizeof(lock_path), "%s.lock", tree_dir) >= (int)sizeof(lock_path)) {
+        return -1;
+    }
+    
+    int fd, ret;
+retry:
+    fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        if (errno != ENOENT || create_directory_recursive(root) != 0) {
+            return -1;
+        }
+        fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) return -1;
+    }
+    
+    // Fast path: the tree exists, mark it in use and go
+    ret = cache_lock(fd, lock_path, LOCK_SH);
+    if (ret != 0) {
+        close(fd);
+        if (ret > 0) goto retry;
+        return -1;
+    }
+    
+    struct stat st;
+    if (stat(tree_dir, &st) == 0 && S_ISDIR(st.st_mode)) {
+        if (time(NULL) - st.st_mtime > CACHE_TOUCH_INTERVAL) {
+            utimensat(AT_FDCWD, tree_dir, NULL, 0);
+        }
+        *lock_fd = fd;
+        printf("Using cached core: %s\n", tree_dir);
+        return 0;
+    }
+    
+    // Slow path: single-flight extraction. Whoever gets the exclusive lock
+    // first populates the tree; everyone else blocks here and then finds it.
+    ret = cache_lock(fd, lock_path, LOCK_EX);
+    if (ret != 0) {
+        close(fd);
+        if (ret > 0) goto retry;
+        return -1;
+    }
+    
+    if (stat(tree_dir, &st) != 0) {
+        char staging[MAX_PATH];
+        if (snprintf(staging, sizeof(staging), "%s.tmpXXXXXX", tree_dir) >= (int)sizeof(staging) ||
+            mkdtemp(staging) == NULL) {
+            close(fd);
+            return -1;
+        }
+        
+        printf("Populating core cache: %s\n", tree_dir);
+        if (populate_cache_tree(staging, addon_files, addon_count) != 0 ||
+            rename(staging, tree_dir) != 0) {
+            remove_cache_tree(staging);
+            close(fd);
+            return -1;
+        }
+    }
+    
+    ret = cache_lock(fd, lock_path, LOCK_SH);
+    if (ret != 0) {
+        close(fd);
+        if (ret > 0) goto retry;
+        return -1;
+    }
+    *lock_fd = fd;
+    return 0;
+}
+
+static int cache_gc(int max_age_days, char **addon_files, int addon_count) {
+    char root[MAX_PATH];
+    if (get_cache_root(root, sizeof(root)) != 0) {
+        fprintf(stderr, "Error: No cache directory (set SSCC_CACHE_DIR or HOME)\n");
+        return 1;
+    }
+    
+    DIR *dir = opendir(root);
+    if (!dir) {
+        printf("Cache %s is empty\n", root);
+        return 0;
+    }
+    
+    // The tree this binary would use right now is never evicted
+    char current[32] = "";
+    uint64_t key;
+    if (compute_cache_key(addon_files, addon_count, &key) == 0) {
+        snprintf(current, sizeof(current), "v%016llx", (unsigned long long)key);
+    }
+    
+    time_t cutoff = time(NULL) - (time_t)max_age_days * 24 * 3600;
+    int removed = 0, kept = 0;
+    
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char *name = entry->d_name;
+        size_t len = strlen(name);
+        if (name[0] != 'v' || len < 6 || strcmp(name + len - 5, ".lock") != 0) {
+            continue;
+        }
+        
+        char version[MAX_PATH], tree[MAX_PATH], lock_path[MAX_PATH];
+        snprintf(version, sizeof(version), "%.*s", (int)(len - 5), name);
+        if (snprintf(tree, sizeof(tree), "%s/%s", root, version) >= (int)sizeof(tree) ||
+            snprintf(lock_path, sizeof(lock_path), "%s/%s", root, name) >= (int)sizeof(lock_path)) {
+            continue;
+        }
+        
+        int fd = open(lock_path, O_RDWR | O_CLOEXEC);
+        if (fd < 0) continue;
+        
+        // Trees in use or being populated hold the lock; leave them alone
+        if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+            close(fd);
+            kept++;
+            continue;
+        }
+        
+        // Nobody is populating this version, so staging dirs are leftovers
+        char pattern[MAX_PATH + 8];
+        glob_t stale;
+        snprintf(pattern, sizeof(pattern), "%s.tmp*", tree);
+        if (glob(pattern, 0, NULL, &stale) == 0) {
+            for (size_t i = 0; i < stale.gl_pathc; i++) {
+                remove_cache_tree(stale.gl_pathv[i]);
+            }
+        }
+        globfree(&stale);
+        
+        struct stat st;
+        int exists = stat(tree, &st) == 0;
+        if (strcmp(version, current) == 0 || (exists && st.st_mtime >= cutoff)) {
+            kept++;
+        } else {
+            if (exists) remove_cache_tree(tree);
+            char headers[MAX_PATH + 16];
+            snprintf(headers, sizeof(headers), "%s.headers", tree);
+            remove_cache_tree(headers);
+            unlink(lock_path);
+            removed++;
+            printf("Removed cached core %s\n", version);
+        }
+        
+        close(fd);
+    }
+    closedir(dir);
+    
+    printf("Cache %s: %d version(s) removed, %d kept\n", root, removed, kept);
+    return 0;
+}
+
+// Extraction scaling benchmark (make bench-extract)
+//
+// Decodes the embedded core into fresh plain-file trees with 1, 2, 4, ...
+// threads up to the CPU count and prints one line per thread count.
+#define BENCH_EXTRACT_ROUNDS 5
+
+static double elapsed_ms(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static int bench_extract(void) {
+    Archive core;
+    if (archive_open(&core, payload.core, payload.core_size) != 0 || archive_verify(&core) != 0) {
+        fprintf(stderr, "Error: Invalid core archive format\n");
+        archive_close(&core);
+        return 1;
+    }
+    
+    int max_threads = pool_default_threads();
+    ram_method = 4;     // Plain files: measure decoding, not memfd copies
+    
+    size_t total = 0;
+    for (uint32_t i = 0; i < core.file_count; i++) {
+        total += core.entries[i].original_size;
+    }
+    printf("Core: %u files, %zu bytes, best of %d rounds\n", core.file_count, total, BENCH_EXTRACT_ROUNDS);
+    printf("%-8s %-9s %10s %8s %9s\n", "threads", "writes", "ms", "speedup", "syscalls");
+    
+    // Each thread count with batches on io_uring, then with one system call
+    // per operation as on kernels without it
+    double base[2] = { 0, 0 };
+    for (int threads = 1; ; threads *= 2) {
+        if (threads > max_threads) threads = max_threads;
+        
+        for (int uring = file_batch_uring_enabled(); uring >= 0; uring--) {
+            extract_uring = uring;
+            double best = 0;
+            uint64_t syscalls = 0;
+            for (int round = 0; round < BENCH_EXTRACT_ROUNDS; round++) {
+                char dir[MAX_PATH];
+                snprintf(dir, sizeof(dir), "%s", get_temp_dir_template());
+                if (!mkdtemp(dir)) {
+                    fprintf(stderr, "Error: Cannot create temporary directory\n");
+                    archive_close(&core);
+                    return 1;
+                }
+                
+                uint64_t before = tree_syscalls;
+                extract_uring_used = 0;
+                struct timespec start;
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                uint32_t failed;
+                int ret = extract_all_entries(&core, dir, threads, NULL, &failed);
+                double ms = elapsed_ms(&start);
+                syscalls = tree_syscalls - before;
+                remove_cache_tree(dir);
+                
+                if (ret != 0) {
+                    fprintf(stderr, "Error: Failed to extract core file %s: %s\n",
+                            archive_path(&core, &core.entries[failed]), extract_error_string(ret));
+                    archive_close(&core);
+                    return 1;
+                }
+                if (round == 0 || ms < best) best = ms;
+            }
+            
+            if (threads == 1) base[uring] = best;
+            printf("%-8d %-9s %10.2f %7.2fx %9llu\n", threads, extract_uring_used ? "io_uring" : "plain",
+                   best, best > 0 ? base[uring] / best : 0, (unsigned long long)syscalls);
+        }
+        if (threads >= max_threads) break;
+    }
+    extract_uring = 1;
+    
+    // Decoding goes into file pages and a fixed arena, so this stays near
+    // the payload mapping plus a slice per thread whatever the entry sizes
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("Peak RSS: %ld KB\n", usage.ru_maxrss);
+    
+    archive_close(&core);
+    return 0;
+}
+
+// Cold-start benchmark (make bench-exec): time from "have the embedded
+// binary" to "tcc exited", writing it to disk as before vs a sealed memfd
+#define BENCH_EXEC_ROUNDS 20
+
+static double bench_exec_once(int use_memfd, const char *dir) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    char tcc_path[MAX_PATH];
+    char *args[] = { "tcc", "-v", NULL };
+    int fd = -1;
+    if (use_memfd) {
+        if ((fd = create_tcc_memfd()) < 0) return -1;
+    } else if (write_tcc_binary(dir, tcc_path, sizeof(tcc_path)) != 0) {
+        return -1;
+    }
+    
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd >= 0) {
+            dup2(null_fd, 1);
+            dup2(null_fd, 2);
+        }
+        if (use_memfd) {
+            fexecve(fd, args, environ);
+        } else {
+            execv(tcc_path, args);
+        }
+        _exit(127);
+    }
+    
+    int status = 0;
+    if (pid > 0) waitpid(pid, &status, 0);
+    if (use_memfd) {
+        close(fd);
+    } else {
+        unlink(tcc_path);
+    }
+    
+    if (pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status) == 127) return -1;
+    return elapsed_ms(&start);
+}
+
+static int bench_exec(void) {
+    char dir[MAX_PATH];
+    snprintf(dir, sizeof(dir), "%s", get_temp_dir_template());
+    if (!mkdtemp(dir)) {
+        fprintf(stderr, "Error: Cannot create temporary directory\n");
+        return 1;
+    }
+    
+    printf("TCC binary: %zu bytes, mean of %d runs of 'tcc -v'\n", payload.tcc_size, BENCH_EXEC_ROUNDS);
+    printf("%-8s %10s\n", "method", "ms");
+    
+    const char *names[] = { "disk", "memfd" };
+    for (int method = 0; method < 2; method++) {
+        double total = 0;
+        int round;
+        for (round = 0; round < BENCH_EXEC_ROUNDS; round++) {
+            double ms = bench_exec_once(method, dir);
+            if (ms < 0) break;
+            total += ms;
+        }
+        if (round < BENCH_EXEC_ROUNDS) {
+            printf("%-8s %10s\n", names[method], "unavailable");
+        } else {
+            printf("%-8s %10.3f\n", names[method], total / BENCH_EXEC_ROUNDS);
+        }
+    }
+    
+    rmdir(dir);
+    return 0;
+}
+
+#ifdef SSCC_USE_LIBTCC
+// In-process compilation (make sscc LIBTCC=1)
+//
+// The wrapper drives libtcc directly instead of writing out and exec'ing the
+// embedded tcc binary. Arguments are split the way tcc's own driver does it:
+// options are applied to the state first, then input files and -l libraries
+// are added in command-line order. Invocations that only the real driver
+// handles (preprocess-only, -run, dependency output, ...) still exec tcc.
+
+static int tcc_needs_driver(int argc, char **argv) {
+    static const char *const prefixes[] = {
+        "-E", "-run", "-ar", "-impdef", "-M", "-v", "-h", "-x", "-print",
+        "-dump", "-bench", "-shared", NULL
+    };
+    int inputs = 0, compile_only = 0, has_output = 0;
+    
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (arg[0] != '-') {
+            inputs++;
+            continue;
+        }
+        if (strcmp(arg, "-") == 0 || strcmp(arg, "-r") == 0) return 1;
+        for (int p = 0; prefixes[p]; p++) {
+            if (strncmp(arg, prefixes[p], strlen(prefixes[p])) == 0) return 1;
+        }
+        if (strcmp(arg, "-c") == 0) compile_only = 1;
+        if (strncmp(arg, "-o", 2) == 0) has_output = 1;
+        if (tcc_option_takes_arg(arg)) i++;
+    }
+    
+    // tcc writes one object per source for "-c a.c b.c"; leave that to it
+    return inputs == 0 || (compile_only && inputs > 1 && !has_output);
+}
+
+// tcc_set_options() splits on whitespace, so every argument is quoted
+static void append_quoted_option(char **buffer, size_t *size, size_t *used, const char *arg) {
+    size_t needed = *used + 2 * strlen(arg) + 4;
+    if (needed > *size) {
+        *size = needed * 2;
+        *buffer = realloc(*buffer, *size);
+    }
+    
+    char *p = *buffer + *used;
+    if (*used) *p++ = ' ';
+    *p++ = '"';
+    for (const char *c = arg; *c; c++) {
+        if (*c == '"' || *c == '\\') *p++ = '\\';
+        *p++ = *c;
+    }
+    *p++ = '"';
+    *p = '\0';
+    *used = p - *buffer;
+}
+
+static int run_tcc_in_process(int argc, char **argv) {
+    char *options = NULL;
+    size_t options_size = 0, options_used = 0;
+    char **inputs = malloc(argc * sizeof(char*));
+    int *is_library = malloc(argc * sizeof(int));
+    int input_count = 0;
+    int compile_only = 0;
+    const char *outfile = NULL;
+    
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (arg[0] != '-') {
+            is_library[input_count] = 0;
+            inputs[input_count++] = argv[i];
+        } else if (strncmp(arg, "-l", 2) == 0) {
+            const char *name = arg[2] ? arg + 2 : (i + 1 < argc ? argv[++i] : "");
+            is_library[input_count] = 1;
+            inputs[input_count++] = (char*)name;
+        } else if (strncmp(arg, "-o", 2) == 0) {
+            outfile = arg[2] ? arg + 2 : (i + 1 < argc ? argv[++i] : NULL);
+        } else {
+            if (strcmp(arg, "-c") == 0) compile_only = 1;
+            append_quoted_option(&options, &options_size, &options_used, arg);
+            if (tcc_option_takes_arg(arg) && i + 1 < argc) {
+                append_quoted_option(&options, &options_size, &options_used, argv[++i]);
+            }
+        }
+    }
+    
+    // Same default output names as the tcc driver
+    char default_outfile[MAX_PATH];
+    if (!outfile) {
+        if (compile_only) {
+            const char *base = strrchr(inputs[0], '/') ? strrchr(inputs[0], '/') + 1 : inputs[0];
+            snprintf(default_outfile, sizeof(default_outfile), "%s", base);
+            char *ext = strrchr(default_outfile, '.');
+            if (ext) *ext = '\0';
+            strncat(default_outfile, ".o", sizeof(default_outfile) - strlen(default_outfile) - 1);
+            outfile = default_outfile;
+        } else {
+            outfile = "a.out";
+        }
+    }
+    
+    int ret = 0;
+    TCCState *s = tcc_new();
+    if (!s) {
+        fprintf(stderr, "Error: Cannot create libtcc state\n");
+        ret = 1;
+        goto out;
+    }
+    
+    if (options) tcc_set_options(s, options);
+    tcc_set_output_type(s, compile_only ? TCC_OUTPUT_OBJ : TCC_OUTPUT_EXE);
+    
+    for (int i = 0; i < input_count; i++) {
+        if (is_library[i]) {
+            if (tcc_add_library(s, inputs[i]) < 0) {
+                fprintf(stderr, "tcc: error: library '%s' not found\n", inputs[i]);
+                ret = 1;
+            }
+        } else if (tcc_add_file(s, inputs[i]) < 0) {
+            ret = 1;
+        }
+    }
+    
+    if (ret == 0 && tcc_output_file(s, outfile) < 0) {
+        ret = 1;
+    }
+    tcc_delete(s);
+
+out:
+    free(options);
+    free(inputs);
+    free(is_library);
+    return ret;
+}
+#endif
+
+// Command line analysis shared by -j and the header cache
+
+static int is_c_source(const char *arg) {
+    size_t len = strlen(arg);
+    return arg[0] != '-' && len > 2 && strcmp(arg + len - 2, ".c") == 0;
+}
+
+// Counts the .c inputs of a tcc command line. Returns -1 if the invocation
+// has to go to tcc as a whole (preprocess-only, -run, dependency output, ...)
+static int count_c_sources(int argc, char **args, int *compile_only, int *has_output) {
+    static const char *const serial_prefixes[] = {
+        "-E", "-run", "-ar", "-impdef", "-M", "-x", "-v", "-h", "-print",
+        "-dump", "-bench", NULL
+    };
+    int sources = 0;
+    
+    *compile_only = 0;
+    *has_output = 0;
+    for (int i = 1; i < argc; i++) {
+        const char *arg = args[i];
+        if (arg[0] != '-') {
+            if (is_c_source(arg)) sources++;
+            continue;
+        }
+        if (strcmp(arg, "-") == 0) return -1;
+        for (int p = 0; serial_prefixes[p]; p++) {
+            if (strncmp(arg, serial_prefixes[p], strlen(serial_prefixes[p])) == 0) return -1;
+        }
+        if (strcmp(arg, "-c") == 0) *compile_only = 1;
+        if (strncmp(arg, "-o", 2) == 0) *has_output = 1;
+        if (tcc_option_takes_arg(arg)) i++;
+    }
+    return sources;
+}
+
+// Which subtrees of the tree an invocation reads (see Phase-selective
+// extraction). Anything unusual reads both.
+static int invocation_phases(int argc, char **args) {
+    static const char *const full_prefixes[] = {
+        "-run", "-ar", "-impdef", "-x", "-print", "-dump", "-b", NULL
+    };
+    int compile_only = 0, sources = 0, objects = 0, others = 0;
+    for (int i = 1; i < argc; i++) {
+        const char *arg = args[i];
+        if (arg[0] != '-') {
+            const char *ext = strrchr(arg, '.');
+            if (ext && (strcmp(ext, ".c") == 0 || strcmp(ext, ".s") == 0 || strcmp(ext, ".S") == 0)) {
+                sources++;
+            } else if (ext && (strcmp(ext, ".o") == 0 || strcmp(ext, ".a") == 0)) {
+                objects++;
+            } else {
+                others++;
+            }
+            continue;
+        }
+        if (strcmp(arg, "-") == 0) return PHASE_ALL;
+        for (int p = 0; full_prefixes[p]; p++) {
+            if (strncmp(arg, full_prefixes[p], strlen(full_prefixes[p])) == 0) return PHASE_ALL;
+        }
+        if (strcmp(arg, "-c") == 0 || strcmp(arg, "-E") == 0 || strcmp(arg, "-M") == 0 ||
+            strcmp(arg, "-MM") == 0) {
+            compile_only = 1;
+        }
+        if (tcc_option_takes_arg(arg)) i++;
+    }
+    
+    if (others > 0) return PHASE_ALL;
+    if (compile_only && sources > 0 && objects == 0) return PHASE_INCLUDE;
+    if (!compile_only && objects > 0 && sources == 0) return PHASE_LIB;
+    return PHASE_ALL;
+}
+
+// Options of the full invocation that do not belong on a "-c" command line
+static int is_link_only_option(const char *arg) {
+    return strncmp(arg, "-o", 2) == 0 || strncmp(arg, "-l", 2) == 0 ||
+           strncmp(arg, "-Wl,", 4) == 0 || strcmp(arg, "-c") == 0 ||
+           strcmp(arg, "-shared") == 0 || strcmp(arg, "-r") == 0 ||
+           strcmp(arg, "-rdynamic") == 0;
+}
+
+// Running tcc
+//
+// The embedded tcc is loaded at most once per invocation (a sealed memfd,
+// else a file in the tree) and shared by every process spawned from it.
+static int tcc_exec_fd = -1;
+static int tcc_binary_ready = 0;
+
+static int prepare_tcc_binary(const char *temp_dir, char *tcc_path, size_t tcc_path_size) {
+    // Cached trees already contain it
+    if (tcc_binary_ready || use_cache) return 0;
+    
+    uint64_t start = trace_now();
+    if ((tcc_exec_fd = create_tcc_memfd()) >= 0) {
+        trace_span("tcc_binary_memfd", start, NULL);
+    } else {
+        start = trace_now();
+        if (write_tcc_binary(temp_dir, tcc_path, tcc_path_size) != 0) {
+            return -1;
+        }
+        trace_span("tcc_binary_write", start, tcc_path);
+    }
+    tcc_binary_ready = 1;
+    return 0;
+}
+
+static void release_tcc_binary() {
+    if (tcc_exec_fd >= 0) close(tcc_exec_fd);
+    tcc_exec_fd = -1;
+    tcc_binary_ready = 0;
+}
+
+// Forks a child that runs one tcc invocation, with stdout/stderr redirected
+// to out_fd/err_fd when those are >= 0. Returns the pid, or -1.
+static pid_t spawn_tcc(int argc, char **args, const char *temp_dir,
+                       char *tcc_path, size_t tcc_path_size, int out_fd, int err_fd) {
+#ifdef SSCC_USE_LIBTCC
+    int in_process = !tcc_needs_driver(argc, args);
+#else
+    int in_process = 0;
+    (void)argc;
+#endif
+    if (!in_process && prepare_tcc_binary(temp_dir, tcc_path, tcc_path_size) != 0) {
+        return -1;
+    }
+    
+    fflush(stdout);
+    fflush(stderr);
+    uint64_t start = trace_now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "Error: Failed to fork process: %s\n", strerror(errno));
+        return -1;
+    }
+    if (pid > 0) {
+        trace_span("fork", start, NULL);
+        return pid;
+    }
+    
+    // Child process: execute TCC
+    if (out_fd >= 0) dup2(out_fd, STDOUT_FILENO);
+    if (err_fd >= 0) dup2(err_fd, STDERR_FILENO);
+#ifdef SSCC_USE_LIBTCC
+    if (in_process) {
+        int ret = run_tcc_in_process(argc, args);
+        fflush(stdout);
+        fflush(stderr);
+        _exit(ret);
+    }
+#endif
+    if (ram_method == 1) {
+        keep_memfds_on_exec();
+    }
+    trace_instant("exec", tcc_exec_fd >= 0 ? "memfd" : tcc_path);
+    exec_tcc(tcc_exec_fd, temp_dir, tcc_path, tcc_path_size, args);
+    // If we get here, execv failed
+    fprintf(stderr, "Error: Failed to execute TCC: %s\n", strerror(errno));
+    _exit(1);
+}
+
+static int open_capture_file() {
+#ifdef __linux__
+    int fd = memfd_create("sscc-output", MFD_CLOEXEC);
+    if (fd >= 0) return fd;
+#endif
+    FILE *f = tmpfile();
+    if (!f) return -1;
+    int copy = dup(fileno(f));
+    fclose(f);
+    if (copy >= 0) fcntl(copy, F_SETFD, FD_CLOEXEC);
+    return copy;
+}
+
+static void replay_capture(int fd, int target) {
+    if (fd < 0) return;
+    
+    char buffer[8192];
+    ssize_t n;
+    lseek(fd, 0, SEEK_SET);
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+        if (write(target, buffer, n) != n) break;
+    }
+    close(fd);
+}
+
+// Held output: a step that may be retried runs with stdout and stderr going
+// to capture files, which are replayed only if its result stands
+typedef struct {
+    int out;
+    int err;
+    int saved_out;
+    int saved_err;
+} HeldOutput;
+
+static int hold_output(HeldOutput *h) {
+    fflush(stdout);
+    fflush(stderr);
+    h->out = open_capture_file();
+    h->err = open_capture_file();
+    h->saved_out = dup(STDOUT_FILENO);
+    h->saved_err = dup(STDERR_FILENO);
+    if (h->out < 0 || h->err < 0 || h->saved_out < 0 || h->saved_err < 0) {
+        if (h->out >= 0) close(h->out);
+        if (h->err >= 0) close(h->err);
+        if (h->saved_out >= 0) close(h->saved_out);
+        if (h->saved_err >= 0) close(h->saved_err);
+        return -1;
+    }
+    dup2(h->out, STDOUT_FILENO);
+    dup2(h->err, STDERR_FILENO);
+    return 0;
+}
+
+// Restores stdout and stderr, then shows or drops what was held
+static void release_output(HeldOutput *h, int replay) {
+    fflush(stdout);
+    fflush(stderr);
+    dup2(h->saved_out, STDOUT_FILENO);
+    dup2(h->saved_err, STDERR_FILENO);
+    close(h->saved_out);
+    close(h->saved_err);
+    if (replay) {
+        replay_capture(h->out, STDOUT_FILENO);
+        replay_capture(h->err, STDERR_FILENO);
+    } else {
+        close(h->out);
+        close(h->err);
+    }
+}
+
+static int tcc_exit_status(int status) {
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
+// Header cache
+//
+// Small sources spend most of their compile time in the same musl headers.
+// A source's preamble is its leading run of blank lines, comments,
+// #define/#undef and #include <...>. That preamble is preprocessed once
+// with -E -dD, which keeps every macro definition, into a flat header. Later
+// compiles pass the flat header with -include. The source's own #includes
+// then stop at the include guards instead of walking features.h,
+// bits/alltypes.h and the rest again.
+//
+// Entries live next to the cached tree in v<key>.headers/<hash>.h. The key
+// covers the preamble text and every compile option, so a change to any
+// -D/-U/-I/-std flag selects a different entry. Some preambles pull in a
+// header from outside the tree, and some flat headers fail to compile. Those
+// are recorded as <hash>.none and never retried.
+#define HEADER_CACHE_VERSION "sscc-headers-1"
+#define PREAMBLE_SCAN_LIMIT (64 * 1024)
+
+static int starts_with_word(const char *p, const char *end, const char *word) {
+    size_t len = strlen(word);
+    return (size_t)(end - p) > len && strncmp(p, word, len) == 0 &&
+           (p[len] == ' ' || p[len] == '\t' || p[len] == '<');
+}
+
+// Returns the length of the preamble, or 0 if it has no system #include
+static size_t find_preamble(const char *src, size_t size) {
+    size_t pos = 0, preamble = 0;
+    int in_comment = 0;
+    
+    while (pos < size) {
+        const char *line = src + pos;
+        const char *end = memchr(line, '\n', size - pos);
+        if (!end) break;
+        pos = end - src + 1;
+        
+        const char *p = line;
+        if (in_comment) {
+            const char *close = memmem(p, end - p, "*/", 2);
+            if (!close) continue;
+            in_comment = 0;
+            p = close + 2;
+        }
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+        if (p == end) continue;
+        
+        if (end[-1] == '\\' && (p[0] != '#' || !starts_with_word(p + 1, end, "define"))) {
+            break;
+        }
+        if (end - p >= 2 && p[0] == '/' && p[1] == '/') continue;
+        if (end - p >= 2 && p[0] == '/' && p[1] == '*') {
+            const char *close = memmem(p + 2, end - p - 2, "*/", 2);
+            if (!close) {
+                in_comment = 1;
+                continue;
+            }
+            // Anything after the comment ends the preamble
+            for (p = close + 2; p < end && (*p == ' ' || *p == '\t' || *p == '\r'); p++);
+            if (p == end) continue;
+            break;
+        }
+        if (*p != '#') break;
+        
+        for (p++; p < end && (*p == ' ' || *p == '\t'); p++);
+        if (memmem(p, end - p, "/*", 2)) break;
+        if (starts_with_word(p, end, "include")) {
+            for (p += 7; p < end && (*p == ' ' || *p == '\t'); p++);
+            if (p == end || *p != '<') break;
+            preamble = pos;
+        } else if (starts_with_word(p, end, "define")) {
+            // Continued definitions run until a line without a backslash
+            while (end[-1] == '\\' && pos < size) {
+                end = memchr(src + pos, '\n', size - pos);
+                if (!end) return preamble;
+                pos = end - src + 1;
+            }
+        } else if (!starts_with_word(p, end, "undef")) {
+            break;
+        }
+    }
+    return preamble;
+}
+
+static char *read_file_prefix(const char *path, size_t limit, size_t *size) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    
+    char *data = malloc(limit);
+    size_t used = 0;
+    ssize_t n;
+    while (data && used < limit && (n = read(fd, data + used, limit - used)) > 0) {
+        used += n;
+    }
+    close(fd);
+    *size = used;
+    return data;
+}
+
+static int write_file_data(const char *path, const char *data, size_t size) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return -1;
+    
+    size_t written = 0;
+    while (written < size) {
+        ssize_t n = write(fd, data + written, size - written);
+        if (n <= 0) {
+            close(fd);
+            return -1;
+        }
+        written += n;
+    }
+    return close(fd);
+}
+
+// Runs tcc with its diagnostics discarded, and stdout too unless out_fd is
+// given; failures are reported by the real compile, not here
+static int run_tcc_quiet(int argc, char **args, int out_fd, const char *temp_dir,
+                         char *tcc_path, size_t tcc_path_size) {
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    pid_t pid = spawn_tcc(argc, args, temp_dir, tcc_path, tcc_path_size,
+                          out_fd >= 0 ? out_fd : null_fd, null_fd);
+    if (null_fd >= 0) close(null_fd);
+    if (pid < 0) return 1;
+    
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) return 1;
+    }
+    return tcc_exit_status(status);
+}
+
+// Rewrites the line markers of tcc -E output so they name the stub as
+// "<preamble>", and drops the predefined macros (they are defined again by
+// every compile). Returns -1 if any header came from outside the tree,
+// since such a header can change without the cache key noticing.
+static int check_line_markers(char *data, size_t *size, const char *tree, const char *stub) {
+    static const char name[] = "<preamble>";
+    size_t tree_len = strlen(tree), stub_len = strlen(stub);
+    size_t in = 0, out = 0;
+    int builtin = 0;
+    
+    while (in < *size) {
+        char *line = data + in;
+        char *end = memchr(line, '\n', *size - in);
+        size_t len = end ? (size_t)(end - line) + 1 : *size - in;
+        in += len;
+        
+        // Line markers look like: # 12 "path" flags
+        char *quote = NULL;
+        if (len > 4 && line[0] == '#' && line[1] == ' ' && line[2] >= '0' && line[2] <= '9') {
+            quote = memchr(line, '"', len);
+        }
+        if (!quote) {
+            if (!builtin) {
+                memmove(data + out, line, len);
+                out += len;
+            }
+            continue;
+        }
+        
+        char *path = quote + 1;
+        size_t rest = len - (path - line);
+        builtin = path[0] == '<';
+        if (builtin) continue;
+        
+        if (rest > stub_len && strncmp(path, stub, stub_len) == 0 && path[stub_len] == '"') {
+            size_t head = path - line;
+            memmove(data + out, line, head);
+            memcpy(data + out + head, name, sizeof(name) - 1);
+            memmove(data + out + head + sizeof(name) - 1, path + stub_len, rest - stub_len);
+            out += head + sizeof(name) - 1 + rest - stub_len;
+            continue;
+        }
+        if (rest <= tree_len || strncmp(path, tree, tree_len) != 0 || path[tree_len] != '/') {
+            return -1;
+        }
+        memmove(data + out, line, len);
+        out += len;
+    }
+    *size = out;
+    return 0;
+}
+
+// Builds the flat header for a preamble into <base>.h, or marks <base>.none
+static void build_header_cache(const char *base, char **options, int option_count,
+                               const char *preamble, size_t preamble_size, const char *temp_dir,
+                               char *tcc_path, size_t tcc_path_size) {
+    char stub[MAX_PATH + 16], flat[MAX_PATH + 16], final[MAX_PATH + 16];
+    snprintf(stub, sizeof(stub), "%s.XXXXXX.c", base);
+    snprintf(flat, sizeof(flat), "%s.XXXXXX", base);
+    
+    int stub_fd = mkstemps(stub, 2);
+    int flat_fd = stub_fd >= 0 ? mkstemp(flat) : -1;
+    if (stub_fd >= 0) close(stub_fd);
+    if (flat_fd >= 0) close(flat_fd);
+    if (stub_fd < 0 || flat_fd < 0 || write_file_data(stub, preamble, preamble_size) != 0) {
+        if (stub_fd >= 0) unlink(stub);
+        if (flat_fd >= 0) unlink(flat);
+        return;
+    }
+    
+    char **args = malloc((option_count + 9) * sizeof(char*));
+    memcpy(args, options, option_count * sizeof(char*));
+    
+    // Preprocess the preamble, keeping the macro definitions
+    int n = option_count;
+    args[n++] = "-E";
+    args[n++] = "-dD";
+    args[n++] = stub;
+    args[n++] = "-o";
+    args[n++] = flat;
+    args[n] = NULL;
+    int ok = run_tcc_quiet(n, args, -1, temp_dir, tcc_path, tcc_path_size) == 0;
+    
+    size_t size = 0;
+    char *data = ok ? read_file_prefix(flat, 64 * 1024 * 1024, &size) : NULL;
+    ok = data && size > 0 && check_line_markers(data, &size, temp_dir, stub) == 0 &&
+         write_file_data(flat, data, size) == 0;
+    free(data);
+    
+    // The source repeats its preamble after the flat header; make sure that
+    // combination compiles before anyone relies on it
+    if (ok) {
+        n = option_count;
+        args[n++] = "-include";
+        args[n++] = flat;
+        args[n++] = "-Werror";
+        args[n++] = "-c";
+        args[n++] = stub;
+        args[n++] = "-o";
+        args[n++] = "/dev/null";
+        args[n] = NULL;
+        ok = run_tcc_quiet(n, args, -1, temp_dir, tcc_path, tcc_path_size) == 0;
+    }
+    free(args);
+    unlink(stub);
+    
+    snprintf(final, sizeof(final), "%s.%s", base, ok ? "h" : "none");
+    if (!ok) {
+        unlink(flat);
+        close(open(final, O_WRONLY | O_CREAT | O_CLOEXEC, 0644));
+    } else if (rename(flat, final) != 0) {
+        unlink(flat);
+    }
+}
+
+// Returns a copy of args with "-include <flat header>" before the source
+// (the path is stored in header[MAX_PATH]), or NULL if the invocation does
+// not use the header cache
+static char **apply_header_cache(int argc, char **args, int *new_argc, char *header,
+                                 const char *temp_dir, char *tcc_path, size_t tcc_path_size) {
+    int compile_only, has_output;
+    if (!use_header_cache || !use_cache ||
+        count_c_sources(argc, args, &compile_only, &has_output) != 1) {
+        return NULL;
+    }
+    
+    // Compile options in order; the user's own -include would be repeated
+    // inside the flat header
+    char **options = malloc((argc + 1) * sizeof(char*));
+    int option_count = 0, source = -1;
+    for (int i = 0; i < argc; i++) {
+        const char *arg = args[i];
+        if (i > 0 && arg[0] != '-') {
+            if (is_c_source(arg)) source = i;
+            continue;
+        }
+        if (i > 0 && strcmp(arg, "-include") == 0) {
+            free(options);
+            return NULL;
+        }
+        int takes_arg = i > 0 && tcc_option_takes_arg(arg) && i + 1 < argc;
+        if (i == 0 || !is_link_only_option(arg)) {
+            options[option_count++] = args[i];
+            if (takes_arg) options[option_count++] = args[i + 1];
+        }
+        if (takes_arg) i++;
+    }
+    
+    size_t size;
+    char *src = read_file_prefix(args[source], PREAMBLE_SCAN_LIMIT, &size);
+    size_t preamble_size = src ? find_preamble(src, size) : 0;
+    if (preamble_size == 0) {
+        free(src);
+        free(options);
+        return NULL;
+    }
+    
+    uint64_t h = sscc_hash64(HEADER_CACHE_VERSION, strlen(HEADER_CACHE_VERSION), SSCC_HASH_INIT);
+    for (int i = 1; i < option_count; i++) {
+        h = sscc_hash64(options[i], strlen(options[i]) + 1, h);
+    }
+    h = sscc_hash64(src, preamble_size, h);
+    
+    char dir[MAX_PATH], base[MAX_PATH], none[MAX_PATH + 8];
+    if (snprintf(dir, sizeof(dir), "%s.headers", temp_dir) >= (int)sizeof(dir) ||
+        snprintf(base, sizeof(base), "%s/%016llx", dir, (unsigned long long)h) >= (int)sizeof(base) ||
+        snprintf(header, MAX_PATH, "%s.h", base) >= MAX_PATH) {
+        free(src);
+        free(options);
+        return NULL;
+    }
+    snprintf(none, sizeof(none), "%s.none", base);
+    
+    if (access(header, R_OK) != 0 && access(none, F_OK) != 0 &&
+        (mkdir(dir, 0755) == 0 || errno == EEXIST)) {
+        uint64_t start = trace_now();
+        build_header_cache(base, options, option_count, src, preamble_size, temp_dir,
+                           tcc_path, tcc_path_size);
+        trace_span("header_cache_build", start, base);
+    }
+    free(src);
+    free(options);
+    if (access(header, R_OK) != 0) {
+        return NULL;
+    }
+    
+    char **with_header = malloc((argc + 3) * sizeof(char*));
+    int n = 0;
+    for (int i = 0; i < argc; i++) {
+        if (i == source) {
+            with_header[n++] = "-include";
+            with_header[n++] = header;
+        }
+        with_header[n++] = args[i];
+    }
+    with_header[n] = NULL;
+    *new_argc = n;
+    return with_header;
+}
+
+// Object cache
+//
+// sscc rewrites every command line with paths into its tree, which is a
+// fresh directory on uncached runs, so external compiler caches never hit.
+// Results are cached here instead, by content. The key hashes:
+// - the preprocessed text of every .c input, with the tree path removed
+// - the bytes of every other input
+// - the remaining flags in order
+// - the core/addon key and the environment tcc reads
+// A hit copies the stored object or executable into place without running
+// tcc. Entries are <cache_root>/objects/<hash>. Their mtime is the LRU clock,
+// and the store is trimmed to SSCC_OBJECT_CACHE_SIZE megabytes by evicting
+// the least recently used. objects/stats holds the counters that
+// --sscc-cache-stats shows.
+#define OBJECT_CACHE_VERSION "sscc-objects-1"
+#define OBJECT_CACHE_DEFAULT_MB 512
+#define OBJECT_CACHE_TRIM_PERCENT 90    // Trim down to this share of the limit
+
+typedef struct {
+    char entry[MAX_PATH];       // Path in the store
+    char output[MAX_PATH];      // File tcc writes
+    int executable;
+} ObjectCacheSlot;
+
+typedef struct {
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long uncacheable;
+    unsigned long long evictions;
+    unsigned long long size;
+} ObjectCacheStats;
+
+typedef struct {
+    char name[32];
+    time_t mtime;
+    off_t size;
+} ObjectCacheEntry;
+
+static int get_object_cache_dir(char *dir, size_t dir_size) {
+    char root[MAX_PATH];
+    if (get_cache_root(root, sizeof(root)) != 0 ||
+        snprintf(dir, dir_size, "%s/objects", root) >= (int)dir_size) {
+        return -1;
+    }
+    return make_directories(dir);
+}
+
+static unsigned long long object_cache_limit() {
+    const char *env = getenv("SSCC_OBJECT_CACHE_SIZE");
+    long long mb = env && *env ? atoll(env) : OBJECT_CACHE_DEFAULT_MB;
+    if (mb <= 0) mb = OBJECT_CACHE_DEFAULT_MB;
+    return (unsigned long long)mb * 1024 * 1024;
+}
+
+static int compare_entry_age(const void *a, const void *b) {
+    const ObjectCacheEntry *x = a, *y = b;
+    return (x->mtime > y->mtime) - (x->mtime < y->mtime);
+}
+
+// Rescans the store, evicting least recently used entries until it fits
+// OBJECT_CACHE_TRIM_PERCENT of the limit; also corrects the size counter
+static void object_cache_trim(const char *dir, ObjectCacheStats *stats, unsigned long long limit) {
+    DIR *d = opendir(dir);
+    if (!d) return;
+    
+    ObjectCacheEntry *entries = NULL;
+    size_t count = 0, capacity = 0;
+    unsigned long long total = 0;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        struct stat st;
+        if (strlen(de->d_name) != 16 || fstatat(dirfd(d), de->d_name, &st, 0) != 0) continue;
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            entries = realloc(entries, capacity * sizeof(ObjectCacheEntry));
+        }
+        snprintf(entries[count].name, sizeof(entries[count].name), "%s", de->d_name);
+        entries[count].mtime = st.st_mtime;
+        entries[count].size = st.st_size;
+        total += st.st_size;
+        count++;
+    }
+    
+    qsort(entries, count, sizeof(ObjectCacheEntry), compare_entry_age);
+    unsigned long long target = limit / 100 * OBJECT_CACHE_TRIM_PERCENT;
+    for (size_t i = 0; i < count && total > target; i++) {
+        if (unlinkat(dirfd(d), entries[i].name, 0) == 0) {
+            total -= entries[i].size;
+            stats->evictions++;
+        }
+    }
+    closedir(d);
+    free(entries);
+    stats->size = total;
+}
+
+// Adds to the shared counters under a lock, trimming the store if it grew
+// past the limit
+static void object_cache_account(int hits, int misses, int uncacheable, long long stored) {
+    char dir[MAX_PATH], path[MAX_PATH + 8];
+    if (get_object_cache_dir(dir, sizeof(dir)) != 0) return;
+    snprintf(path, sizeof(path), "%s/stats", dir);
+    
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) return;
+    if (flock(fd, LOCK_EX) != 0) {
+        close(fd);
+        return;
+    }
+    
+    ObjectCacheStats stats = {0};
+    char buffer[512];
+    ssize_t n = pread(fd, buffer, sizeof(buffer) - 1, 0);
+    if (n > 0) {
+        buffer[n] = '\0';
+        sscanf(buffer, "hits %llu misses %llu uncacheable %llu evictions %llu size %llu",
+               &stats.hits, &stats.misses, &stats.uncacheable, &stats.evictions, &stats.size);
+    }
+    
+    stats.hits += hits;
+    stats.misses += misses;
+    stats.uncacheable += uncacheable;
+    stats.size += stored;
+    
+    unsigned long long limit = object_cache_limit();
+    if (stats.size > limit) {
+        object_cache_trim(dir, &stats, limit);
+    }
+    
+    n = snprintf(buffer, sizeof(buffer), "hits %llu\nmisses %llu\nuncacheable %llu\nevictions %llu\nsize %llu\n",
+                 stats.hits, stats.misses, stats.uncacheable, stats.evictions, stats.size);
+    if (pwrite(fd, buffer, n, 0) == n) {
+        ftruncate(fd, n);
+    }
+    close(fd);
+}
+
+static int object_cache_stats() {
+    char dir[MAX_PATH], path[MAX_PATH + 8];
+    if (get_object_cache_dir(dir, sizeof(dir)) != 0) {
+        fprintf(stderr, "Error: No cache directory (set SSCC_CACHE_DIR or HOME)\n");
+        return 1;
+    }
+    
+    ObjectCacheStats stats = {0};
+    snprintf(path, sizeof(path), "%s/stats", dir);
+    FILE *f = fopen(path, "r");
+    if (f) {
+        if (fscanf(f, "hits %llu misses %llu uncacheable %llu evictions %llu",
+                   &stats.hits, &stats.misses, &stats.uncacheable, &stats.evictions) != 4) {
+            memset(&stats, 0, sizeof(stats));
+        }
+        fclose(f);
+    }
+    
+    // Size and entry count come from the store itself
+    int entries = 0;
+    DIR *d = opendir(dir);
+    struct dirent *de;
+    while (d && (de = readdir(d)) != NULL) {
+        struct stat st;
+        if (strlen(de->d_name) == 16 && fstatat(dirfd(d), de->d_name, &st, 0) == 0) {
+            stats.size += st.st_size;
+            entries++;
+        }
+    }
+    if (d) closedir(d);
+    
+    unsigned long long lookups = stats.hits + stats.misses;
+    char size_str[64], limit_str[64];
+    format_bytes(stats.size, size_str, sizeof(size_str));
+    format_bytes(object_cache_limit(), limit_str, sizeof(limit_str));
+    printf("Object cache: %s\n", dir);
+    printf("  Hits:        %llu (%.1f%%)\n", stats.hits, lookups ? 100.0 * stats.hits / lookups : 0.0);
+    printf("  Misses:      %llu\n", stats.misses);
+    printf("  Uncacheable: %llu\n", stats.uncacheable);
+    printf("  Evictions:   %llu\n", stats.evictions);
+    printf("  Size:        %s of %s in %d entries\n", size_str, limit_str, entries);
+    return 0;
+}
+
+// Hashes data with every occurrence of the tree path left out, so per-run
+// temporary trees produce the same key
+static uint64_t hash_without_tree(const char *data, size_t size, const char *tree, uint64_t h) {
+    size_t tree_len = strlen(tree);
+    const char *p = data, *end = data + size;
+    const char *match;
+    while ((match = memmem(p, end - p, tree, tree_len)) != NULL) {
+        h = sscc_hash64(p, match - p, h);
+        h = sscc_hash64("<tree>", 6, h);
+        p = match + tree_len;
+    }
+    return sscc_hash64(p, end - p, h);
+}
+
+static int hash_preprocessed(char **options, int option_count, char *source, const char *temp_dir,
+                             char *tcc_path, size_t tcc_path_size, uint64_t *h) {
+    char **args = malloc((option_count + 3) * sizeof(char*));
+    memcpy(args, options, option_count * sizeof(char*));
+    args[option_count] = "-E";
+    args[option_count + 1] = source;
+    args[option_count + 2] = NULL;
+    
+    uint64_t start = trace_now();
+    int out_fd = open_capture_file();
+    int ret = out_fd >= 0 ? run_tcc_quiet(option_count + 2, args, out_fd, temp_dir,
+                                          tcc_path, tcc_path_size) : 1;
+    free(args);
+    if (ret != 0) {
+        if (out_fd >= 0) close(out_fd);
+        return -1;
+    }
+    
+    off_t size = lseek(out_fd, 0, SEEK_END);
+    void *data = size > 0 ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, out_fd, 0) : MAP_FAILED;
+    close(out_fd);
+    if (data == MAP_FAILED) return -1;
+    *h = hash_without_tree(data, size, temp_dir, *h);
+    munmap(data, size);
+    trace_span("preprocess", start, source);
+    return 0;
+}
+
+static int copy_file_contents(const char *from, const char *to, mode_t mode) {
+    int in = open(from, O_RDONLY | O_CLOEXEC);
+    if (in < 0) return -1;
+    int out = open(to, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+    if (out < 0) {
+        close(in);
+        return -1;
+    }
+    
+    char buffer[65536];
+    ssize_t n;
+    int ret = 0;
+    while ((n = read(in, buffer, sizeof(buffer))) > 0) {
+        if (write(out, buffer, n) != n) {
+            ret = -1;
+            break;
+        }
+    }
+    if (n < 0) ret = -1;
+    close(in);
+    if (close(out) != 0) ret = -1;
+    return ret;
+}
+
+// Returns 1 on a hit (the output is already in place), 0 on a miss with
+// slot filled in for object_cache_store(), or -1 if the invocation cannot
+// be cached
+static int object_cache_lookup(int argc, char **args, ObjectCacheSlot *slot, const char *temp_dir,
+                               char *tcc_path, size_t tcc_path_size) {
+    int compile_only, has_output;
+    int sources = count_c_sources(argc, args, &compile_only, &has_output);
+    if (!use_object_cache || core_key == 0 || sources < 0) {
+        return -1;
+    }
+    // tcc writes one object per source for "-c a.c b.c"; -j splits those
+    if (compile_only && sources != 1) {
+        object_cache_account(0, 0, 1, 0);
+        return -1;
+    }
+    
+    // Options as passed to tcc -E for the .c inputs
+    char **options = malloc((argc + 1) * sizeof(char*));
+    int option_count = 0;
+    for (int i = 0; i < argc; i++) {
+        const char *arg = args[i];
+        if (i > 0 && arg[0] != '-') continue;
+        int takes_arg = i > 0 && tcc_option_takes_arg(arg) && i + 1 < argc;
+        if (i == 0 || !is_link_only_option(arg)) {
+            options[option_count++] = args[i];
+            if (takes_arg) options[option_count++] = args[i + 1];
+        }
+        if (takes_arg) i++;
+    }
+    
+    uint64_t h = sscc_hash64(OBJECT_CACHE_VERSION, strlen(OBJECT_CACHE_VERSION), SSCC_HASH_INIT);
+    h = sscc_hash_u64(core_key, h);
+    static const char *const environment[] = { "CPATH", "C_INCLUDE_PATH", "LIBRARY_PATH", NULL };
+    for (int i = 0; environment[i]; i++) {
+        const char *value = getenv(environment[i]);
+        h = sscc_hash64(value ? value : "", value ? strlen(value) + 1 : 0, h);
+        h = sscc_hash64("\n", 1, h);
+    }
+    
+    const char *output = NULL, *first_source = NULL;
+    int inputs = 0, debug = 0, cacheable = 1;
+    for (int i = 1; i < argc && cacheable; i++) {
+        const char *arg = args[i];
+        if (arg[0] != '-') {
+            inputs++;
+            if (is_c_source(arg)) {
+                if (!first_source) first_source = arg;
+                h = sscc_hash64("source", 7, h);
+                cacheable = hash_preprocessed(options, option_count, args[i], temp_dir,
+                                              tcc_path, tcc_path_size, &h) == 0;
+            } else {
+                h = sscc_hash64("file", 5, h);
+                cacheable = hash_file(arg, &h) == 0;
+            }
+            continue;
+        }
+        
+        int takes_arg = tcc_option_takes_arg(arg) && i + 1 < argc;
+        if (strncmp(arg, "-o", 2) == 0) {
+            output = arg[2] ? arg + 2 : (takes_arg ? args[i + 1] : NULL);
+            if (takes_arg) i++;
+            continue;
+        }
+        // The tree's own -I/-L/-B paths are covered by core_key
+        if (strstr(arg, temp_dir)) {
+            continue;
+        }
+        // Libraries from user directories are not hashed
+        if (!compile_only && (strncmp(arg, "-L", 2) == 0 || strncmp(arg, "-B", 2) == 0)) {
+            cacheable = 0;
+        }
+        if (strncmp(arg, "-g", 2) == 0) debug = 1;
+        
+        h = sscc_hash64(arg, strlen(arg) + 1, h);
+        if (takes_arg) {
+            h = sscc_hash64(args[i + 1], strlen(args[i + 1]) + 1, h);
+            i++;
+        }
+    }
+    free(options);
+    
+    // Debug info records the working directory
+    char cwd[MAX_PATH];
+    if (debug && getcwd(cwd, sizeof(cwd))) {
+        h = sscc_hash64(cwd, strlen(cwd) + 1, h);
+    }
+    
+    char dir[MAX_PATH];
+    if (!cacheable || inputs == 0 || get_object_cache_dir(dir, sizeof(dir)) != 0) {
+        object_cache_account(0, 0, 1, 0);
+        return -1;
+    }
+    
+    // Same default output names as the tcc driver
+    slot->executable = !compile_only;
+    if (output) {
+        snprintf(slot->output, sizeof(slot->output), "%s", output);
+    } else if (compile_only) {
+        const char *base = strrchr(first_source, '/') ? strrchr(first_source, '/') + 1 : first_source;
+        snprintf(slot->output, sizeof(slot->output), "%.*s.o", (int)strlen(base) - 2, base);
+    } else {
+        snprintf(slot->output, sizeof(slot->output), "a.out");
+    }
+    if (snprintf(slot->entry, sizeof(slot->entry), "%s/%016llx", dir, (unsigned long long)h) >=
+        (int)sizeof(slot->entry)) {
+        object_cache_account(0, 0, 1, 0);
+        return -1;
+    }
+    
+    if (copy_file_contents(slot->entry, slot->output, slot->executable ? 0777 : 0666) == 0) {
+        utimensat(AT_FDCWD, slot->entry, NULL, 0);
+        object_cache_account(1, 0, 0, 0);
+        return 1;
+    }
+    object_cache_account(0, 1, 0, 0);
+    return 0;
+}
+
+static void object_cache_store(const ObjectCacheSlot *slot) {
+    char temp[MAX_PATH + 16];
+    snprintf(temp, sizeof(temp), "%s.tmpXXXXXX", slot->entry);
+    int fd = mkstemp(temp);
+    if (fd < 0) return;
+    close(fd);
+    
+    struct stat st;
+    if (copy_file_contents(slot->output, temp, 0644) != 0 || stat(temp, &st) != 0 ||
+        rename(temp, slot->entry) != 0) {
+        unlink(temp);
+        return;
+    }
+    object_cache_account(0, 0, 0, st.st_size);
+}
+
+// Runs one tcc invocation to completion and returns its exit status
+static int run_tcc(int argc, char **args, const char *temp_dir, char *tcc_path, size_t tcc_path_size) {
+    ObjectCacheSlot slot;
+    uint64_t start = trace_now();
+    int cached = object_cache_lookup(argc, args, &slot, temp_dir, tcc_path, tcc_path_size);
+    trace_span("object_cache_lookup", start, cached == 1 ? "hit" : cached == 0 ? "miss" : "uncacheable");
+    if (cached == 1) {
+        return 0;
+    }
+    
+    start = trace_now();
+    char header[MAX_PATH];
+    char **with_header = apply_header_cache(argc, args, &argc, header, temp_dir,
+                                            tcc_path, tcc_path_size);
+    if (with_header) {
+        args = with_header;
+        trace_span("header_cache", start, header);
+    }
+    
+    int ret = 1;
+#ifdef SSCC_USE_LIBTCC
+    // Compile inside this process when libtcc can reproduce the invocation
+    if (!tcc_needs_driver(argc, args)) {
+        start = trace_now();
+        ret = run_tcc_in_process(argc, args);
+        trace_span("compile_in_process", start, NULL);
+    } else
+#endif
+    {
+        pid_t pid = spawn_tcc(argc, args, temp_dir, tcc_path, tcc_path_size, -1, -1);
+        int status;
+        start = trace_now();
+        while (pid > 0 && waitpid(pid, &status, 0) < 0) {
+            if (errno != EINTR) pid = -1;
+        }
+        if (pid > 0) {
+            ret = tcc_exit_status(status);
+        }
+        trace_span("wait", start, NULL);
+    }
+    free(with_header);
+    
+    if (cached == 0 && ret == 0) {
+        start = trace_now();
+        object_cache_store(&slot);
+        trace_span("object_cache_store", start, slot.entry);
+    }
+    return ret;
+}
+
+// Links against deferred libraries (see Split static libraries)
+//
+// A link of object files only needs the library members its symbols reach.
+// The closure starts from the undefined symbols of the objects, the crt
+// files and any other archive on the command line, and follows each symbol
+// to the first member defining it in every library the link searches,
+// which is the member the linker would take. The minimal archives keep
+// member order and a symbol table of their own, so the linker resolves
+// exactly as it would with the full ones. What the analysis does not model
+// (linker flags such as -Wl,-u, weak or common symbol corner cases) shows
+// up as a failed link, which is rerun against the full libraries with only
+// the second attempt's output shown.
+#define LINK_NONE 0             // reads no library (-c, -E, -M, no inputs)
+#define LINK_OBJECTS 1          // links object files and archives only
+#define LINK_OTHER 2            // needs the full libraries (sources, -run, ...)
+
+static int link_kind(int argc, char **args) {
+    static const char *const no_link_prefixes[] = { "-ar", "-impdef", "-print", "-dump", NULL };
+    int inputs = 0, kind = LINK_OBJECTS;
+    for (int i = 1; i < argc; i++) {
+        const char *arg = args[i];
+        size_t len = strlen(arg);
+        if (arg[0] != '-' || strcmp(arg, "-") == 0) {
+            inputs++;
+            if (len < 3 || (strcmp(arg + len - 2, ".o") != 0 && strcmp(arg + len - 2, ".a") != 0)) {
+                kind = LINK_OTHER;
+            }
+            continue;
+        }
+        if (strcmp(arg, "-c") == 0 || strcmp(arg, "-E") == 0 || strcmp(arg, "-M") == 0 ||
+            strcmp(arg, "-MM") == 0) {
+            return LINK_NONE;
+        }
+        for (int p = 0; no_link_prefixes[p]; p++) {
+            if (strncmp(arg, no_link_prefixes[p], strlen(no_link_prefixes[p])) == 0) return LINK_NONE;
+        }
+        // -run also takes the program's arguments; -b links the bounds checker
+        if (strncmp(arg, "-run", 4) == 0) return LINK_OTHER;
+        if (strcmp(arg, "-shared") == 0 || strcmp(arg, "-r") == 0 || strncmp(arg, "-b", 2) == 0 ||
+            strncmp(arg, "-x", 2) == 0 || (strncmp(arg, "-Wl,", 4) == 0 && strstr(arg, "whole-archive"))) {
+            kind = LINK_OTHER;
+        }
+        if (tcc_option_takes_arg(arg) && i + 1 < argc) i++;
+    }
+    return inputs ? kind : LINK_NONE;
+}
+
+typedef struct {
+    SymbolTable defined;        // defined by the objects and crt files
+    SymbolTable wanted;         // every symbol resolved so far
+    const char **pending;       // undefined symbols still to resolve
+    uint32_t pending_count;
+    uint32_t pending_capacity;
+    uint8_t **selected;         // per split library, NULL if not searched
+    int failed;                 // out of memory
+} LinkClosure;
+
+static void closure_want(LinkClosure *c, const char *name) {
+    if (c->pending_count == c->pending_capacity) {
+        uint32_t capacity = c->pending_capacity ? c->pending_capacity * 2 : 1024;
+        const char **pending = realloc(c->pending, capacity * sizeof(char*));
+        if (!pending) {
+            c->failed = 1;
+            return;
+        }
+        c->pending = pending;
+        c->pending_capacity = capacity;
+    }
+    c->pending[c->pending_count++] = name;
+}
+
+static void closure_object_symbol(void *ctx, const char *name, int defined) {
+    LinkClosure *c = ctx;
+    if (!defined) {
+        closure_want(c, name);
+    } else if (symbol_add(&c->defined, name, 0) < 0) {
+        c->failed = 1;
+    }
+}
+
+// Members of other archives only add what they reference: whether the
+// linker takes them is not modelled, so their definitions are not trusted
+static void closure_archive_symbol(void *ctx, const char *name, int defined) {
+    if (!defined) closure_want(ctx, name);
+}
+
+typedef struct {
+    const char **data;
+    size_t *sizes;
+    int count;
+} MappedInputs;
+
+// Maps an input the closure reads; it stays mapped while symbol names
+// point into it
+static const unsigned char *map_link_input(MappedInputs *inputs, const char *path, size_t *size) {
+    const char **data = realloc(inputs->data, (inputs->count + 1) * sizeof(char*));
+    size_t *sizes = realloc(inputs->sizes, (inputs->count + 1) * sizeof(size_t));
+    if (data) inputs->data = data;
+    if (sizes) inputs->sizes = sizes;
+    if (!data || !sizes) return NULL;
+    
+    const char *mapped = map_file(path, size);
+    if (!mapped) return NULL;
+    inputs->data[inputs->count] = mapped;
+    inputs->sizes[inputs->count++] = *size;
+    return (const unsigned char*)mapped;
+}
+
+static int add_object_input(LinkClosure *c, MappedInputs *inputs, const char *path) {
+    size_t size;
+    const unsigned char *data = map_link_input(inputs, path, &size);
+    return data ? elf_object_symbols(data, size, closure_object_symbol, c) : -1;
+}
+
+static int add_archive_input(LinkClosure *c, MappedInputs *inputs, const char *path) {
+    size_t size;
+    ArMember *members;
+    uint32_t count;
+    const unsigned char *data = map_link_input(inputs, path, &size);
+    if (!data || ar_parse(data, size, &members, &count) != 0) return -1;
+    
+    int ret = 0;
+    for (uint32_t i = 0; i < count && ret == 0; i++) {
+        ret = elf_object_symbols(members[i].data, members[i].size, closure_archive_symbol, c);
+    }
+    free(members);
+    return ret;
+}
+
+// Marks split library name ("libX.a") as searched. Returns -1 if the tree
+// has no such split library.
+static int search_split_library(LinkClosure *c, const char *name) {
+    for (int l = 0; l < split_lib_count; l++) {
+        if (strcmp(split_libs[l].name, name) != 0) continue;
+        if (!c->selected[l]) {
+            c->selected[l] = calloc(split_libs[l].index.member_count + 1, 1);
+            if (!c->selected[l]) return -1;
+        }
+        return 0;
+    }
+    return -1;
+}
+
+// -lX: the first libX.a in the -L directories, in order (-static links
+// never look for shared objects)
+static int add_library_input(LinkClosure *c, MappedInputs *inputs, const char *name,
+                             char **dirs, int dir_count, const char *tree_lib) {
+    char file[MAX_PATH], path[MAX_PATH];
+    snprintf(file, sizeof(file), "lib%s.a", name);
+    for (int d = 0; d < dir_count; d++) {
+        if (strcmp(dirs[d], tree_lib) == 0 && search_split_library(c, file) == 0) return 0;
+        if (snprintf(path, sizeof(path), "%s/%s", dirs[d], file) < (int)sizeof(path) && access(path, F_OK) == 0) {
+            return add_archive_input(c, inputs, path);
+        }
+    }
+    return -1;
+}
+
+// Fills selected[l][m] for the members of every split library l the link
+// searches. Returns -1 if the link is not one the closure can model.
+static int select_library_members(int argc, char **args, const char *temp_dir, uint8_t **selected) {
+    LinkClosure c;
+    memset(&c, 0, sizeof(c));
+    c.selected = selected;
+    MappedInputs inputs = { NULL, NULL, 0 };
+    char **dirs = malloc((argc + 1) * sizeof(char*));
+    int dir_count = 0;
+    char tree_lib[MAX_PATH];
+    snprintf(tree_lib, sizeof(tree_lib), "%s/lib", temp_dir);
+    size_t tree_lib_len = strlen(tree_lib);
+    int ret = dirs ? 0 : -1;
+    int nostdlib = 0;
+    
+    for (int i = 1; i < argc && ret == 0; i++) {
+        const char *arg = args[i];
+        if (strncmp(arg, "-L", 2) == 0) {
+            if (arg[2]) dirs[dir_count++] = (char*)arg + 2;
+            else if (i + 1 < argc) dirs[dir_count++] = args[i + 1];
+        }
+        if (strcmp(arg, "-nostdlib") == 0) nostdlib = 1;
+        if (tcc_option_takes_arg(arg)) i++;
+    }
+    
+    // Inputs and -l in command-line order
+    for (int i = 1; i < argc && ret == 0 && !c.failed; i++) {
+        const char *arg = args[i];
+        size_t len = strlen(arg);
+        if (arg[0] != '-') {
+            if (strcmp(arg + len - 2, ".o") == 0) {
+                ret = add_object_input(&c, &inputs, arg);
+            } else if (strncmp(arg, tree_lib, tree_lib_len) == 0 && arg[tree_lib_len] == '/' &&
+                       search_split_library(&c, arg + tree_lib_len + 1) == 0) {
+                continue;
+            } else {
+                ret = add_archive_input(&c, &inputs, arg);
+            }
+        } else if (strncmp(arg, "-l", 2) == 0) {
+            const char *name = arg[2] ? arg + 2 : (i + 1 < argc ? args[++i] : "");
+            ret = add_library_input(&c, &inputs, name, dirs, dir_count, tree_lib);
+        } else if (tcc_option_takes_arg(arg)) {
+            i++;
+        }
+    }
+    
+    // What tcc adds itself: the crt files, libc and its runtime library
+    if (!nostdlib) {
+        static const char *const crt_files[] = { "crt1.o", "crti.o", "crtn.o", NULL };
+        for (int f = 0; crt_files[f] && ret == 0; f++) {
+            char path[MAX_PATH];
+            snprintf(path, sizeof(path), "%s/%s", tree_lib, crt_files[f]);
+            ret = add_object_input(&c, &inputs, path);
+        }
+        if (ret == 0) ret = add_library_input(&c, &inputs, "c", dirs, dir_count, tree_lib);
+        if (ret == 0 && search_split_library(&c, "libtcc1.a") != 0) {
+            char path[MAX_PATH];
+            snprintf(path, sizeof(path), "%s/libtcc1.a", tree_lib);
+            ret = access(path, F_OK) == 0 ? add_archive_input(&c, &inputs, path) : 0;
+        }
+    }
+    
+    // Each wanted symbol pulls the first member defining it in every
+    // searched library, and that member's references in turn
+    while (ret == 0 && !c.failed && c.pending_count > 0) {
+        const char *name = c.pending[--c.pending_count];
+        if (symbol_find(&c.defined, name, NULL)) continue;
+        int added = symbol_add(&c.wanted, name, 0);
+        if (added <= 0) {
+            if (added < 0) c.failed = 1;
+            continue;
+        }
+        for (int l = 0; l < split_lib_count; l++) {
+            SplitLibrary *lib = &split_libs[l];
+            uint32_t m;
+            if (!selected[l] || !symbol_find(&lib->symbols, name, &m) || selected[l][m]) continue;
+            selected[l][m] = 1;
+            const StaticLibMember *member = &lib->index.members[m];
+            for (uint32_t u = 0; u < member->undef_count; u++) {
+                closure_want(&c, staticlib_string(&lib->index, lib->index.undefs[member->undef_first + u]));
+            }
+        }
+    }
+    if (c.failed) ret = -1;
+    
+    for (int i = 0; i < inputs.count; i++) {
+        munmap((void*)inputs.data[i], inputs.sizes[i]);
+    }
+    free(inputs.data);
+    free(inputs.sizes);
+    free(c.pending);
+    symbol_table_free(&c.defined);
+    symbol_table_free(&c.wanted);
+    free(dirs);
+    return ret;
+}
+
+// Symbol tables of the split libraries, built on the first narrowed link
+static int build_library_symbols(void) {
+    for (int l = 0; l < split_lib_count; l++) {
+        SplitLibrary *lib = &split_libs[l];
+        if (lib->symbols.count > 0) continue;
+        for (uint32_t m = 0; m < lib->index.member_count; m++) {
+            const StaticLibMember *member = &lib->index.members[m];
+            for (uint32_t d = 0; d < member->def_count; d++) {
+                const char *name = staticlib_string(&lib->index, lib->index.defs[member->def_first + d]);
+                if (symbol_add(&lib->symbols, name, m) < 0) return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Runs a tcc invocation that may link, writing the deferred libraries it
+// needs first: only the reachable members for a link of objects (retried
+// with everything if that link fails), all of them for anything else
+static int run_link(int argc, char **args, const char *temp_dir, char *tcc_path, size_t tcc_path_size) {
+    int kind = libraries_deferred ? link_kind(argc, args) : LINK_NONE;
+    if (kind == LINK_NONE) {
+        return run_tcc(argc, args, temp_dir, tcc_path, tcc_path_size);
+    }
+    
+    if (kind == LINK_OBJECTS) {
+        uint64_t start = trace_now();
+        uint8_t **selected = calloc(split_lib_count, sizeof(uint8_t*));
+        int narrowed = selected && build_library_symbols() == 0 &&
+                       select_library_members(argc, args, temp_dir, selected) == 0;
+        trace_span("library_closure", start, narrowed ? NULL : "unsupported");
+        if (narrowed) narrowed = write_libraries(temp_dir, selected) == 0;
+        for (int l = 0; l < split_lib_count && selected; l++) free(selected[l]);
+        free(selected);
+        
+        HeldOutput held;
+        if (narrowed && hold_output(&held) == 0) {
+            int ret = run_tcc(argc, args, temp_dir, tcc_path, tcc_path_size);
+            release_output(&held, ret == 0);
+            if (ret == 0) return 0;
+            trace_instant("library_retry", NULL);
+        }
+    }
+    
+    if (write_deferred_libraries(temp_dir) != 0) return 1;
+    return run_tcc(argc, args, temp_dir, tcc_path, tcc_path_size);
+}
+
+// Parallel compilation (-j N)
+//
+// An invocation with several .c inputs is split into one "tcc -c" per
+// source, at most N running at once, followed by a single link of the
+// resulting objects. Each job's output is captured and replayed in
+// command-line order as soon as every earlier job has finished, so
+// diagnostics read exactly as they would from a serial compile.
+typedef struct {
+    int arg_index;      // Position of the source in tcc_args
+    pid_t pid;
+    int out_fd;
+    int err_fd;
+    int status;         // -1 while pending or running
+    uint64_t start;     // Trace timestamp of the launch
+    char object[MAX_PATH];
+} CompileJob;
+
+// Runs one job through run_tcc() in a child with its output captured, so
+// the object and header caches are consulted in parallel too
+static pid_t spawn_compile_job(int argc, char **args, const char *temp_dir,
+                               char *tcc_path, size_t tcc_path_size, int out_fd, int err_fd) {
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "Error: Failed to fork process: %s\n", strerror(errno));
+        return -1;
+    }
+    if (pid > 0) {
+        return pid;
+    }
+    
+    if (out_fd >= 0) dup2(out_fd, STDOUT_FILENO);
+    if (err_fd >= 0) dup2(err_fd, STDERR_FILENO);
+    int ret = run_tcc(argc, args, temp_dir, tcc_path, tcc_path_size);
+    fflush(stdout);
+    fflush(stderr);
+    _exit(ret);
+}
+
+// Returns -1 if the invocation is not a parallel one (the caller runs it
+// as is), otherwise the exit status of the whole build
+static int compile_parallel(int argc, char **args, int max_jobs, int min_sources, const char *temp_dir,
+                            char *tcc_path, size_t tcc_path_size) {
+    int compile_only, has_output;
+    int count = count_c_sources(argc, args, &compile_only, &has_output);
+    
+    // "-c -o out.o a.c b.c" is an error tcc should report itself
+    if (count < (compile_only ? 2 : min_sources) || (compile_only && has_output)) {
+        return -1;
+    }
+    
+    // Objects for the link step go to a private directory; -c writes them
+    // next to the caller like tcc does
+    char object_dir[MAX_PATH] = "";
+    if (!compile_only) {
+        const char *tmpdir = getenv("TMPDIR");
+        if (tmpdir == NULL) tmpdir = getenv("TEMP");
+        if (tmpdir == NULL) tmpdir = "/tmp";
+        snprintf(object_dir, sizeof(object_dir), "%s/sscc_objs_XXXXXX", tmpdir);
+        if (!mkdtemp(object_dir)) {
+            fprintf(stderr, "Warning: Cannot create object directory, compiling serially\n");
+            return -1;
+        }
+    }
+    
+    // Load tcc once here rather than in every job
+    if (prepare_tcc_binary(temp_dir, tcc_path, tcc_path_size) != 0) {
+        if (object_dir[0]) rmdir(object_dir);
+        return 1;
+    }
+    
+    CompileJob *jobs = calloc(count, sizeof(CompileJob));
+    char **compile_args = malloc((argc + 5) * sizeof(char*));
+    int common_count = 0;
+    int job_count = 0;
+    
+    // Compile flags are the full command line minus inputs and link options
+    for (int i = 0; i < argc; i++) {
+        const char *arg = args[i];
+        if (i > 0 && arg[0] != '-') {
+            if (is_c_source(arg)) {
+                CompileJob *job = &jobs[job_count++];
+                job->arg_index = i;
+                job->pid = -1;
+                job->out_fd = job->err_fd = -1;
+                job->status = -1;
+                
+                const char *base = strrchr(arg, '/') ? strrchr(arg, '/') + 1 : arg;
+                if (compile_only) {
+                    snprintf(job->object, sizeof(job->object), "%.*s.o", (int)strlen(base) - 2, base);
+                } else {
+                    snprintf(job->object, sizeof(job->object), "%s/%d_%.*s.o",
+                             object_dir, job_count, (int)strlen(base) - 2, base);
+                }
+            }
+            continue;
+        }
+        int takes_arg = i > 0 && tcc_option_takes_arg(arg) && i + 1 < argc;
+        if (i == 0 || !is_link_only_option(arg)) {
+            compile_args[common_count++] = args[i];
+            if (takes_arg) compile_args[common_count++] = args[i + 1];
+        }
+        if (takes_arg) i++;
+    }
+    
+    int next = 0, replayed = 0, running = 0;
+    int failed = 0;
+    while (replayed < next || (!failed && next < count)) {
+        // Start jobs in order; stop starting new ones after a failure
+        while (!failed && next < count && running < max_jobs) {
+            CompileJob *job = &jobs[next++];
+            compile_args[common_count] = "-c";
+            compile_args[common_count + 1] = args[job->arg_index];
+            compile_args[common_count + 2] = "-o";
+            compile_args[common_count + 3] = job->object;
+            compile_args[common_count + 4] = NULL;
+            
+            job->start = trace_now();
+            job->out_fd = open_capture_file();
+            job->err_fd = open_capture_file();
+            job->pid = spawn_compile_job(common_count + 4, compile_args, temp_dir,
+                                         tcc_path, tcc_path_size, job->out_fd, job->err_fd);
+            if (job->pid < 0) {
+                job->status = 1;
+                failed = 1;
+            } else {
+                running++;
+            }
+        }
+        
+        if (running > 0) {
+            int status;
+            pid_t pid = waitpid(-1, &status, 0);
+            if (pid < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            if (lazy_reaped(pid, status)) continue;
+            for (int j = 0; j < next; j++) {
+                if (jobs[j].pid == pid && jobs[j].status < 0) {
+                    jobs[j].status = tcc_exit_status(status);
+                    trace_span("compile_job", jobs[j].start, args[jobs[j].arg_index]);
+                    if (jobs[j].status != 0) failed = 1;
+                    running--;
+                    break;
+                }
+            }
+        }
+        
+        // Flush the output of every finished job with no earlier job pending
+        while (replayed < next && jobs[replayed].status >= 0) {
+            replay_capture(jobs[replayed].out_fd, STDOUT_FILENO);
+            replay_capture(jobs[replayed].err_fd, STDERR_FILENO);
+            replayed++;
+        }
+    }
+    
+    // First failure in command-line order decides the result
+    int ret = 0;
+    for (int j = 0; j < next && ret == 0; j++) {
+        ret = jobs[j].status;
+    }
+    if (ret < 0) ret = 1;
+    
+    if (ret == 0 && !compile_only) {
+        // Single link: the original command line with sources swapped for objects
+        char **link_args = malloc((argc + 1) * sizeof(char*));
+        memcpy(link_args, args, argc * sizeof(char*));
+        for (int j = 0; j < count; j++) {
+            link_args[jobs[j].arg_index] = jobs[j].object;
+        }
+        link_args[argc] = NULL;
+        ret = run_link(argc, link_args, temp_dir, tcc_path, tcc_path_size);
+        free(link_args);
+    }
+    
+    if (object_dir[0]) {
+        remove_cache_tree(object_dir);
+    }
+    free(compile_args);
+    free(jobs);
+    return ret;
+}
+
+// Access profiling (--sscc-profile=FILE)
+//
+// Profiled compiles run with -MD, so tcc lists every header, object and
+// library it opened. The ones inside the tree are appended to FILE relative
+// to it, one per line and one write per compile, so concurrent compiles can
+// share a profile. `sort | uniq -c` over many profiles gives the hot-set
+// manifest embed_resources and create_addon order archives by (make hot-set).
+#define PROFILE_DEPS_LIMIT (4 * 1024 * 1024)
+
+// Adds -MD -MF to args (which has room for three more) unless the caller
+// asked for dependency output of their own. Returns 0 if deps will be written.
+static int add_profile_args(int *argc, char **args, char *deps, size_t deps_size) {
+    for (int i = 1; i < *argc; i++) {
+        if (strncmp(args[i], "-M", 2) == 0) return -1;
+    }
+    
+    const char *tmpdir = getenv("TMPDIR");
+    if (tmpdir == NULL) tmpdir = "/tmp";
+    snprintf(deps, deps_size, "%s/sscc_deps_XXXXXX", tmpdir);
+    int fd = mkstemp(deps);
+    if (fd < 0) return -1;
+    close(fd);
+    
+    args[(*argc)++] = "-MD";
+    args[(*argc)++] = "-MF";
+    args[(*argc)++] = deps;
+    args[*argc] = NULL;
+    return 0;
+}
+
+// Next file of a "target: dep dep \<newline> dep ..." list, starting after
+// the target's colon. Returns NULL at the end.
+static char *next_dependency(char **cursor, char *end, size_t *len) {
+    char *p = *cursor;
+    while (p < end && (*p == ':' || *p == '\\' || isspace((unsigned char)*p))) p++;
+    if (p >= end) return NULL;
+    char *token = p;
+    while (p < end && !isspace((unsigned char)*p)) p++;
+    *len = p - token;
+    *cursor = p;
+    return token;
+}
+
+static void record_profile(const char *deps, const char *tree) {
+    size_t size;
+    char *data = read_file_prefix(deps, PROFILE_DEPS_LIMIT, &size);
+    unlink(deps);
+    if (!data) return;
+    
+    // The target is never in the tree
+    char *out = malloc(size + 1);
+    size_t used = 0;
+    size_t tree_len = strlen(tree);
+    char *end = data + size;
+    char *cursor = memchr(data, ':', size);
+    char *token;
+    size_t len;
+    while (out && cursor && (token = next_dependency(&cursor, end, &len)) != NULL) {
+        if (len > tree_len + 1 && memcmp(token, tree, tree_len) == 0 && token[tree_len] == '/') {
+            memcpy(out + used, token + tree_len + 1, len - tree_len - 1);
+            used += len - tree_len - 1;
+            out[used++] = '\n';
+        }
+    }
+    
+    int fd = open(profile_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0 || (used > 0 && write(fd, out, used) != (ssize_t)used)) {
+        fprintf(stderr, "Warning: Cannot write profile %s: %s\n", profile_path, strerror(errno));
+    }
+    if (fd >= 0) close(fd);
+    free(out);
+    free(data);
+}
+
+static int run_compile(int argc, char **args, int parallel_jobs, const char *temp_dir,
+                       char *tcc_path, size_t tcc_path_size) {
+    int ret = -1;
+    // With the libraries deferred a single source is compiled on its own
+    // too, so that its link is one of objects (see run_link)
+    if (parallel_jobs > 1 || libraries_deferred) {
+        ret = compile_parallel(argc, args, parallel_jobs, libraries_deferred ? 1 : 2, temp_dir,
+                               tcc_path, tcc_path_size);
+    }
+    if (ret < 0) {
+        ret = run_link(argc, args, temp_dir, tcc_path, tcc_path_size);
+    }
+    return ret;
+}
+
+// Runs the compile while the rest of the core is still being extracted
+// (see Lazy extraction). Its output is held back; if it fails, the
+// extraction is waited for and the compile run again, and only the second
+// attempt is seen. Invocations that cannot run twice (-run executes the
+// program, "-" consumes stdin) wait for the whole core first instead.
+static int compile_lazily(int argc, char **args, int parallel_jobs, const char *temp_dir,
+                          char *tcc_path, size_t tcc_path_size) {
+    int repeatable = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(args[i], "-run", 4) == 0 || strcmp(args[i], "-") == 0) repeatable = 0;
+    }
+    
+    HeldOutput held;
+    if (!repeatable || hold_output(&held) != 0) {
+        if (finish_lazy_extraction() != 0) return 1;
+        return run_compile(argc, args, parallel_jobs, temp_dir, tcc_path, tcc_path_size);
+    }
+    
+    int ret = run_compile(argc, args, parallel_jobs, temp_dir, tcc_path, tcc_path_size);
+    int retry = ret != 0 && finish_lazy_extraction() == 0;
+    release_output(&held, !retry);
+    if (retry) {
+        trace_instant("lazy_retry", NULL);
+        return run_compile(argc, args, parallel_jobs, temp_dir, tcc_path, tcc_path_size);
+    }
+    return ret;
+}
+
+// Script mode (--run)
+//
+// `sscc [flags] --run script.c args...`, or a script starting with
+// `#!/usr/bin/env -S sscc --run`, compiles the script once and then execs
+// the executable. Executables live in the object cache store. They are keyed
+// by the script's path and bytes, the flags, the core and TCC hashes from the
+// payload trailer, the --addon files and the environment tcc and addon
+// activation read, plus the working directory when there are flags. A second
+// entry lists every file outside the tree the compile read, with a hash of
+// its content, and the addons activated for it and the addon directories,
+// with their identity (see file_identity) rather than a hash. The lookup
+// comes right after the arguments are parsed: a run whose key matches and
+// whose files are unchanged execs the stored executable without mapping the
+// payload, looking for addons or hashing them, building a tree or compiling.
+// Without a cache directory, or with --sscc-no-object-cache, the script
+// runs through tcc -run.
+#define RUN_CACHE_VERSION "sscc-run-2"
+#define RUN_DEPS_LIMIT (1024 * 1024)
+
+typedef struct {
+    char dir[MAX_PATH];         // object cache store
+    char entry[MAX_PATH];       // stored executable
+    char deps[MAX_PATH];        // its dependency list
+    char output[MAX_PATH];      // executable being compiled, renamed to entry
+    char depfile[MAX_PATH];     // tcc -MD output
+} RunCacheSlot;
+
+// addon_files are the --addon ones, auto addons being in the dependency list
+static int run_cache_key(int flag_count, char **flags, const char *script,
+                         char **addon_files, int addon_count, RunCacheSlot *slot) {
+    char script_path[MAX_PATH];
+    uint64_t payload_hash;
+    if (get_object_cache_dir(slot->dir, sizeof(slot->dir)) != 0 || !realpath(script, script_path) ||
+        trailer_key(&payload_hash) != 0) {
+        return -1;
+    }
+    
+    uint64_t h = sscc_hash64(RUN_CACHE_VERSION, strlen(RUN_CACHE_VERSION), SSCC_HASH_INIT);
+    h = sscc_hash_u64(payload_hash, h);
+    for (int i = 0; i < addon_count; i++) {
+        char addon_path[MAX_PATH];
+        if (!realpath(addon_files[i], addon_path) || file_identity(addon_path, &h) != 0) return -1;
+        h = sscc_hash64(addon_path, strlen(addon_path) + 1, h);
+    }
+    h = sscc_hash_u64(use_auto_addons, h);
+    static const char *const environment[] = { "CPATH", "C_INCLUDE_PATH", "LIBRARY_PATH", "SSCC_ADDON_PATH", NULL };
+    for (int i = 0; environment[i]; i++) {
+        const char *value = getenv(environment[i]);
+        h = sscc_hash64(value ? value : "", value ? strlen(value) + 1 : 0, h);
+        h = sscc_hash64("\n", 1, h);
+    }
+    for (int i = 0; i < flag_count; i++) {
+        h = sscc_hash64(flags[i], strlen(flags[i]) + 1, h);
+    }
+    // Relative -I/-L/-include paths resolve against it
+    char cwd[MAX_PATH];
+    if (flag_count > 0) {
+        if (!getcwd(cwd, sizeof(cwd))) return -1;
+        h = sscc_hash64(cwd, strlen(cwd) + 1, h);
+    }
+    h = sscc_hash64(script_path, strlen(script_path) + 1, h);
+    if (hash_file(script_path, &h) != 0) return -1;
+    
+    if (snprintf(slot->entry, sizeof(slot->entry), "%s/%016llx", slot->dir, (unsigned long long)h) >=
+        (int)sizeof(slot->entry) ||
+        snprintf(slot->deps, sizeof(slot->deps), "%s/%016llx", slot->dir,
+                 (unsigned long long)sscc_hash64("deps", 4, h)) >= (int)sizeof(slot->deps)) {
+        return -1;
+    }
+    return 0;
+}
+
+// The dependency list holds "<hash> <absolute path>" lines, and
+// "@<identity> <path>" lines for addons and addon directories
+static int run_cache_valid(const RunCacheSlot *slot) {
+    size_t size;
+    char *data = read_file_prefix(slot->deps, RUN_DEPS_LIMIT, &size);
+    if (!data) return 0;
+    
+    int valid = size > 0 && size < RUN_DEPS_LIMIT && data[size - 1] == '\n';
+    char *line = data, *end = data + size;
+    while (valid && line < end) {
+        char *newline = memchr(line, '\n', end - line);
+        *newline = '\0';
+        unsigned long long expected;
+        int offset = 0;
+        int identity = *line == '@';
+        uint64_t h = SSCC_HASH_INIT;
+        valid = sscanf(line + identity, "%16llx %n", &expected, &offset) == 1 && offset > 0 &&
+                (identity ? file_identity(line + 1 + offset, &h) : hash_file(line + offset, &h)) == 0 &&
+                h == expected;
+        line = newline + 1;
+    }
+    free(data);
+    return valid;
+}
+
+// Runs the stored executable in place of sscc, with the script as argv[0]
+// like tcc -run. Returns only if it cannot be executed.
+static void exec_cached_script(const RunCacheSlot *slot, char **script_args) {
+    utimensat(AT_FDCWD, slot->entry, NULL, 0);
+    trace_instant("exec", slot->entry);
+    trace_close();
+    fflush(stdout);
+    fflush(stderr);
+    execv(slot->entry, script_args);
+}
+
+// Appends an identity line for path, made absolute if it exists
+static int run_cache_identity(FILE *out, const char *path) {
+    char absolute[MAX_PATH];
+    uint64_t h = SSCC_HASH_INIT;
+    if (realpath(path, absolute)) path = absolute;
+    if (file_identity(path, &h) != 0) return -1;
+    fprintf(out, "@%016llx %s\n", (unsigned long long)h, path);
+    return 0;
+}
+
+// Records the compile's dependencies outside the tree, the auto addons it
+// activated and the directories they are searched in, and moves the
+// executable into the store; the executable goes first, so a concurrent run
+// never pairs a new list with an old executable
+static int run_cache_store(const RunCacheSlot *slot, const char *tree, char **auto_files, int auto_count) {
+    size_t size;
+    char *data = read_file_prefix(slot->depfile, RUN_DEPS_LIMIT, &size);
+    unlink(slot->depfile);
+    if (!data || size >= RUN_DEPS_LIMIT) {
+        free(data);
+        return -1;
+    }
+    
+    char *list = NULL;
+    size_t list_size = 0;
+    FILE *out = open_memstream(&list, &list_size);
+    size_t tree_len = strlen(tree);
+    char *end = data + size;
+    char *cursor = memchr(data, ':', size);
+    char *token;
+    size_t len;
+    int ret = out && cursor ? 0 : -1;
+    while (ret == 0 && (token = next_dependency(&cursor, end, &len)) != NULL) {
+        if (len > tree_len && memcmp(token, tree, tree_len) == 0 && token[tree_len] == '/') continue;
+        
+        char path[MAX_PATH], absolute[MAX_PATH];
+        snprintf(path, sizeof(path), "%.*s", (int)len, token);
+        uint64_t h = SSCC_HASH_INIT;
+        if (!realpath(path, absolute) || hash_file(absolute, &h) != 0) {
+            ret = -1;
+            break;
+        }
+        fprintf(out, "%016llx %s\n", (unsigned long long)h, absolute);
+    }
+    for (int i = 0; ret == 0 && i < auto_count; i++) {
+        ret = run_cache_identity(out, auto_files[i]);
+    }
+    // New addons in them may be activated for the script
+    char self_dir[MAX_PATH];
+    const char *search = use_auto_addons && ret == 0 ? addon_search_path(self_dir, sizeof(self_dir)) : NULL;
+    char *dirs = search ? strdup(search) : NULL;
+    char *saveptr = NULL;
+    for (char *dir = dirs ? strtok_r(dirs, ":", &saveptr) : NULL; dir && ret == 0;
+         dir = strtok_r(NULL, ":", &saveptr)) {
+        ret = run_cache_identity(out, dir);
+    }
+    if (search && !dirs) ret = -1;
+    free(dirs);
+    if (out && fclose(out) != 0) ret = -1;
+    free(data);
+    
+    // The output was created by mkstemp, so tcc kept its 0600 mode
+    struct stat st;
+    char temp[MAX_PATH + 16];
+    snprintf(temp, sizeof(temp), "%s.tmp%d", slot->deps, (int)getpid());
+    if (ret == 0 && (chmod(slot->output, 0755) != 0 || stat(slot->output, &st) != 0 ||
+                     rename(slot->output, slot->entry) != 0 ||
+                     write_file_data(temp, list, list_size) != 0 || rename(temp, slot->deps) != 0)) {
+        unlink(temp);
+        ret = -1;
+    }
+    free(list);
+    if (ret == 0) object_cache_account(0, 1, 0, st.st_size + list_size);
+    return ret;
 }
 
-// External symbols for embedded core archive and TCC binary
-extern const unsigned char sscc_archive_data[];
-extern const unsigned int sscc_archive_size;
-extern const unsigned char tcc_binary_data[];
-extern const unsigned int tcc_binary_size;
-int main(int argc, char *argv[]) {
+// Maps the core and TCC appended to our executable; the server client path
+// never needs them, so this happens on first use rather than in main()
+static int load_payload(void) {
+    if (payload.map) return 0;
+    if (payload_open(&payload, "/proc/self/exe") != 0) {
+        fprintf(stderr, "Error: No core payload attached to /proc/self/exe (see sscc_payload)\n");
+        return -1;
+    }
+    return 0;
+}
+
+// The payload is only mapped once a --run cache lookup has missed
+static int sscc_main(int argc, char *argv[]) {
     char *addon_files[64] = {0};
     int addon_count = 0;
+    int gc_requested = 0;
+    int gc_max_age = CACHE_DEFAULT_MAX_AGE_DAYS;
+    int parallel_jobs = 1;
+    int run_index = 0;          // argv index of the --run script
+    const char *trace_path = getenv("SSCC_TRACE");
     char **filtered_args = malloc(argc * sizeof(char*));
     int filtered_argc = 0;
     
@@ -542,6 +4865,28 @@ int main(int argc, char *argv[]) {
             printf("\n");
             printf("Modular options:\n");
             printf("  --addon FILE    Load addon file (.addon)\n");
+            printf("  --sscc-list-addon=FILE List the files in an addon without extracting it\n");
+            printf("  --sscc-no-auto-addons Only load addons given with --addon\n");
+            printf("\n");
+            printf("Cache options:\n");
+            printf("  --sscc-no-cache Extract into a private temporary directory\n");
+            printf("  --sscc-gc[=DAYS] Remove cached cores unused for DAYS days (default %d)\n",
+                   CACHE_DEFAULT_MAX_AGE_DAYS);
+            printf("  --sscc-no-header-cache Preprocess system headers on every compile\n");
+            printf("  --sscc-no-object-cache Always run the compiler, never reuse outputs\n");
+            printf("  --sscc-cache-stats Show object cache hits, misses and size\n");
+            printf("  --sscc-no-namespace Extract into /dev/shm or /tmp, not a private tmpfs\n");
+            printf("  --sscc-no-lazy  Extract the whole core before compiling, libraries included\n");
+            printf("  --sscc-threads=N Decompress with N threads (default: all CPUs)\n");
+            printf("  --sscc-trace=FILE Write a Chrome trace (Perfetto) of every phase to FILE\n");
+            printf("  --sscc-profile=FILE Append the core and addon files each compile opens to FILE\n");
+            printf("\n");
+            printf("Server options:\n");
+            printf("  --server        Serve compiles from a warm cached tree over a Unix socket\n");
+            printf("  --sscc-workers=N Pre-forked workers, i.e. concurrent compiles (default: all CPUs)\n");
+            printf("  --sscc-idle=SECS Exit after SECS without requests (default %d, 0 = never)\n",
+                   SERVER_DEFAULT_IDLE);
+            printf("  --sscc-no-server Compile locally even if a server is running\n");
             printf("\n");
             printf("Common options:\n");
             printf("  -o FILE         Output to FILE\n");
@@ -553,18 +4898,44 @@ int main(int argc, char *argv[]) {
             printf("  -I DIR          Add include directory\n");
             printf("  -L DIR          Add library directory\n");
             printf("  -l LIB          Link with library\n");
+            printf("  -j N            Compile up to N source files in parallel, then link once\n");
+            printf("  --run FILE ARGS Compile FILE once, cache the executable and run it with ARGS\n");
+            printf("\n");
+            printf("Environment:\n");
+            printf("  SSCC_CACHE_DIR  Cache location (default $XDG_CACHE_HOME/sscc or ~/.cache/sscc)\n");
+            printf("  SSCC_NO_CACHE   Same as --sscc-no-cache when set\n");
+            printf("  SSCC_NO_HEADER_CACHE Same as --sscc-no-header-cache when set\n");
+            printf("  SSCC_NO_OBJECT_CACHE Same as --sscc-no-object-cache when set\n");
+            printf("  SSCC_NO_NAMESPACE Same as --sscc-no-namespace when set\n");
+            printf("  SSCC_NO_LAZY    Same as --sscc-no-lazy when set\n");
+            printf("  SSCC_ADDON_PATH Addon directories (default: DIR/../lib/sscc/addons, DIR holding sscc)\n");
+            printf("  SSCC_NO_AUTO_ADDONS Same as --sscc-no-auto-addons when set\n");
+            printf("  SSCC_OBJECT_CACHE_SIZE Object cache limit in MB (default %d)\n",
+                   OBJECT_CACHE_DEFAULT_MB);
+            printf("  SSCC_THREADS    Default decompression thread count\n");
+            printf("  SSCC_NO_URING   Write extracted files one system call at a time, without io_uring\n");
+            printf("  SSCC_TRACE      Same as --sscc-trace=FILE when set\n");
+            printf("  SSCC_PROFILE    Same as --sscc-profile=FILE when set\n");
+            printf("  SSCC_SERVER_SOCKET Server socket, in a directory only you can write to\n");
+            printf("                  (default $XDG_RUNTIME_DIR or /tmp/sscc-UID, sscc-UID-HASH.sock)\n");
+            printf("  SSCC_NO_SERVER  Same as --sscc-no-server when set\n");
             printf("\n");
             return 0;
         } else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--version") == 0) {
+            if (load_payload() != 0) return 1;
             printf("SSCC v%s - Self Sufficient C Compiler\n", SSCC_VERSION);
             printf("Built with complete musl libc and TCC compiler integration\n");
-            printf("Core size: %u files, TCC binary: %u bytes\n", 
-                   sscc_archive_size > 0 ? 228 : 0, tcc_binary_size);
+            printf("Core archive: %zu bytes, TCC binary: %zu bytes\n", payload.core_size, payload.tcc_size);
             printf("\n");
             printf("Features:\n");
             printf("  • Complete C99/C11 standard library\n");
             printf("  • Static linking with musl libc\n");
             printf("  • RAM-based compilation (memfd/shm)\n");
+#ifdef SSCC_USE_LIBTCC
+            printf("  • In-process compilation via libtcc\n");
+#endif
+            printf("  • Persistent extraction cache\n");
+            printf("  • Parallel decompression\n");
             printf("  • Modular addon system\n");
             printf("  • Single portable binary\n");
             printf("\n");
@@ -574,70 +4945,268 @@ int main(int argc, char *argv[]) {
         } else if (strcmp(argv[i], "--addon") == 0 && i + 1 < argc) {
             addon_files[addon_count++] = argv[i + 1];
             i++; // Skip the addon file argument
+        } else if (strncmp(argv[i], "-j", 2) == 0) {
+            // -j N / -jN; a bare -j or -j0 means one job per CPU
+            if (argv[i][2]) {
+                parallel_jobs = atoi(argv[i] + 2);
+            } else if (i + 1 < argc && argv[i + 1][0] &&
+                       strspn(argv[i + 1], "0123456789") == strlen(argv[i + 1])) {
+                parallel_jobs = atoi(argv[++i]);
+            } else {
+                parallel_jobs = 0;
+            }
+            if (parallel_jobs <= 0) parallel_jobs = pool_default_threads();
+        } else if (strcmp(argv[i], "--sscc-no-cache") == 0) {
+            use_cache = 0;
+        } else if (strncmp(argv[i], "--sscc-trace=", 13) == 0) {
+            trace_path = argv[i] + 13;
+        } else if (strcmp(argv[i], "--sscc-no-object-cache") == 0) {
+            use_object_cache = 0;
+        } else if (strcmp(argv[i], "--sscc-no-namespace") == 0) {
+            use_namespace = 0;
+        } else if (strcmp(argv[i], "--sscc-no-lazy") == 0) {
+            use_lazy = 0;
+        } else if (strcmp(argv[i], "--sscc-no-auto-addons") == 0) {
+            use_auto_addons = 0;
+        } else if (strncmp(argv[i], "--sscc-profile=", 15) == 0) {
+            profile_path = argv[i] + 15;
+        } else if (strncmp(argv[i], "--sscc-list-addon=", 18) == 0) {
+            free(filtered_args);
+            return list_addon(argv[i] + 18);
+        } else if (strcmp(argv[i], "--sscc-cache-stats") == 0) {
+            free(filtered_args);
+            return object_cache_stats();
+        } else if (strcmp(argv[i], "--sscc-no-header-cache") == 0) {
+            use_header_cache = 0;
+        } else if (strcmp(argv[i], "--sscc-no-server") == 0) {
+            // Only meaningful to the client check in main()
+        } else if (strcmp(argv[i], "--sscc-gc") == 0) {
+            gc_requested = 1;
+        } else if (strncmp(argv[i], "--sscc-gc=", 10) == 0) {
+            gc_requested = 1;
+            gc_max_age = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--sscc-threads=", 15) == 0) {
+            decode_threads = atoi(argv[i] + 15);
+        } else if (strcmp(argv[i], "--sscc-bench=extract") == 0) {
+            free(filtered_args);
+            return load_payload() != 0 ? 1 : bench_extract();
+        } else if (strcmp(argv[i], "--sscc-bench=exec") == 0) {
+            free(filtered_args);
+            return load_payload() != 0 ? 1 : bench_exec();
+        } else if (strcmp(argv[i], "--run") == 0) {
+            // The script and its own arguments follow
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --run needs a script\n");
+                free(filtered_args);
+                return 1;
+            }
+            run_index = i + 1;
+            break;
         } else {
             filtered_args[filtered_argc++] = argv[i];
         }
     }
     
-    // Create temporary directory (RAM filesystem if possible)
-    char temp_dir[MAX_PATH];
-    char *temp_template = get_temp_dir_template();
-    strcpy(temp_dir, temp_template);
-    if (create_temp_directory(temp_dir) != 0) {
-        fprintf(stderr, "Error: Cannot create temporary directory\n");
-        free(filtered_args);
-        return 1;
+    const char *no_cache = getenv("SSCC_NO_CACHE");
+    if (no_cache && *no_cache && strcmp(no_cache, "0") != 0) {
+        use_cache = 0;
     }
     
-    printf("SSCC - Modular C Compiler\n");
+    const char *no_object_cache = getenv("SSCC_NO_OBJECT_CACHE");
+    if (no_object_cache && *no_object_cache && strcmp(no_object_cache, "0") != 0) {
+        use_object_cache = 0;
+    }
     
-    // Extract core archive
-    if (extract_core_archive((const char*)sscc_archive_data, sscc_archive_size, temp_dir) != 0) {
-        fprintf(stderr, "Error: Failed to extract core resources\n");
-        cleanup_temp_dir(temp_dir);
+    const char *no_namespace = getenv("SSCC_NO_NAMESPACE");
+    if (no_namespace && *no_namespace && strcmp(no_namespace, "0") != 0) {
+        use_namespace = 0;
+    }
+    
+    const char *no_header_cache = getenv("SSCC_NO_HEADER_CACHE");
+    if (no_header_cache && *no_header_cache && strcmp(no_header_cache, "0") != 0) {
+        use_header_cache = 0;
+    }
+    
+    const char *no_lazy = getenv("SSCC_NO_LAZY");
+    if (no_lazy && *no_lazy && strcmp(no_lazy, "0") != 0) {
+        use_lazy = 0;
+    }
+    
+    // A profile has to see the real headers, not a cached object or flat header
+    const char *profile_env = getenv("SSCC_PROFILE");
+    if (!profile_path && profile_env && *profile_env) {
+        profile_path = profile_env;
+    }
+    if (profile_path && *profile_path) {
+        use_object_cache = 0;
+        use_header_cache = 0;
+    } else {
+        profile_path = NULL;
+    }
+    
+    if (gc_requested) {
         free(filtered_args);
-        return 1;
+        return load_payload() != 0 ? 1 : cache_gc(gc_max_age, addon_files, addon_count);
     }
     
-    // Extract embedded TCC binary
-    char tcc_path[MAX_PATH];
-    snprintf(tcc_path, sizeof(tcc_path), "%s/tcc", temp_dir);
-    FILE *tcc_file = fopen(tcc_path, "wb");
-    if (!tcc_file) {
-        fprintf(stderr, "Error: Cannot create TCC binary at %s\n", tcc_path);
-        cleanup_temp_dir(temp_dir);
+    // Closed at exit so that every return below still ends the JSON array
+    if (trace_path && *trace_path) {
+        if (trace_open(trace_path) == 0) {
+            atexit(trace_close);
+        } else {
+            fprintf(stderr, "Warning: Cannot write trace to %s\n", trace_path);
+        }
+    }
+    
+    char temp_dir[MAX_PATH];
+    char tcc_path[MAX_PATH + 8];
+    int cache_lock = -1;
+    
+    const char *no_auto_addons = getenv("SSCC_NO_AUTO_ADDONS");
+    if (no_auto_addons && *no_auto_addons && strcmp(no_auto_addons, "0") != 0) {
+        use_auto_addons = 0;
+    }
+    
+    // Script mode: a stored executable runs before anything else is done
+    RunCacheSlot run_slot;
+    int run_cached = 0;
+    uint64_t start = trace_now();
+    if (run_index > 0) {
+        run_cached = use_object_cache &&
+                     run_cache_key(filtered_argc - 1, filtered_args + 1, argv[run_index],
+                                   addon_files, addon_count, &run_slot) == 0;
+        if (run_cached && run_cache_valid(&run_slot)) {
+            trace_span("run_cache_lookup", start, "hit");
+            exec_cached_script(&run_slot, argv + run_index);
+        }
+        trace_span("run_cache_lookup", start, run_cached ? "miss" : "uncacheable");
+    }
+    if (load_payload() != 0) {
         free(filtered_args);
         return 1;
     }
-    fwrite(tcc_binary_data, 1, tcc_binary_size, tcc_file);
-    fclose(tcc_file);
-    chmod(tcc_path, 0755); // Make executable
     
-    // Track TCC binary size
-    track_file_size(tcc_path, tcc_binary_size);
+    // Addons from the search path join the --addon ones when needed
+    int explicit_count = addon_count;
+    if (use_auto_addons) {
+        uint64_t activation_start = trace_now();
+        activate_auto_addons(filtered_argc, filtered_args, run_index > 0 ? argv[run_index] : NULL,
+                             addon_files, &addon_count);
+        trace_span("addon_activation", activation_start, addon_count > explicit_count ? "activated" : "none");
+    }
     
-    // Load addons (only explicitly specified ones)
-    load_addons(temp_dir, addon_files, addon_count);
+    // Identifies the core and addons for both the tree and the object cache
+    if ((use_cache || use_object_cache) &&
+        compute_cache_key(addon_files, addon_count, &core_key) != 0) {
+        core_key = 0;
+    }
     
-    // Show total RAM usage before compilation
-    if (use_ram_filesystem) {
-        char total_str[64];
-        format_bytes(total_ram_used, total_str, sizeof(total_str));
+    // Script mode, not found in the cache: the script is compiled with its
+    // dependencies listed, and sscc's own messages are kept off the
+    // script's stdout
+    int script_stdout = -1;
+    if (run_index > 0) {
+        run_slot.output[0] = run_slot.depfile[0] = '\0';
+        if (run_cached) {
+            const char *tmpdir = getenv("TMPDIR");
+            if (tmpdir == NULL) tmpdir = "/tmp";
+            int output_fd = -1, depfile_fd = -1;
+            if (snprintf(run_slot.output, sizeof(run_slot.output), "%s/run_XXXXXX", run_slot.dir) <
+                (int)sizeof(run_slot.output) &&
+                snprintf(run_slot.depfile, sizeof(run_slot.depfile), "%s/sscc_deps_XXXXXX", tmpdir) <
+                (int)sizeof(run_slot.depfile)) {
+                output_fd = mkstemp(run_slot.output);
+                depfile_fd = output_fd >= 0 ? mkstemp(run_slot.depfile) : -1;
+            }
+            if (output_fd >= 0) close(output_fd);
+            if (depfile_fd >= 0) close(depfile_fd);
+            if (depfile_fd < 0) {
+                if (output_fd >= 0) unlink(run_slot.output);
+                run_cached = 0;
+            }
+        }
+        // The listed dependencies must be the real ones
+        use_object_cache = 0;
+        use_header_cache = 0;
         
-        const char* method_name = "";
-        switch (ram_method) {
-            case 1: method_name = " (memfd)"; break;
-            case 2: method_name = " (/dev/shm)"; break;
-            case 3: method_name = " (disk)"; break;
+        fflush(stdout);
+        script_stdout = dup(STDOUT_FILENO);
+        int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        if (null_fd >= 0) {
+            dup2(null_fd, STDOUT_FILENO);
+            close(null_fd);
         }
-        printf("Total cached size: %s%s\n", total_str, method_name);
     }
     
-    // TCC binary is now extracted to temp directory
-    // (No need to look for external sscc.bin file)
+    start = trace_now();
+    if (use_cache && core_key &&
+        cache_acquire(temp_dir, core_key, addon_files, addon_count, &cache_lock) == 0) {
+        trace_span("cache_acquire", start, temp_dir);
+        // Warm (or freshly populated) persistent tree: nothing to extract
+        ram_method = 4;
+        snprintf(tcc_path, sizeof(tcc_path), "%s/tcc", temp_dir);
+    } else {
+        use_cache = 0;
+        
+        // Create temporary directory (RAM filesystem if possible)
+        char *temp_template = get_temp_dir_template();
+        strcpy(temp_dir, temp_template);
+        if (create_temp_directory(temp_dir) != 0) {
+            fprintf(stderr, "Error: Cannot create temporary directory\n");
+            free(filtered_args);
+            return 1;
+        }
+        
+        printf("SSCC - Modular C Compiler\n");
+        
+        // A private tree only needs what this invocation's stages read
+        if (run_index == 0) {
+            extract_phases = invocation_phases(filtered_argc, filtered_args);
+        }
+        
+        // Extract core archive
+        int lazy = use_lazy && lazy_compile_safe(filtered_argc, filtered_args,
+                                                 run_index > 0 ? argv[run_index] : NULL);
+        if (extract_core_archive((const char*)payload.core, payload.core_size, temp_dir, lazy) != 0) {
+            fprintf(stderr, "Error: Failed to extract core resources\n");
+            cancel_lazy_extraction();
+            cleanup_temp_dir(temp_dir);
+            free(filtered_args);
+            return 1;
+        }
+        
+        // Addons may replace core files or link to them, so the core must be complete
+        if (addon_count > 0 && (finish_lazy_extraction() != 0 || write_deferred_libraries(temp_dir) != 0)) {
+            fprintf(stderr, "Error: Failed to extract core resources\n");
+            cleanup_temp_dir(temp_dir);
+            free(filtered_args);
+            return 1;
+        }
+        
+        // The TCC binary itself is only written out if it is going to be run
+        snprintf(tcc_path, sizeof(tcc_path), "%s/tcc", temp_dir);
+        
+        // Load addons (--addon ones and those activated for this invocation)
+        load_addons(temp_dir, addon_files, addon_count, 0);
+        
+        // Show total RAM usage before compilation
+        if (use_ram_filesystem) {
+            char total_str[64];
+            format_bytes(total_ram_used, total_str, sizeof(total_str));
+            
+            const char* method_name = "";
+            switch (ram_method) {
+                case 1: method_name = " (memfd)"; break;
+                case 2: method_name = " (/dev/shm)"; break;
+                case 3: method_name = " (disk)"; break;
+                case 5: method_name = " (private tmpfs)"; break;
+            }
+            printf("Total cached size: %s%s\n", total_str, method_name);
+        }
+    }
     
     // Prepare arguments for TCC
-    char **tcc_args = malloc((filtered_argc + 10) * sizeof(char*));
+    char **tcc_args = malloc((filtered_argc + 16 + (run_index > 0 ? argc - run_index : 0)) * sizeof(char*));
     int arg_count = 0;
     
     tcc_args[arg_count++] = tcc_path;
@@ -659,37 +5228,568 @@ int main(int argc, char *argv[]) {
     for (int i = 1; i < filtered_argc; i++) {
         tcc_args[arg_count++] = filtered_args[i];
     }
+    if (run_cached) {
+        tcc_args[arg_count++] = "-MD";
+        tcc_args[arg_count++] = "-MF";
+        tcc_args[arg_count++] = run_slot.depfile;
+        tcc_args[arg_count++] = "-o";
+        tcc_args[arg_count++] = run_slot.output;
+        tcc_args[arg_count++] = argv[run_index];
+    } else if (run_index > 0) {
+        tcc_args[arg_count++] = "-run";
+        for (int i = run_index; i < argc; i++) {
+            tcc_args[arg_count++] = argv[i];
+        }
+    }
     tcc_args[arg_count] = NULL;
     
+    char deps_path[MAX_PATH];
+    int profiling = profile_path && add_profile_args(&arg_count, tcc_args, deps_path, sizeof(deps_path)) == 0;
+    
     printf("Starting compilation...\n");
+    fflush(stdout);
+    
+    // tcc -run hands stdout to the script
+    if (script_stdout >= 0 && !run_cached) {
+        dup2(script_stdout, STDOUT_FILENO);
+    }
+    
+    int ret;
+    if (lazy_pending()) {
+        ret = compile_lazily(arg_count, tcc_args, parallel_jobs, temp_dir, tcc_path, sizeof(tcc_path));
+    } else {
+        ret = run_compile(arg_count, tcc_args, parallel_jobs, temp_dir, tcc_path, sizeof(tcc_path));
+    }
+    release_tcc_binary();
+    if (profiling) {
+        record_profile(deps_path, temp_dir);
+    }
+    
+    // Cleanup (cached trees are kept for the next run)
+    if (!use_cache) {
+        cancel_lazy_extraction();
+        cleanup_temp_dir(temp_dir);
+    }
+    
+    if (script_stdout >= 0) {
+        fflush(stdout);
+        dup2(script_stdout, STDOUT_FILENO);
+        close(script_stdout);
+    }
+    if (run_cached) {
+        if (ret == 0 && run_cache_store(&run_slot, temp_dir, addon_files + explicit_count, addon_count - explicit_count) == 0) {
+            exec_cached_script(&run_slot, argv + run_index);
+            fprintf(stderr, "Error: Cannot run %s: %s\n", argv[run_index], strerror(errno));
+            ret = 1;
+        } else if (ret == 0) {
+            fprintf(stderr, "Error: Cannot store the executable for %s\n", argv[run_index]);
+            ret = 1;
+        }
+        unlink(run_slot.output);
+        unlink(run_slot.depfile);
+    }
+    
+    free(filtered_args);
+    free(tcc_args);
+    
+    // Return TCC's exit status
+    return ret;
+}
+
+// Compile server
+//
+// `sscc --server` keeps the cached tree warm and pre-forks workers that
+// block in accept() on a Unix socket. A client (any ordinary sscc run that
+// finds the socket) sends argv, cwd and environment, and passes its stdin,
+// stdout and stderr as descriptors, so compiler output goes straight to the
+// caller's terminal or pipe. For each request the worker forks a child that
+// adopts the client's cwd, environment and descriptors and runs the normal
+// sscc_main() path; only the exit status travels back over the socket.
+#define SERVER_MAGIC 0x53534353u            // "SSCS"
+#define SERVER_MAX_REQUEST (1024 * 1024)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t argc;
+    uint32_t envc;
+    uint32_t payload_size;      // cwd, argv and env strings, NUL-terminated
+} ServerRequest;
+
+// Shared between the server and its workers for idle tracking
+typedef struct {
+    int active;
+    time_t last_activity;
+    int served;                 // requests whose compile ran
+} ServerState;
+
+static volatile sig_atomic_t server_stop = 0;
+
+static void server_stop_handler(int sig) {
+    (void)sig;
+    server_stop = 1;
+}
+
+// SIGTERM and SIGINT, which stop the server
+static void server_stop_signals(sigset_t *set) {
+    sigemptyset(set);
+    sigaddset(set, SIGTERM);
+    sigaddset(set, SIGINT);
+}
+
+// Socket name carries the uid and the core/tcc hash, so a client never
+// talks to a server built from a different sscc. Without XDG_RUNTIME_DIR
+// it lives in a private /tmp/sscc-UID, which the server creates.
+static int get_server_socket(char *path, size_t path_size, int create) {
+    const char *env = getenv("SSCC_SERVER_SOCKET");
+    if (env && *env) {
+        snprintf(path, path_size, "%s", env);
+        return 0;
+    }
+    
+    // The client has not mapped the payload, so only the trailer's hashes
+    // go into the name
+    uint64_t key;
+    if (trailer_key(&key) != 0) return -1;
+    
+    char tmp_dir[64];
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    if (!dir || !*dir) {
+        snprintf(tmp_dir, sizeof(tmp_dir), "/tmp/sscc-%d", (int)getuid());
+        if (create && mkdir(tmp_dir, 0700) != 0 && errno != EEXIST) return -1;
+        dir = tmp_dir;
+    }
+    if (snprintf(path, path_size, "%s/sscc-%d-%08llx.sock", dir, (int)getuid(),
+                 (unsigned long long)(key & 0xffffffffULL)) >= (int)path_size) {
+        return -1;
+    }
+    return 0;
+}
+
+// The socket's directory must belong to us and be closed to everyone else,
+// or another user could bind the path first and receive our environment
+// and descriptors
+static int server_dir_private(const char *socket_path) {
+    char dir[MAX_PATH];
+    snprintf(dir, sizeof(dir), "%s", socket_path);
+    char *slash = strrchr(dir, '/');
+    if (!slash) {
+        strcpy(dir, ".");
+    } else if (slash == dir) {
+        dir[1] = '\0';
+    } else {
+        *slash = '\0';
+    }
+    
+    struct stat st;
+    return lstat(dir, &st) == 0 && S_ISDIR(st.st_mode) && st.st_uid == getuid() &&
+           !(st.st_mode & (S_IWGRP | S_IWOTH));
+}
+
+static int write_all(int fd, const void *data, size_t size) {
+    const char *p = data;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+static int read_all(int fd, void *data, size_t size) {
+    char *p = data;
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+// Client side: returns the compile's exit status, or -1 to fall back to
+// running locally (no server, stale socket, protocol error before sending)
+static int try_server(int argc, char **argv) {
+    char socket_path[MAX_PATH];
+    struct sockaddr_un addr;
+    struct stat st;
+    if (get_server_socket(socket_path, sizeof(socket_path), 0) != 0 ||
+        strlen(socket_path) >= sizeof(addr.sun_path) || lstat(socket_path, &st) != 0 ||
+        !S_ISSOCK(st.st_mode) || st.st_uid != getuid() || !server_dir_private(socket_path)) {
+        return -1;
+    }
+    
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    
+    // Nothing is sent to a server run by someone else
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) != 0 || cred.uid != getuid()) {
+        close(fd);
+        return -1;
+    }
+    
+    char cwd[MAX_PATH];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        close(fd);
+        return -1;
+    }
+    
+    ServerRequest req = { SERVER_MAGIC, argc, 0, strlen(cwd) + 1 };
+    for (int i = 0; i < argc; i++) req.payload_size += strlen(argv[i]) + 1;
+    for (char **e = environ; *e; e++) {
+        req.envc++;
+        req.payload_size += strlen(*e) + 1;
+    }
+    if (req.payload_size > SERVER_MAX_REQUEST) {
+        close(fd);
+        return -1;
+    }
+    
+    char *payload = malloc(req.payload_size);
+    if (!payload) {
+        close(fd);
+        return -1;
+    }
+    size_t pos = 0;
+    size_t len = strlen(cwd) + 1;
+    memcpy(payload, cwd, len);
+    pos += len;
+    for (int i = 0; i < argc; i++) {
+        len = strlen(argv[i]) + 1;
+        memcpy(payload + pos, argv[i], len);
+        pos += len;
+    }
+    for (char **e = environ; *e; e++) {
+        len = strlen(*e) + 1;
+        memcpy(payload + pos, *e, len);
+        pos += len;
+    }
+    
+    // The header travels with our stdin/stdout/stderr
+    int fds[3] = { 0, 1, 2 };
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+    struct iovec iov = { &req, sizeof(req) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    
+    int sent = sendmsg(fd, &msg, MSG_NOSIGNAL) == (ssize_t)sizeof(req) &&
+               write_all(fd, payload, req.payload_size) == 0;
+    free(payload);
+    
+    int32_t status;
+    if (!sent || read_all(fd, &status, sizeof(status)) != 0) {
+        // Once the request is out the compile may have run; do not repeat it
+        close(fd);
+        if (!sent) return -1;
+        fprintf(stderr, "Error: Lost connection to sscc server %s\n", socket_path);
+        return 1;
+    }
+    close(fd);
+    return status;
+}
+
+// Worker side of one connection. Returns 1 if the compile ran.
+static int serve_client(int conn, int listen_fd) {
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) != 0 || cred.uid != getuid()) {
+        return 0;
+    }
+    
+    ServerRequest req;
+    int fds[3] = { -1, -1, -1 };
+    char control[CMSG_SPACE(sizeof(fds))];
+    struct iovec iov = { &req, sizeof(req) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    
+    if (recvmsg(conn, &msg, MSG_CMSG_CLOEXEC) != (ssize_t)sizeof(req)) return 0;
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+        cmsg->cmsg_len == CMSG_LEN(sizeof(fds))) {
+        memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    }
+    
+    char *payload = NULL;
+    char **args = NULL;
+    char **env = NULL;
+    int ran = 0;
+    if (fds[0] < 0 || req.magic != SERVER_MAGIC || req.payload_size > SERVER_MAX_REQUEST ||
+        req.argc == 0 || req.argc + req.envc >= req.payload_size ||
+        !(payload = malloc(req.payload_size)) || read_all(conn, payload, req.payload_size) != 0 ||
+        payload[req.payload_size - 1] != '\0' ||
+        !(args = calloc(req.argc + 1, sizeof(char*))) || !(env = calloc(req.envc + 1, sizeof(char*)))) {
+        goto out;
+    }
+    
+    // Split the payload; every string must be present
+    char *p = payload, *end = payload + req.payload_size;
+    const char *cwd = p;
+    p += strlen(p) + 1;
+    for (uint32_t i = 0; i < req.argc; i++) {
+        if (p >= end) goto out;
+        args[i] = p;
+        p += strlen(p) + 1;
+    }
+    for (uint32_t i = 0; i < req.envc; i++) {
+        if (p >= end) goto out;
+        env[i] = p;
+        p += strlen(p) + 1;
+    }
     
-    // Fork and execute TCC so we can cleanup afterwards
     pid_t pid = fork();
     if (pid == 0) {
-        // Child process: execute TCC
-        execv(tcc_path, tcc_args);
-        // If we get here, execv failed
-        fprintf(stderr, "Error: Failed to execute TCC: %s\n", strerror(errno));
-        exit(1);
-    } else if (pid > 0) {
-        // Parent process: wait for TCC to finish
-        int status;
-        wait(&status);
-        
-        // Cleanup and show total
-        cleanup_temp_dir(temp_dir);
-        
-        free(filtered_args);
-        free(tcc_args);
+        close(listen_fd);
+        close(conn);
+        sigset_t stop_signals;
+        server_stop_signals(&stop_signals);
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGINT, SIG_DFL);
+        sigprocmask(SIG_UNBLOCK, &stop_signals, NULL);
+        if (chdir(cwd) != 0) {
+            dprintf(fds[2], "Error: Cannot enter %s: %s\n", cwd, strerror(errno));
+            _exit(1);
+        }
+        for (int i = 0; i < 3; i++) {
+            dup2(fds[i], i);
+        }
+        environ = env;
+        exit(sscc_main((int)req.argc, args));
+    }
+    
+    int status = 0;
+    int32_t result = 1;
+    if (pid > 0 && waitpid(pid, &status, 0) == pid) {
+        result = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        ran = 1;
+    }
+    write_all(conn, &result, sizeof(result));
+
+out:
+    for (int i = 0; i < 3; i++) {
+        if (fds[i] >= 0) close(fds[i]);
+    }
+    free(payload);
+    free(args);
+    free(env);
+    return ran;
+}
+
+// A worker keeps SIGTERM and SIGINT blocked except while it waits for a
+// connection, so stopping the server (or its idle timeout) never cuts a
+// request off: the signal is taken after the compile, which the client then
+// sees complete. The listening socket is non-blocking, as every worker is
+// woken for a connection only one of them gets.
+static void server_worker(int listen_fd, ServerState *state) {
+    sigset_t stop_signals, waiting;
+    server_stop_signals(&stop_signals);
+    sigprocmask(SIG_BLOCK, &stop_signals, &waiting);
+    sigdelset(&waiting, SIGTERM);
+    sigdelset(&waiting, SIGINT);
+    
+    while (!server_stop) {
+        struct pollfd pfd = { listen_fd, POLLIN, 0 };
+        if (ppoll(&pfd, 1, NULL, &waiting) < 0) {
+            if (errno == EINTR) continue;
+            _exit(1);
+        }
+        int conn = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED || errno == EAGAIN) continue;
+            _exit(1);
+        }
         
-        // Return TCC's exit status
-        return WEXITSTATUS(status);
-    } else {
-        // Fork failed
-        fprintf(stderr, "Error: Failed to fork process: %s\n", strerror(errno));
-        cleanup_temp_dir(temp_dir);
-        free(filtered_args);
-        free(tcc_args);
+        __atomic_add_fetch(&state->active, 1, __ATOMIC_SEQ_CST);
+        if (serve_client(conn, listen_fd)) {
+            __atomic_add_fetch(&state->served, 1, __ATOMIC_SEQ_CST);
+        }
+        close(conn);
+        __atomic_store_n(&state->last_activity, time(NULL), __ATOMIC_SEQ_CST);
+        __atomic_sub_fetch(&state->active, 1, __ATOMIC_SEQ_CST);
+    }
+    _exit(0);
+}
+
+static int run_server(char **addon_files, int addon_count, int workers, int idle_timeout) {
+    if (load_payload() != 0) return 1;
+    
+    char socket_path[MAX_PATH];
+    struct sockaddr_un addr;
+    if (get_server_socket(socket_path, sizeof(socket_path), 1) != 0 ||
+        strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: Cannot determine server socket path\n");
+        return 1;
+    }
+    if (!server_dir_private(socket_path)) {
+        fprintf(stderr, "Error: The directory of %s must be yours and writable only by you\n",
+                socket_path);
+        return 1;
+    }
+    
+    // Warm the tree the workers will use; holding the shared lock keeps
+    // the garbage collector away from it while we run
+    char tree_dir[MAX_PATH];
+    int cache_lock = -1;
+    uint64_t key;
+    if (compute_cache_key(addon_files, addon_count, &key) != 0 ||
+        cache_acquire(tree_dir, key, addon_files, addon_count, &cache_lock) != 0) {
+        fprintf(stderr, "Error: The server needs the extraction cache (check SSCC_CACHE_DIR)\n");
+        return 1;
+    }
+    
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        fprintf(stderr, "Error: Cannot create socket: %s\n", strerror(errno));
+        return 1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+    
+    // Refuse to replace a live server; a socket nobody answers is stale
+    if (connect(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+        fprintf(stderr, "Error: An sscc server is already listening on %s\n", socket_path);
+        close(listen_fd);
         return 1;
     }
+    close(listen_fd);
+    unlink(socket_path);
+    
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    mode_t old_umask = umask(077);
+    int bound = listen_fd >= 0 && bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+    umask(old_umask);
+    if (!bound || listen(listen_fd, 128) != 0) {
+        fprintf(stderr, "Error: Cannot listen on %s: %s\n", socket_path, strerror(errno));
+        if (listen_fd >= 0) close(listen_fd);
+        return 1;
+    }
+    
+    ServerState *state = mmap(NULL, sizeof(ServerState), PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    pid_t *pids = calloc(workers, sizeof(pid_t));
+    if (state == MAP_FAILED || !pids) {
+        fprintf(stderr, "Error: Memory allocation failed\n");
+        close(listen_fd);
+        unlink(socket_path);
+        return 1;
+    }
+    state->active = 0;
+    state->last_activity = time(NULL);
+    state->served = 0;
+    
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = server_stop_handler;
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+    
+    printf("SSCC server listening on %s (%d workers, idle timeout %ds)\n",
+           socket_path, workers, idle_timeout);
+    fflush(stdout);
+    
+    while (!server_stop) {
+        // Keep the pool full; a worker only exits if accept() breaks
+        for (int i = 0; i < workers; i++) {
+            if (pids[i] > 0 && waitpid(pids[i], NULL, WNOHANG) == 0) continue;
+            pids[i] = fork();
+            if (pids[i] == 0) {
+                server_worker(listen_fd, state);
+            }
+        }
+        
+        if (idle_timeout > 0 && __atomic_load_n(&state->active, __ATOMIC_SEQ_CST) == 0 &&
+            time(NULL) - __atomic_load_n(&state->last_activity, __ATOMIC_SEQ_CST) >= idle_timeout) {
+            printf("SSCC server idle for %ds, shutting down\n", idle_timeout);
+            break;
+        }
+        poll(NULL, 0, 1000);
+    }
+    
+    // Stop accepting first so clients fall back to local compiles; workers
+    // finish the request they are in before they see SIGTERM (see
+    // server_worker). Stopping on a signal and when idle take this path.
+    unlink(socket_path);
+    close(listen_fd);
+    for (int i = 0; i < workers; i++) {
+        if (pids[i] > 0) kill(pids[i], SIGTERM);
+    }
+    for (int i = 0; i < workers; i++) {
+        if (pids[i] > 0) waitpid(pids[i], NULL, 0);
+    }
+    
+    printf("SSCC server stopped after %d requests\n", state->served);
+    free(pids);
+    munmap(state, sizeof(ServerState));
+    close(cache_lock);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int server_mode = 0;
+    int local_only = 0;
+    int workers = 0;
+    int idle_timeout = SERVER_DEFAULT_IDLE;
+    char *addon_files[64] = {0};
+    int addon_count = 0;
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--server") == 0) {
+            server_mode = 1;
+        } else if (strncmp(argv[i], "--sscc-workers=", 15) == 0) {
+            workers = atoi(argv[i] + 15);
+        } else if (strncmp(argv[i], "--sscc-idle=", 12) == 0) {
+            idle_timeout = atoi(argv[i] + 12);
+        } else if (strcmp(argv[i], "--addon") == 0 && i + 1 < argc && addon_count < 64) {
+            addon_files[addon_count++] = argv[++i];
+        } else if (strcmp(argv[i], "--run") == 0) {
+            // The script is exec'd in place of this process; the rest of
+            // the command line is its own
+            local_only = 1;
+            break;
+        } else if (strncmp(argv[i], "--sscc-", 7) == 0) {
+            // Cache, GC, benchmark and debugging options always run locally
+            local_only = 1;
+        }
+    }
+    
+    if (server_mode) {
+        if (workers <= 0) workers = pool_default_threads();
+        return run_server(addon_files, addon_count, workers, idle_timeout);
+    }
+    
+    const char *no_server = getenv("SSCC_NO_SERVER");
+    const char *no_cache = getenv("SSCC_NO_CACHE");
+    if (!local_only && !(no_server && *no_server && strcmp(no_server, "0") != 0) &&
+        !(no_cache && *no_cache && strcmp(no_cache, "0") != 0)) {
+        int status = try_server(argc, argv);
+        if (status >= 0) return status;
+    }
+    
+    return sscc_main(argc, argv);
 }
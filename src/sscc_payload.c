@@ -0,0 +1,201 @@
+// SSCC payload tool - attaches the core archive and TCC binary to the sscc
+// wrapper as a trailer (see payload.h), or swaps the core of a built sscc
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "archive.h"
+#include "hash.h"
+#include "payload.h"
+
+static unsigned char *read_file(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "Error: Cannot open %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long file_size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    
+    unsigned char *data = malloc(file_size > 0 ? file_size : 1);
+    if (!data || fread(data, 1, file_size, f) != (size_t)file_size) {
+        fprintf(stderr, "Error: Cannot read %s\n", path);
+        free(data);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+    *size = file_size;
+    return data;
+}
+
+static int write_padding(FILE *out, uint64_t *pos, uint64_t alignment) {
+    static const char zeros[PAYLOAD_ALIGN];
+    uint64_t pad = (alignment - *pos % alignment) % alignment;
+    *pos += pad;
+    return fwrite(zeros, 1, pad, out) == pad ? 0 : -1;
+}
+
+static int write_section(FILE *out, uint64_t *pos, const void *data, size_t size) {
+    *pos += size;
+    return fwrite(data, 1, size, out) == size ? 0 : -1;
+}
+
+// Writes image (without any previous payload), then core, its index and tcc,
+// to a temporary file renamed over output, so a running sscc never sees a
+// half-written executable
+static int write_executable(const char *output, const unsigned char *image, size_t image_size,
+                            const unsigned char *core, size_t core_size,
+                            const unsigned char *tcc, size_t tcc_size) {
+    // The core gets the perfect-hash path index the runtime looks files up with
+    uint32_t *index = NULL;
+    uint32_t index_size = 0;
+    Archive archive;
+    if (archive_open(&archive, core, core_size) != 0 || archive.kind != ARCHIVE_KIND_CORE) {
+        fprintf(stderr, "Error: Not a core archive\n");
+        return -1;
+    }
+    if (archive.version >= 2 && archive_build_index(&archive, &index, &index_size) != 0) {
+        fprintf(stderr, "Error: Cannot build path index\n");
+        archive_close(&archive);
+        return -1;
+    }
+    printf("Built path index for %u entries (%u words)\n", archive.file_count, index_size);
+    archive_close(&archive);
+    
+    char temp_path[4096];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmpXXXXXX", output);
+    int fd = mkstemp(temp_path);
+    FILE *out = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    if (!out) {
+        fprintf(stderr, "Error: Cannot create %s: %s\n", output, strerror(errno));
+        if (fd >= 0) close(fd);
+        free(index);
+        return -1;
+    }
+    
+    PayloadTrailer t;
+    memset(&t, 0, sizeof(t));
+    memcpy(t.magic, PAYLOAD_MAGIC, sizeof(t.magic));
+    t.image_size = image_size;
+    t.core_size = core_size;
+    t.core_hash = sscc_hash64(core, core_size, SSCC_HASH_INIT);
+    t.index_size = index_size;
+    t.tcc_size = tcc_size;
+    t.tcc_hash = sscc_hash64(tcc, tcc_size, SSCC_HASH_INIT);
+    
+    uint64_t pos = 0;
+    int ret = write_section(out, &pos, image, image_size);
+    ret |= write_padding(out, &pos, PAYLOAD_ALIGN);
+    t.core_offset = pos;
+    ret |= write_section(out, &pos, core, core_size);
+    ret |= write_padding(out, &pos, sizeof(uint32_t));
+    t.index_offset = pos;
+    ret |= write_section(out, &pos, index, index_size * sizeof(uint32_t));
+    ret |= write_padding(out, &pos, PAYLOAD_ALIGN);
+    t.tcc_offset = pos;
+    ret |= write_section(out, &pos, tcc, tcc_size);
+    ret |= write_section(out, &pos, &t, sizeof(t));
+    free(index);
+    
+    fchmod(fd, 0755);
+    if (fclose(out) != 0 || ret != 0 || rename(temp_path, output) != 0) {
+        fprintf(stderr, "Error: Cannot write %s\n", output);
+        unlink(temp_path);
+        return -1;
+    }
+    
+    printf("Attached core (%zu bytes) and TCC (%zu bytes) to %s (%llu bytes)\n",
+           core_size, tcc_size, output, (unsigned long long)pos);
+    return 0;
+}
+
+// Loads an executable and, if it already carries a payload, its trailer
+static unsigned char *read_executable(const char *path, size_t *size, PayloadTrailer *t, int *has_payload) {
+    unsigned char *data = read_file(path, size);
+    if (!data) return NULL;
+    
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    *has_payload = fd >= 0 && payload_read_trailer(fd, t) == 0;
+    if (fd >= 0) close(fd);
+    return data;
+}
+
+static int usage(const char *prog) {
+    fprintf(stderr, "Usage: %s attach <wrapper> <core.bin> <tcc> <output>\n", prog);
+    fprintf(stderr, "       %s set-core <sscc> <core.bin>\n", prog);
+    fprintf(stderr, "       %s info <sscc>\n", prog);
+    fprintf(stderr, "Example: %s attach sscc.wrapper core.bin sscc.bin sscc\n", prog);
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) return usage(argv[0]);
+    const char *command = argv[1];
+    
+    size_t exe_size;
+    PayloadTrailer t;
+    int has_payload;
+    unsigned char *exe;
+    
+    if (strcmp(command, "attach") == 0 && argc == 6) {
+        size_t core_size, tcc_size;
+        unsigned char *core = read_file(argv[3], &core_size);
+        unsigned char *tcc = core ? read_file(argv[4], &tcc_size) : NULL;
+        exe = tcc ? read_executable(argv[2], &exe_size, &t, &has_payload) : NULL;
+        int ret = exe ? write_executable(argv[5], exe, has_payload ? t.image_size : exe_size,
+                                         core, core_size, tcc, tcc_size) : -1;
+        free(core);
+        free(tcc);
+        free(exe);
+        return ret == 0 ? 0 : 1;
+    }
+    
+    if (strcmp(command, "set-core") == 0 && argc == 4) {
+        // Keeps the wrapper and TCC, replaces the core in place
+        size_t core_size;
+        unsigned char *core = read_file(argv[3], &core_size);
+        exe = core ? read_executable(argv[2], &exe_size, &t, &has_payload) : NULL;
+        if (exe && !has_payload) {
+            fprintf(stderr, "Error: %s has no payload; use attach\n", argv[2]);
+        }
+        int ret = exe && has_payload ?
+                  write_executable(argv[2], exe, t.image_size, core, core_size,
+                                   exe + t.tcc_offset, t.tcc_size) : -1;
+        free(core);
+        free(exe);
+        return ret == 0 ? 0 : 1;
+    }
+    
+    if (strcmp(command, "info") == 0 && argc == 3) {
+        exe = read_executable(argv[2], &exe_size, &t, &has_payload);
+        if (!exe) return 1;
+        if (!has_payload) {
+            printf("%s: no payload\n", argv[2]);
+            free(exe);
+            return 1;
+        }
+        printf("Wrapper: %llu bytes\n", (unsigned long long)t.image_size);
+        printf("Core:    %llu bytes at %llu, hash %016llx, index %llu words\n",
+               (unsigned long long)t.core_size, (unsigned long long)t.core_offset,
+               (unsigned long long)t.core_hash, (unsigned long long)t.index_size);
+        printf("TCC:     %llu bytes at %llu, hash %016llx\n",
+               (unsigned long long)t.tcc_size, (unsigned long long)t.tcc_offset,
+               (unsigned long long)t.tcc_hash);
+        
+        Archive core;
+        if (archive_open(&core, exe + t.core_offset, t.core_size) == 0) {
+            printf("Core archive: v%d, %u files (%u hot), %s\n", core.version, core.file_count,
+                   core.hot_count, archive_verify(&core) == 0 ? "checksum ok" : "CHECKSUM MISMATCH");
+            archive_close(&core);
+        }
+        free(exe);
+        return 0;
+    }
+    
+    return usage(argv[0]);
+}
@@ -0,0 +1,370 @@
+// Static library splitting and reassembly (see staticlib.h)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <elf.h>
+#include "staticlib.h"
+
+#define AR_MAGIC "!<arch>\n"
+#define AR_HEADER_SIZE 60
+#define AR_SHORT_NAME 15            // longer names go to the "//" table
+
+static int parse_decimal(const char *field, size_t len, size_t *value) {
+    size_t v = 0, i = 0;
+    while (i < len && field[i] == ' ') i++;
+    if (i == len || field[i] < '0' || field[i] > '9') return -1;
+    for (; i < len && field[i] >= '0' && field[i] <= '9'; i++) {
+        v = v * 10 + (field[i] - '0');
+    }
+    for (; i < len; i++) {
+        if (field[i] != ' ') return -1;
+    }
+    *value = v;
+    return 0;
+}
+
+int ar_parse(const unsigned char *data, size_t size, ArMember **members, uint32_t *count) {
+    *members = NULL;
+    *count = 0;
+    if (size < 8 || memcmp(data, AR_MAGIC, 8) != 0) return -1;
+    
+    ArMember *list = NULL;
+    uint32_t used = 0, capacity = 0;
+    const char *long_names = NULL;
+    size_t long_names_size = 0;
+    size_t pos = 8;
+    while (pos < size) {
+        const char *h = (const char*)data + pos;
+        size_t member_size;
+        if (size - pos < AR_HEADER_SIZE || memcmp(h + 58, "`\n", 2) != 0 ||
+            parse_decimal(h + 48, 10, &member_size) != 0 ||
+            member_size > size - pos - AR_HEADER_SIZE) {
+            goto bad;
+        }
+        const unsigned char *member = data + pos + AR_HEADER_SIZE;
+        pos += AR_HEADER_SIZE + member_size + (member_size & 1);
+        
+        const char *name = h;
+        size_t name_len;
+        if (memcmp(h, "/ ", 2) == 0 || memcmp(h, "/SYM64/ ", 8) == 0) {
+            continue;
+        } else if (memcmp(h, "// ", 3) == 0) {
+            long_names = (const char*)member;
+            long_names_size = member_size;
+            continue;
+        } else if (h[0] == '/') {
+            // "/N": name at offset N of the long-name table, ended by "/\n"
+            size_t offset;
+            if (!long_names || parse_decimal(h + 1, 15, &offset) != 0 || offset >= long_names_size) {
+                goto bad;
+            }
+            name = long_names + offset;
+            const char *end = memchr(name, '\n', long_names_size - offset);
+            if (!end || end == name || end[-1] != '/') goto bad;
+            name_len = end - 1 - name;
+        } else {
+            // "name/"; BSD archives ("#1/N", no terminator) are not supported
+            const char *slash = memchr(h, '/', 16);
+            if (!slash || (slash == h + 2 && memcmp(h, "#1", 2) == 0)) goto bad;
+            name_len = slash - h;
+        }
+        
+        if (used == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            ArMember *grown = realloc(list, capacity * sizeof(ArMember));
+            if (!grown) goto bad;
+            list = grown;
+        }
+        list[used].name = name;
+        list[used].name_len = name_len;
+        list[used].data = member;
+        list[used].size = member_size;
+        used++;
+    }
+    
+    *members = list;
+    *count = used;
+    return 0;
+
+bad:
+    free(list);
+    return -1;
+}
+
+int elf_object_symbols(const unsigned char *data, size_t size, ElfSymbolFn fn, void *ctx) {
+    Elf64_Ehdr eh;
+    if (size < sizeof(eh)) return -1;
+    memcpy(&eh, data, sizeof(eh));
+    if (memcmp(eh.e_ident, ELFMAG, SELFMAG) != 0 || eh.e_ident[EI_CLASS] != ELFCLASS64 ||
+        eh.e_ident[EI_DATA] != ELFDATA2LSB || eh.e_type != ET_REL ||
+        eh.e_shentsize != sizeof(Elf64_Shdr) || eh.e_shoff > size ||
+        (uint64_t)eh.e_shnum * sizeof(Elf64_Shdr) > size - eh.e_shoff) {
+        return -1;
+    }
+    
+    for (uint32_t s = 0; s < eh.e_shnum; s++) {
+        Elf64_Shdr symtab, strtab;
+        memcpy(&symtab, data + eh.e_shoff + s * sizeof(Elf64_Shdr), sizeof(symtab));
+        if (symtab.sh_type != SHT_SYMTAB) continue;
+        if (symtab.sh_link >= eh.e_shnum || symtab.sh_offset > size ||
+            symtab.sh_size > size - symtab.sh_offset) {
+            return -1;
+        }
+        memcpy(&strtab, data + eh.e_shoff + symtab.sh_link * sizeof(Elf64_Shdr), sizeof(strtab));
+        if (strtab.sh_offset > size || strtab.sh_size > size - strtab.sh_offset || strtab.sh_size == 0 ||
+            data[strtab.sh_offset + strtab.sh_size - 1] != '\0') {
+            return -1;
+        }
+        
+        const char *names = (const char*)data + strtab.sh_offset;
+        for (uint64_t i = 1; i < symtab.sh_size / sizeof(Elf64_Sym); i++) {
+            Elf64_Sym sym;
+            memcpy(&sym, data + symtab.sh_offset + i * sizeof(Elf64_Sym), sizeof(sym));
+            int bind = ELF64_ST_BIND(sym.st_info);
+            if ((bind != STB_GLOBAL && bind != STB_WEAK) || sym.st_name == 0 ||
+                sym.st_name >= strtab.sh_size) {
+                continue;
+            }
+            fn(ctx, names + sym.st_name, sym.st_shndx != SHN_UNDEF);
+        }
+    }
+    return 0;
+}
+
+// Index building: symbols are collected per member into growable arrays of
+// string table offsets
+typedef struct {
+    uint32_t *items;
+    uint32_t count;
+    uint32_t capacity;
+} U32List;
+
+typedef struct {
+    char *strtab;
+    size_t strtab_size;
+    size_t strtab_capacity;
+    U32List defs;
+    U32List undefs;
+    int failed;
+} IndexBuild;
+
+static int list_push(U32List *l, uint32_t value) {
+    if (l->count == l->capacity) {
+        uint32_t capacity = l->capacity ? l->capacity * 2 : 256;
+        uint32_t *items = realloc(l->items, capacity * sizeof(uint32_t));
+        if (!items) return -1;
+        l->items = items;
+        l->capacity = capacity;
+    }
+    l->items[l->count++] = value;
+    return 0;
+}
+
+static int add_string(IndexBuild *b, const char *s, size_t len, uint32_t *offset) {
+    if (b->strtab_size + len + 1 > b->strtab_capacity) {
+        size_t capacity = (b->strtab_size + len + 1) * 2;
+        char *grown = realloc(b->strtab, capacity);
+        if (!grown) return -1;
+        b->strtab = grown;
+        b->strtab_capacity = capacity;
+    }
+    if (b->strtab_size + len + 1 > UINT32_MAX) return -1;
+    *offset = b->strtab_size;
+    memcpy(b->strtab + b->strtab_size, s, len);
+    b->strtab[b->strtab_size + len] = '\0';
+    b->strtab_size += len + 1;
+    return 0;
+}
+
+static void collect_symbol(void *ctx, const char *name, int defined) {
+    IndexBuild *b = ctx;
+    uint32_t offset;
+    if (add_string(b, name, strlen(name), &offset) != 0 ||
+        list_push(defined ? &b->defs : &b->undefs, offset) != 0) {
+        b->failed = 1;
+    }
+}
+
+int staticlib_build_index(const ArMember *members, uint32_t count, unsigned char **index, size_t *size) {
+    IndexBuild b;
+    memset(&b, 0, sizeof(b));
+    StaticLibMember *entries = calloc(count + 1, sizeof(StaticLibMember));
+    int ret = -1;
+    if (!entries) return -1;
+    
+    for (uint32_t i = 0; i < count && !b.failed; i++) {
+        if (members[i].size > UINT32_MAX ||
+            add_string(&b, members[i].name, members[i].name_len, &entries[i].name_offset) != 0) {
+            goto out;
+        }
+        entries[i].size = members[i].size;
+        entries[i].def_first = b.defs.count;
+        entries[i].undef_first = b.undefs.count;
+        if (elf_object_symbols(members[i].data, members[i].size, collect_symbol, &b) != 0) goto out;
+        entries[i].def_count = b.defs.count - entries[i].def_first;
+        entries[i].undef_count = b.undefs.count - entries[i].undef_first;
+    }
+    if (b.failed) goto out;
+    
+    StaticLibIndexHeader h;
+    memcpy(h.magic, STATICLIB_INDEX_MAGIC, 4);
+    h.member_count = count;
+    h.def_count = b.defs.count;
+    h.undef_count = b.undefs.count;
+    h.strtab_size = b.strtab_size;
+    
+    *size = sizeof(h) + count * sizeof(StaticLibMember) +
+            ((size_t)h.def_count + h.undef_count) * sizeof(uint32_t) + b.strtab_size;
+    unsigned char *out = malloc(*size);
+    if (!out) goto out;
+    size_t pos = 0;
+    memcpy(out + pos, &h, sizeof(h));
+    pos += sizeof(h);
+    memcpy(out + pos, entries, count * sizeof(StaticLibMember));
+    pos += count * sizeof(StaticLibMember);
+    memcpy(out + pos, b.defs.items, h.def_count * sizeof(uint32_t));
+    pos += h.def_count * sizeof(uint32_t);
+    memcpy(out + pos, b.undefs.items, h.undef_count * sizeof(uint32_t));
+    pos += h.undef_count * sizeof(uint32_t);
+    memcpy(out + pos, b.strtab, b.strtab_size);
+    *index = out;
+    ret = 0;
+
+out:
+    free(entries);
+    free(b.strtab);
+    free(b.defs.items);
+    free(b.undefs.items);
+    return ret;
+}
+
+int staticlib_open_index(StaticLibIndex *idx, const void *data, size_t size) {
+    StaticLibIndexHeader h;
+    if (size < sizeof(h)) return -1;
+    memcpy(&h, data, sizeof(h));
+    if (memcmp(h.magic, STATICLIB_INDEX_MAGIC, 4) != 0) return -1;
+    
+    uint64_t tables = sizeof(h) + (uint64_t)h.member_count * sizeof(StaticLibMember) +
+                      ((uint64_t)h.def_count + h.undef_count) * sizeof(uint32_t);
+    if (tables > size || h.strtab_size != size - tables || h.strtab_size == 0 ||
+        ((const char*)data)[size - 1] != '\0') {
+        return -1;
+    }
+    
+    // The index is decoded into a malloc'd buffer, so the tables are aligned
+    const unsigned char *p = data;
+    idx->member_count = h.member_count;
+    idx->members = (const StaticLibMember*)(p + sizeof(h));
+    idx->defs = (const uint32_t*)(idx->members + h.member_count);
+    idx->undefs = idx->defs + h.def_count;
+    idx->strtab = (const char*)(idx->undefs + h.undef_count);
+    idx->strtab_size = h.strtab_size;
+    
+    for (uint32_t i = 0; i < h.member_count; i++) {
+        const StaticLibMember *m = &idx->members[i];
+        if (m->name_offset >= h.strtab_size ||
+            (uint64_t)m->def_first + m->def_count > h.def_count ||
+            (uint64_t)m->undef_first + m->undef_count > h.undef_count) {
+            return -1;
+        }
+    }
+    for (uint32_t i = 0; i < h.def_count + h.undef_count; i++) {
+        if (idx->defs[i] >= h.strtab_size) return -1;
+    }
+    return 0;
+}
+
+static void ar_header(unsigned char *p, const char *name, size_t size, const char *mode) {
+    char header[AR_HEADER_SIZE + 32];
+    snprintf(header, sizeof(header), "%-16.16s%-12s%-6s%-6s%-8s%-10zu`\n", name, "0", "0", "0", mode, size);
+    memcpy(p, header, AR_HEADER_SIZE);
+}
+
+static void put_be32(unsigned char *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+int staticlib_write(const StaticLibIndex *idx, const unsigned char *const *data,
+                    const uint8_t *selected, unsigned char **out, size_t *out_size) {
+    // Sizes of the symbol table and long-name table come first: the symbol
+    // table holds the offsets of the members that follow both
+    size_t symbols = 0, symbol_names = 0, long_names = 0;
+    for (uint32_t i = 0; i < idx->member_count; i++) {
+        if (selected && !selected[i]) continue;
+        const StaticLibMember *m = &idx->members[i];
+        symbols += m->def_count;
+        for (uint32_t d = 0; d < m->def_count; d++) {
+            symbol_names += strlen(staticlib_string(idx, idx->defs[m->def_first + d])) + 1;
+        }
+        size_t name_len = strlen(staticlib_string(idx, m->name_offset));
+        if (name_len > AR_SHORT_NAME) long_names += name_len + 2;
+    }
+    if (symbols > UINT32_MAX) return -1;
+    
+    size_t armap_size = 4 + symbols * 4 + symbol_names;
+    size_t pos = 8 + AR_HEADER_SIZE + armap_size + (armap_size & 1);
+    if (long_names) pos += AR_HEADER_SIZE + long_names + (long_names & 1);
+    size_t first_member = pos;
+    for (uint32_t i = 0; i < idx->member_count; i++) {
+        if (selected && !selected[i]) continue;
+        pos += AR_HEADER_SIZE + idx->members[i].size + (idx->members[i].size & 1);
+    }
+    if (pos > UINT32_MAX) return -1;
+    
+    unsigned char *buf = malloc(pos);
+    if (!buf) return -1;
+    memset(buf, '\n', pos);     // odd-sized members are padded with a newline
+    memcpy(buf, AR_MAGIC, 8);
+    
+    unsigned char *armap = buf + 8 + AR_HEADER_SIZE;
+    ar_header(buf + 8, "/", armap_size, "0");
+    put_be32(armap, symbols);
+    unsigned char *offsets = armap + 4;
+    char *names = (char*)armap + 4 + symbols * 4;
+    
+    char *table = NULL;
+    size_t table_used = 0;
+    if (long_names) {
+        unsigned char *h = armap + armap_size + (armap_size & 1);
+        ar_header(h, "//", long_names, "");
+        table = (char*)h + AR_HEADER_SIZE;
+    }
+    
+    pos = first_member;
+    for (uint32_t i = 0; i < idx->member_count; i++) {
+        if (selected && !selected[i]) continue;
+        const StaticLibMember *m = &idx->members[i];
+        const char *name = staticlib_string(idx, m->name_offset);
+        size_t name_len = strlen(name);
+        
+        char header_name[32];
+        if (name_len > AR_SHORT_NAME) {
+            snprintf(header_name, sizeof(header_name), "/%zu", table_used);
+            memcpy(table + table_used, name, name_len);
+            memcpy(table + table_used + name_len, "/\n", 2);
+            table_used += name_len + 2;
+        } else {
+            snprintf(header_name, sizeof(header_name), "%s/", name);
+        }
+        
+        for (uint32_t d = 0; d < m->def_count; d++) {
+            const char *symbol = staticlib_string(idx, idx->defs[m->def_first + d]);
+            size_t len = strlen(symbol) + 1;
+            put_be32(offsets, pos);
+            offsets += 4;
+            memcpy(names, symbol, len);
+            names += len;
+        }
+        
+        ar_header(buf + pos, header_name, m->size, "644");
+        memcpy(buf + pos + AR_HEADER_SIZE, data[i], m->size);
+        pos += AR_HEADER_SIZE + m->size + (m->size & 1);
+    }
+    
+    *out = buf;
+    *out_size = pos;
+    return 0;
+}
@@ -0,0 +1,80 @@
+// Static libraries split into members, shared by embed_resources and sscc
+#ifndef SSCC_STATICLIB_H
+#define SSCC_STATICLIB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// embed_resources stores lib/X.a as one entry per object member plus a
+// symbol index, under STATICLIB_MEMBER_DIR "X.a/":
+//   lib/.members/X.a/index        StaticLibIndexHeader, members, symbols
+//   lib/.members/X.a/<n>          member n as it was in the archive
+// sscc writes lib/X.a back at link time, holding only the members the
+// program can reach (or all of them, see staticlib_write).
+#define STATICLIB_MEMBER_DIR "lib/.members/"
+#define STATICLIB_INDEX_NAME "index"
+#define STATICLIB_INDEX_MAGIC "SSLI"
+
+// Index layout: header, StaticLibMember[member_count], u32 defs[def_count],
+// u32 undefs[undef_count] (string table offsets), then the string table.
+// Little-endian, like the archive format.
+typedef struct {
+    char magic[4];
+    uint32_t member_count;
+    uint32_t def_count;
+    uint32_t undef_count;
+    uint32_t strtab_size;
+} StaticLibIndexHeader;
+
+typedef struct {
+    uint32_t name_offset;       // member name, as listed by `ar t`
+    uint32_t size;
+    uint32_t def_first;         // global and weak symbols the member defines
+    uint32_t def_count;
+    uint32_t undef_first;       // and the ones it references
+    uint32_t undef_count;
+} StaticLibMember;
+
+typedef struct {
+    uint32_t member_count;
+    const StaticLibMember *members;
+    const uint32_t *defs;
+    const uint32_t *undefs;
+    const char *strtab;
+    uint32_t strtab_size;
+} StaticLibIndex;
+
+// One object of an ar archive; name is not NUL-terminated
+typedef struct {
+    const char *name;
+    size_t name_len;
+    const unsigned char *data;
+    size_t size;
+} ArMember;
+
+// Lists the members of a GNU/System V ar archive, skipping its symbol and
+// long-name tables. Returns -1 for anything else (thin or BSD archives).
+int ar_parse(const unsigned char *data, size_t size, ArMember **members, uint32_t *count);
+
+// Calls fn for every global or weak symbol of an ELF64 relocatable object,
+// with defined = 0 for references. Returns -1 if data is not such an object.
+typedef void (*ElfSymbolFn)(void *ctx, const char *name, int defined);
+int elf_object_symbols(const unsigned char *data, size_t size, ElfSymbolFn fn, void *ctx);
+
+// Builds the index of an archive's members. Fails if a member is not an
+// object elf_object_symbols understands, so such libraries stay whole.
+int staticlib_build_index(const ArMember *members, uint32_t count, unsigned char **index, size_t *size);
+int staticlib_open_index(StaticLibIndex *idx, const void *data, size_t size);
+
+static inline const char *staticlib_string(const StaticLibIndex *idx, uint32_t offset) {
+    return idx->strtab + offset;
+}
+
+// Writes an ar archive of the members with selected[i] set (every member if
+// selected is NULL), in index order and with a symbol table of what they
+// define, so the linker picks the same member for each symbol as it would
+// from the original. data[i] holds member i. Returns a malloc'd buffer.
+int staticlib_write(const StaticLibIndex *idx, const unsigned char *const *data,
+                    const uint8_t *selected, unsigned char **out, size_t *out_size);
+                    
+#endif
@@ -0,0 +1,118 @@
+// Chrome trace recording (see trace.h)
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "trace.h"
+
+int trace_fd = -1;
+static pid_t trace_owner = 0;
+static uint64_t trace_start = 0;
+
+uint64_t trace_now(void) {
+    if (trace_fd < 0) return 0;
+    
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Copies s into out as the body of a JSON string, truncating if needed
+static void json_escape(char *out, size_t out_size, const char *s) {
+    size_t used = 0;
+    for (; *s && used + 7 < out_size; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            out[used++] = '\\';
+            out[used++] = c;
+        } else if (c < 0x20) {
+            used += snprintf(out + used, out_size - used, "\\u%04x", c);
+        } else {
+            out[used++] = c;
+        }
+    }
+    out[used] = '\0';
+}
+
+// Instant events (phase 'i') are thread-scoped and carry no duration
+static void trace_event(const char *name, char phase, uint64_t start, uint64_t duration,
+                        const char *detail) {
+    char timing[64], args[1100] = "", event[1536];
+    if (phase == 'X') {
+        snprintf(timing, sizeof(timing), "\"ts\":%llu,\"dur\":%llu",
+                 (unsigned long long)start, (unsigned long long)duration);
+    } else {
+        snprintf(timing, sizeof(timing), "\"ts\":%llu,\"s\":\"t\"", (unsigned long long)start);
+    }
+    if (detail) {
+        char escaped[1024];
+        json_escape(escaped, sizeof(escaped), detail);
+        snprintf(args, sizeof(args), ",\"args\":{\"detail\":\"%s\"}", escaped);
+    }
+    
+    int n = snprintf(event, sizeof(event),
+                     ",\n{\"name\":\"%s\",\"cat\":\"sscc\",\"ph\":\"%c\",%s,\"pid\":%d,\"tid\":%ld%s}",
+                     name, phase, timing, (int)getpid(), (long)syscall(SYS_gettid), args);
+    if (n > 0 && (size_t)n < sizeof(event)) {
+        ssize_t written = write(trace_fd, event, n);
+        (void)written;
+    }
+}
+
+void trace_span(const char *name, uint64_t start, const char *detail) {
+    if (trace_fd < 0) return;
+    trace_event(name, 'X', start, trace_now() - start, detail);
+}
+
+void trace_instant(const char *name, const char *detail) {
+    if (trace_fd < 0) return;
+    trace_event(name, 'i', trace_now(), 0, detail);
+}
+
+int trace_open(const char *path) {
+    // Every event starts with a comma, after the metadata event of the
+    // process that created the file. That one links the file into place
+    // already holding "[" and its metadata, so nobody appends before them.
+    char meta[256], temp[4096 + 32];
+    int n = snprintf(meta, sizeof(meta),
+                     "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+                     "\"args\":{\"name\":\"sscc\"}}", (int)getpid());
+    int created = 0;
+    int fd = open(path, O_WRONLY | O_APPEND | O_CLOEXEC);
+    if (fd < 0 && errno == ENOENT &&
+        snprintf(temp, sizeof(temp), "%s.%d.tmp", path, (int)getpid()) < (int)sizeof(temp)) {
+        int temp_fd = open(temp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (temp_fd >= 0) {
+            int written = write(temp_fd, "[\n", 2) == 2 && write(temp_fd, meta, n) == n;
+            close(temp_fd);
+            created = written && link(temp, path) == 0;
+            unlink(temp);
+        }
+        fd = open(path, O_WRONLY | O_APPEND | O_CLOEXEC);
+    }
+    if (fd < 0) return -1;
+    
+    char header[260];
+    int header_len = snprintf(header, sizeof(header), ",\n%s", meta);
+    if (!created && write(fd, header, header_len) != header_len) {
+        close(fd);
+        return -1;
+    }
+    
+    trace_fd = fd;
+    trace_owner = getpid();
+    trace_start = trace_now();
+    return 0;
+}
+
+void trace_close(void) {
+    if (trace_fd < 0) return;
+    if (getpid() == trace_owner) {
+        trace_span("sscc", trace_start, NULL);
+    }
+    close(trace_fd);
+    trace_fd = -1;
+}
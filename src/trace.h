@@ -0,0 +1,34 @@
+// Chrome trace recording for --sscc-trace=FILE / SSCC_TRACE=FILE
+#ifndef SSCC_TRACE_H
+#define SSCC_TRACE_H
+
+#include <stdint.h>
+
+// The file holds a JSON array of trace events that Perfetto and
+// chrome://tracing load directly. Each event is appended with a single
+// O_APPEND write(), so pool threads, forked children (compile jobs, the tcc
+// fork) and other sscc processes tracing into the same path record into one
+// file without locking. An existing file is appended to, never truncated,
+// and the array is left open: the trace format does not need the closing
+// bracket, and no process knows it is the last one.
+extern int trace_fd;
+
+static inline int trace_enabled(void) {
+    return trace_fd >= 0;
+}
+
+// Returns 0 on success; tracing stays off on failure
+int trace_open(const char *path);
+void trace_close(void);
+
+// Microseconds on CLOCK_MONOTONIC, which all processes share; 0 when off
+uint64_t trace_now(void);
+
+// Complete event covering [start, now). detail is optional and shows up
+// as the event's argument, e.g. the file being written.
+void trace_span(const char *name, uint64_t start, const char *detail);
+
+// Zero-length event, for points such as the exec of tcc
+void trace_instant(const char *name, const char *detail);
+
+#endif